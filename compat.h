@@ -148,6 +148,7 @@ off_t compat_file_get_length( compat_fd fd );
 int compat_file_read( compat_fd fd, struct utils_file *file );
 int compat_file_write( compat_fd fd, const unsigned char *buffer,
                        size_t length );
+int compat_file_flush( compat_fd fd );
 int compat_file_close( compat_fd fd );
 int compat_file_exists( const char *path );
 
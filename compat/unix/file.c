@@ -97,6 +97,17 @@ compat_file_write( compat_fd fd, const unsigned char *buffer, size_t length )
   return 0;
 }
 
+int
+compat_file_flush( compat_fd fd )
+{
+  if( fflush( fd ) ) {
+    ui_error( UI_ERROR_ERROR, "error writing file: %s", strerror( errno ) );
+    return 1;
+  }
+
+  return 0;
+}
+
 int
 compat_file_close( compat_fd fd )
 {
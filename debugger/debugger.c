@@ -184,11 +184,18 @@ debugger_port_write( libspectrum_word port, libspectrum_byte value )
 /* Exit the emulator */
 void
 debugger_exit_emulator( debugger_expression *exit_code_expression )
+{
+  debugger_exit_emulator_with_code( exit_code_expression ?
+    debugger_expression_evaluate( exit_code_expression ) : 0 );
+}
+
+/* Exit the emulator with a given exit code */
+void
+debugger_exit_emulator_with_code( int code )
 {
   fuse_exiting = 1;
 
-  exit_code = exit_code_expression ?
-    debugger_expression_evaluate( exit_code_expression ) : 0;
+  exit_code = code;
 
   /* Ensure we break out of the main Z80 loop immediately */
   event_add( 0, event_type_null );
@@ -81,6 +81,7 @@ void debugger_event( int event_code );
 
 /* Exit the emulator */
 void debugger_exit_emulator( debugger_expression *exit_code_expression );
+void debugger_exit_emulator_with_code( int code );
 
 /* Get the exit code to be used when exiting the emulator */
 int debugger_get_exit_code( void );
@@ -39,6 +39,7 @@
 #include "screenshot.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "timer/timer.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
 
@@ -98,6 +99,16 @@ static libspectrum_qword display_all_dirty;
 /* Used to signify that we're redrawing the entire screen */
 static int display_redraw_all;
 
+/* A hash of the contents of display_last_screen, maintained incrementally
+   as chunks are redrawn */
+static libspectrum_qword display_frame_hash;
+
+/* The hash of the frame last sent to the UI */
+static libspectrum_qword display_presented_hash;
+
+/* Set if the frame last sent to the UI differed from the one before it */
+static int display_frame_changed = 1;
+
 /* The last point at which we updated the screen display */
 int critical_region_x = 0, critical_region_y = 0;
 
@@ -122,16 +133,43 @@ static void display_dirty64( libspectrum_word address );
 static void display_get_attr( int x, int y,
 			      libspectrum_byte *ink, libspectrum_byte *paper);
 
+/* The border changes in this frame; the array is kept between frames and
+   only ever grows, so it quickly reaches the size needed by the busiest
+   frame */
 static int border_changes_last = 0;
+static int border_changes_size = 0;
 static struct border_change_t *border_changes = NULL;
 
+/* Mix the contents of one chunk of display_last_screen into a 64-bit value;
+   the frame hash is the XOR of this over every chunk */
+static inline libspectrum_qword
+chunk_hash( int index, libspectrum_dword chunk_detail )
+{
+  libspectrum_qword h = ( (libspectrum_qword)index << 32 ) | chunk_detail;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+/* Record the new contents of a chunk, keeping the frame hash up to date */
+static inline void
+set_last_screen( int index, libspectrum_dword chunk_detail )
+{
+  display_frame_hash ^= chunk_hash( index, display_last_screen[ index ] ) ^
+                        chunk_hash( index, chunk_detail );
+  display_last_screen[ index ] = chunk_detail;
+}
+
 static struct border_change_t *
 alloc_change(void)
 {
-  static int border_changes_size = 0;
-
   if( border_changes_size == border_changes_last ) {
-    border_changes_size += 10;
+    border_changes_size = border_changes_size ? 2 * border_changes_size : 64;
     border_changes = libspectrum_renew( struct border_change_t,
                                         border_changes, border_changes_size );
   }
@@ -190,7 +228,7 @@ display_init( int *argc, char ***argv )
 
   display_refresh_all();
 
-  border_changes_last = 0;
+  border_changes_last = border_changes_size = 0;
   if( border_changes ) {
     libspectrum_free( border_changes );
   }
@@ -413,7 +451,7 @@ display_write_if_dirty_timex( int x, int y )
     }
 
     /* Update last display record */
-    display_last_screen[ index ] = last_chunk_detail;
+    set_last_screen( index, last_chunk_detail );
 
     /* And now mark it dirty */
     display_is_dirty[ beam_y ] |= ( (libspectrum_qword)1 << beam_x );
@@ -494,7 +532,7 @@ display_write_if_dirty_pentagon_16_col( int x, int y )
     uidisplay_putpixel( draw_x  , beam_y, colour2 );
 
     /* Update last display record */
-    display_last_screen[ index ] = last_chunk_detail;
+    set_last_screen( index, last_chunk_detail );
 
     /* And now mark it dirty */
     display_is_dirty[ beam_y ] |= ( (libspectrum_qword)1 << beam_x );
@@ -529,7 +567,7 @@ display_write_if_dirty_sinclair( int x, int y )
     uidisplay_plot8( beam_x, beam_y, data, ink, paper );
 
     /* Update last display record */
-    display_last_screen[ index ] = last_chunk_detail;
+    set_last_screen( index, last_chunk_detail );
 
     /* And now mark it dirty */
     display_is_dirty[ beam_y ] |= ( (libspectrum_qword)1 << beam_x );
@@ -730,6 +768,21 @@ push_border_change( int colour )
   if( beam_x > DISPLAY_SCREEN_WIDTH_COLS ) beam_x = DISPLAY_SCREEN_WIDTH_COLS;
   if( beam_y < 0 ) beam_y = 0;
 
+  /* Several changes at the same beam position (e.g. before the top of the
+     screen or during the horizontal retrace) can only show the last
+     colour; if that is the colour which was already in use, the change
+     disappears entirely. The first entry is the sentinel, which is never
+     removed */
+  change = &border_changes[ border_changes_last - 1 ];
+  if( change->x == beam_x && change->y == beam_y ) {
+    if( border_changes_last > 1 && change[-1].colour == colour ) {
+      border_changes_last--;
+    } else {
+      change->colour = colour;
+    }
+    return;
+  }
+
   change = alloc_change();
 
   change->x = beam_x;
@@ -774,21 +827,29 @@ static void
 set_border( int y, int start, int end, int colour )
 {
   libspectrum_dword chunk_detail = colour << 11;
-  int index = start + y * DISPLAY_SCREEN_WIDTH_COLS;
+  libspectrum_dword *last = &display_last_screen[ y * DISPLAY_SCREEN_WIDTH_COLS ];
+  int run;
 
-  for( ; start < end; start++ ) {
-    /* Draw it if it is different to what was there last time - we know that
-    data and mode will have been the same */
-    if( display_last_screen[ index ] != chunk_detail ) {
-      uidisplay_plot8( start, y, 0x00, 0, colour );
+  while( start < end ) {
 
-      /* Update last display record */
-      display_last_screen[ index ] = chunk_detail;
-
-      /* And now mark it dirty */
-      display_is_dirty[y] |= ( (libspectrum_qword)1 << start );
+    /* Skip chunks which are unchanged since last time - we know that data
+       and mode will have been the same */
+    if( last[ start ] == chunk_detail ) {
+      start++;
+      continue;
     }
-    index++;
+
+    /* Find the run of chunks which have changed and draw them all at once */
+    for( run = start; run < end && last[ run ] != chunk_detail; run++ )
+      set_last_screen( y * DISPLAY_SCREEN_WIDTH_COLS + run, chunk_detail );
+
+    uidisplay_fill8( start, y, run - start, colour );
+
+    /* And now mark them dirty */
+    display_is_dirty[y] |=
+      ( ( (libspectrum_qword)1 << ( run - start ) ) - 1 ) << start;
+
+    start = run;
   }
 }
 
@@ -892,12 +953,23 @@ update_ui_screen( void )
   size_t i;
   struct rectangle *ptr;
 
+  /* Nothing is shown while turbo loading; the whole screen is redrawn
+     when it finishes */
+  if( timer_turbo_active() ) {
+    rectangle_clear();
+    return;
+  }
+
   if( settings_current.frame_rate <= ++frame_count ) {
     frame_count = 0;
     if( movie_recording ) {
       movie_start_frame();
     }
 
+    display_frame_changed = display_redraw_all ||
+                            display_frame_hash != display_presented_hash;
+    display_presented_hash = display_frame_hash;
+
     if( display_redraw_all ) {
       if( movie_recording ) {
         movie_add_area( 0, 0, DISPLAY_ASPECT_WIDTH >> 3,
@@ -907,7 +979,10 @@ update_ui_screen( void )
                       scale * DISPLAY_ASPECT_WIDTH,
                       scale * DISPLAY_SCREEN_HEIGHT );
       display_redraw_all = 0;
-    } else {
+    } else if( display_frame_changed ) {
+      /* If the frame is the same as the one last sent to the UI, any
+         rectangles are changes which have since been undone (e.g. when
+         skipping frames) and needn't be redrawn or recorded */
       for( i = 0, ptr = rectangle_inactive;
            i < rectangle_inactive_count;
            i++, ptr++ ) {
@@ -919,7 +994,7 @@ update_ui_screen( void )
       }
     }
 
-    rectangle_inactive_count = 0;
+    rectangle_clear();
 
     uidisplay_frame_end();
   }
@@ -1025,6 +1100,16 @@ void display_refresh_all(void)
   memset( display_last_screen, 0xff,
           DISPLAY_SCREEN_WIDTH_COLS * DISPLAY_SCREEN_HEIGHT 
           * sizeof(libspectrum_dword) );
+
+  display_frame_hash = 0;
+  for( i = 0; i < DISPLAY_SCREEN_WIDTH_COLS * DISPLAY_SCREEN_HEIGHT; i++ )
+    display_frame_hash ^= chunk_hash( i, display_last_screen[i] );
+}
+
+libspectrum_qword
+display_get_frame_hash( void )
+{
+  return display_frame_hash;
 }
 
 /* Fetch pixel (x, y). On a Timex this will be a point on a 640x480 canvas,
@@ -116,6 +116,9 @@ int display_frame(void);
 void display_refresh_main_screen(void);
 void display_refresh_all(void);
 
+/* A hash of the visible frame (including the border) */
+libspectrum_qword display_get_frame_hash( void );
+
 #define display_get_offset( x, y ) display_line_start[(y)]+(x)
 
 #define display_get_addr( x, y ) \
@@ -59,6 +59,7 @@
 #include "fuse.h"
 #include "infrastructure/startup_manager.h"
 #include "keyboard.h"
+#include "loader.h"
 #include "machine.h"
 #include "machines/machines_periph.h"
 #include "memory_pages.h"
@@ -94,13 +95,16 @@
 #include "pokefinder/pokemem.h"
 #include "profile.h"
 #include "psg.h"
+#include "rewind.h"
 #include "rzx.h"
+#include "rzx_verify.h"
 #include "screenshot.h"
 #include "settings.h"
 #include "slt.h"
 #include "snapshot.h"
 #include "sound.h"
 #include "spectrum.h"
+#include "state.h"
 #include "tape.h"
 #include "timer/timer.h"
 #include "ui/scaler/scaler.h"
@@ -194,6 +198,10 @@ int main(int argc, char **argv)
   if( settings_current.show_help ||
       settings_current.show_version ) return 0;
 
+  /* The process controlling RZX verification doesn't emulate anything */
+  if( settings_current.rzx_verify && !rzx_verify_worker() )
+    return rzx_verify_exit_code();
+
   if( settings_current.unittests ) {
     r = unittests_run();
   } else {
@@ -314,6 +322,7 @@ run_startup_manager( int *argc, char ***argv )
   keyboard_register_startup();
   libspectrum_register_startup();
   libxml2_register_startup();
+  loader_register_startup();
   machine_register_startup();
   machines_periph_register_startup();
   melodik_register_startup();
@@ -326,6 +335,7 @@ run_startup_manager( int *argc, char ***argv )
   printer_register_startup();
   profile_register_startup();
   psg_register_startup();
+  rewind_register_startup();
   rzx_register_startup();
   scld_register_startup();
   screenshot_register_startup();
@@ -338,6 +348,7 @@ run_startup_manager( int *argc, char ***argv )
   specdrum_register_startup();
   spectranet_register_startup();
   spectrum_register_startup();
+  state_register_startup();
   tape_register_startup();
   ttx2000s_register_startup();
   timer_register_startup();
@@ -385,9 +396,15 @@ static int fuse_init(int argc, char **argv)
     return 0;
   }
 
+  if( settings_current.rzx_verify ) {
+    error = rzx_verify_start( argc, argv, first_arg );
+    if( error ) return error;
+    if( !rzx_verify_worker() ) return 0;
+  }
+
   start_scaler = utils_safe_strdup( settings_current.start_scaler_mode );
 
-  fuse_show_copyright();
+  if( !settings_current.rzx_verify ) fuse_show_copyright();
 
   if( run_startup_manager( &argc, &argv ) ) return 1;
 
@@ -398,7 +415,8 @@ static int fuse_init(int argc, char **argv)
   if( error ) return error;
 
   if( setup_start_files( &start_files ) ) return 1;
-  if( parse_nonoption_args( argc, argv, first_arg, &start_files ) ) return 1;
+  if( !settings_current.rzx_verify &&
+      parse_nonoption_args( argc, argv, first_arg, &start_files ) ) return 1;
   if( do_start_files( &start_files ) ) return 1;
 
   /* Must do this after all subsytems are initialised */
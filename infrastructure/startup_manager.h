@@ -47,6 +47,7 @@ typedef enum startup_manager_module {
   STARTUP_MANAGER_MODULE_KEYBOARD,
   STARTUP_MANAGER_MODULE_LIBSPECTRUM,
   STARTUP_MANAGER_MODULE_LIBXML2,
+  STARTUP_MANAGER_MODULE_LOADER,
   STARTUP_MANAGER_MODULE_MACHINE,
   STARTUP_MANAGER_MODULE_MACHINES_PERIPH,
   STARTUP_MANAGER_MODULE_MELODIK,
@@ -59,6 +60,7 @@ typedef enum startup_manager_module {
   STARTUP_MANAGER_MODULE_PRINTER,
   STARTUP_MANAGER_MODULE_PROFILE,
   STARTUP_MANAGER_MODULE_PSG,
+  STARTUP_MANAGER_MODULE_REWIND,
   STARTUP_MANAGER_MODULE_RZX,
   STARTUP_MANAGER_MODULE_SCLD,
   STARTUP_MANAGER_MODULE_SCREENSHOT,
@@ -71,6 +73,7 @@ typedef enum startup_manager_module {
   STARTUP_MANAGER_MODULE_SPECDRUM,
   STARTUP_MANAGER_MODULE_SPECTRANET,
   STARTUP_MANAGER_MODULE_SPECTRUM,
+  STARTUP_MANAGER_MODULE_STATE,
   STARTUP_MANAGER_MODULE_TAPE,
   STARTUP_MANAGER_MODULE_TTX2000S,
   STARTUP_MANAGER_MODULE_TIMER,
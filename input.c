@@ -27,6 +27,7 @@
 #include "input.h"
 #include "keyboard.h"
 #include "peripherals/joystick.h"
+#include "rewind.h"
 #include "settings.h"
 #include "snapshot.h"
 #include "tape.h"
@@ -247,6 +248,12 @@ keypress( const input_event_key_t *event )
     if( !ui_mouse_grabbed ) return 0;
   }
 
+  /* Hold F12 to run backwards */
+  if( event->native_key == INPUT_KEY_F12 && settings_current.rewind ) {
+    rewind_hold( 1 );
+    return 0;
+  }
+
   swallow = 0;
   /* Joystick emulation via keyboard keys */
   if ( event->spectrum_key == settings_current.joystick_keyboard_up ) {
@@ -281,6 +288,8 @@ keypress( const input_event_key_t *event )
 static int
 keyrelease( const input_event_key_t *event )
 {
+  if( event->native_key == INPUT_KEY_F12 ) rewind_hold( 0 );
+
   if( !settings_current.recreated_spectrum ) {
     send_keyboard_release( event->spectrum_key );
   }
@@ -33,7 +33,8 @@ my $ui = shift;
 $ui = 'gtk' unless defined $ui;
 
 die "$0: unrecognised user interface: $ui\n"
-  unless 0 < grep { $ui eq $_ } ( 'gtk', 'x', 'fb', 'sdl', 'win32', 'wii' );
+  unless 0 < grep { $ui eq $_ } ( 'gtk', 'x', 'fb', 'sdl', 'sdl2', 'win32',
+                               'wii' );
 
 sub fb_keysym ($) {
 
@@ -235,6 +236,20 @@ my %ui_data = (
 	    },
 );
 
+# SDL 2 uses the same names as SDL 1, except that the Meta and Super keys
+# have become the GUI keys. There is no Unicode keysym table as SDL 2's key
+# events have no Unicode value; ui/sdl/sdlkeyboard.c works out letters and
+# shifted symbols from the key and its modifiers instead
+$ui_data{sdl2} = {
+    %{ $ui_data{sdl} },
+    skips => { %{ $ui_data{sdl}{skips} }, map { $_ => 1 } ( 'Meta_L',
+                                                            'Meta_R' ) },
+    translations => { %{ $ui_data{sdl}{translations} },
+		      Super_L => 'LGUI',
+		      Super_R => 'RGUI',
+    },
+};
+
 # Translation table for any UI which uses keyboard mode K_MEDIUMRAW
 my @cooked_keysyms = (
     # 0x00
@@ -23,16 +23,26 @@
 
 #include "config.h"
 
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "event.h"
+#include "fuse.h"
+#include "infrastructure/startup_manager.h"
 #include "loader.h"
 #include "memory_pages.h"
 #include "rzx.h"
 #include "settings.h"
 #include "spectrum.h"
 #include "tape.h"
+#include "ui/ui.h"
+#include "utils.h"
 #include "z80/z80.h"
 
 static int successive_reads = 0;
+static int frames_since_read = 0;
 static libspectrum_signed_dword last_tstates_read = -100000;
 static libspectrum_byte last_b_read = 0x00;
 static int length_known1 = 0, length_known2 = 0;
@@ -46,6 +56,7 @@ typedef enum acceleration_mode_t {
 
 static acceleration_mode_t acceleration_mode;
 static size_t acceleration_pc;
+static libspectrum_byte acceleration_level_mask;
 
 void
 loader_frame( libspectrum_dword frame_length )
@@ -53,6 +64,15 @@ loader_frame( libspectrum_dword frame_length )
   if( last_tstates_read > -100000 ) {
     last_tstates_read -= frame_length;
   }
+
+  if( frames_since_read < INT_MAX ) frames_since_read++;
+}
+
+/* How many frames have started since the tape was last read */
+int
+loader_frames_since_read( void )
+{
+  return frames_since_read;
 }
 
 void
@@ -82,8 +102,10 @@ do_acceleration( void )
       z80.bc.b.h = 0x00;
     }
 
-    /* Bit 5 of C is used to indicate the current microphone level */
-    z80.bc.b.l = (z80.bc.b.l & ~0x20) | (tape_microphone ? 0x00 : 0x20);
+    /* One bit of C, normally bit 5, is used to indicate the current
+       microphone level */
+    z80.bc.b.l = (z80.bc.b.l & ~acceleration_level_mask) |
+                 (tape_microphone ? 0x00 : acceleration_level_mask);
 
     z80.af.b.l |= 0x01;
 
@@ -101,289 +123,336 @@ do_acceleration( void )
   length_long1 = length_long2;
 }
 
-static acceleration_mode_t
-acceleration_detector( libspectrum_word pc )
+/* Loader signatures. Each signature is a pattern matched against the
+   code of the edge detection loop, starting 6 bytes before the address
+   just after the IN A,(nn) instruction which triggered the check. All
+   patterns are compiled into a single trie so the code only has to be
+   read once however many signatures there are.
+
+   The textual form, used both for the built-in signatures and for
+   --loader-signatures files, is
+
+     <name> <increasing|decreasing> <level mask> <pattern byte>...
+
+   where "increasing" or "decreasing" says whether the loop counts edges
+   up or down in B, <level mask> is the mask, in hex, of the bit of C
+   which holds the current MIC level and each pattern byte is one of
+
+     nn        the hex byte nn; alternatives can be given as nn|nn|...
+     ??        any byte
+     rN        the offset of a relative jump to pattern start + N
+     lN, hN    the low and high bytes of the address pattern start + N */
+
+static const char * const builtin_signatures[] = {
+
+  /* The ROM loader and its many variants (Bleepload, Microsphere, Paul
+     Owens, Dinaload...) */
+  "rom increasing 20 04 c8 3e 00|7f|ff db fe 1f 00|a7|c8|d0 a9 e6 20 28 r0",
+  "speedlock increasing 20 04 c8 3e 00|7f|ff db fe 1f a9 e6 20 28 r0",
+
+  /* Search Loader and Space Crusade */
+  "search increasing 20 04 c8 3e 00|7f|ff db fe a9 e6 40 d8 00 28 r0",
+  "space-crusade increasing 20 04 c8 3e 00|7f|ff db fe a9 e6 40 28 r0",
+
+  "digital-integration decreasing 20 ?? ?? 05 c8 db fe a9 e6 40 ca l2 h2",
+
+  "alkatraz increasing 20 03 c3 ?? ?? db fe 1f c8 a9 e6 20 28 f1|f3",
+  "alkatraz-variant increasing 20 04 20 01 c9 db fe 1f c8 a9 e6 20 28 f1|f3",
+
+};
+
+#define LOADER_SIGNATURE_MAX_LENGTH 64
+
+typedef struct loader_signature_t {
+  char *name;
+  acceleration_mode_t mode;
+  libspectrum_byte level_mask;
+} loader_signature_t;
+
+typedef enum loader_match_t {
+  LOADER_MATCH_BYTE,
+  LOADER_MATCH_ANY,
+  LOADER_MATCH_RELATIVE,
+  LOADER_MATCH_LOW,
+  LOADER_MATCH_HIGH,
+} loader_match_t;
+
+typedef struct loader_node_t {
+  loader_match_t type;
+  libspectrum_byte value;	/* The byte, or the offset for the address
+				   matches */
+  int child;			/* First child node, or -1 */
+  int sibling;			/* Next node with the same parent, or -1 */
+  int signature;		/* Signature matched at this node, or -1 */
+} loader_node_t;
+
+static loader_signature_t *signatures;
+static size_t signature_count;
+
+static loader_node_t *nodes;
+static size_t node_count, nodes_allocated;
+
+static int
+node_new( loader_match_t type, libspectrum_byte value )
 {
-  int state = 0, count = 0;
-  while( 1 ) {
-    libspectrum_byte b = readbyte_internal( pc ); pc++; count++;
-    switch( state ) {
-    case 0:
-      switch( b ) {
-      case 0x03: state = 28; break;     /* Data byte of JR NZ, ... - Alkatraz */
-      case 0x04: state = 1; break;	/* INC B - Many loaders */
-      default: state = 13; break;	/* Possible Digital Integration */
-      }
-      break;
-    case 1:
-      switch( b ) {
-      case 0x20: state = 40; break;     /* JR NZ - variant Alkatraz */
-      case 0xc8: state = 2; break;	/* RET Z */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 2:
-      switch( b ) {
-      case 0x3e: state = 3; break;	/* LD A,nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 3:
-      switch( b ) {
-      case 0x00:			/* Search Loader */
-      case 0x7f:			/* ROM loader and variants */
-      case 0xff:                        /* Dinaload */
-	state = 4; break;		/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 4:
-      switch( b ) {
-      case 0xdb: state = 5; break;	/* IN A,(nn) */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 5:
-      switch( b ) {
-      case 0xfe: state = 6; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 6:
-      switch( b ) {
-      case 0x1f: state = 7; break;	/* RRA */
-      case 0xa9: state = 24; break;	/* XOR C - Search Loader */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 7:
-      switch( b ) {
-      case 0x00:			/* NOP - Bleepload */
-      case 0xa7:			/* AND A - Microsphere */
-      case 0xc8:			/* RET Z - Paul Owens */
-      case 0xd0:			/* RET NC - ROM loader */
-	state = 8; break;
-      case 0xa9: state = 9; break;	/* XOR C - Speedlock */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 8:
-      switch( b ) {
-      case 0xa9: state = 9; break;	/* XOR C */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 9:
-      switch( b ) {
-      case 0xe6: state = 10; break;	/* AND nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 10:
-      switch( b ) {
-      case 0x20: state = 11; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 11:
-      switch( b ) {
-      case 0x28: state = 12; break;	/* JR nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 12:
-      if( b == 0x100 - count ) {
-	return ACCELERATION_MODE_INCREASING;
-      } else {
-	return ACCELERATION_MODE_NONE;
-      }
-      break;
+  loader_node_t *node;
 
-      /* Digital Integration loader */
+  if( node_count == nodes_allocated ) {
+    nodes_allocated = nodes_allocated ? 2 * nodes_allocated : 64;
+    nodes = libspectrum_renew( loader_node_t, nodes, nodes_allocated );
+  }
 
-    case 13:
-      state = 14; break;		/* Possible Digital Integration */
-    case 14:
-      switch( b ) {
-      case 0x05: state = 15; break;	/* DEC B - Digital Integration */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 15:
-      switch( b ) {
-      case 0xc8: state = 16; break;	/* RET Z */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 16:
-      switch( b ) {
-      case 0xdb: state = 17; break;	/* IN A,(nn) */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 17:
-      switch( b ) {
-      case 0xfe: state = 18; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 18:
-      switch( b ) {
-      case 0xa9: state = 19; break;	/* XOR C */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 19:
-      switch( b ) {
-      case 0xe6: state = 20; break;	/* AND nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 20:
-      switch( b ) {
-      case 0x40: state = 21; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 21:
-      switch( b ) {
-      case 0xca: state = 22; break;	/* JP Z,nnnn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 22:				/* LSB of jump target */
-      if( b == ( z80.pc.w - 4 ) % 0x100 ) {
-	state = 23;
-      } else {
-	return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 23:				/* MSB of jump target */
-      if( b == ( z80.pc.w - 4 ) / 0x100 ) {
-	return ACCELERATION_MODE_DECREASING;
-      } else {
-	return ACCELERATION_MODE_NONE;
-      }
+  node = &nodes[ node_count ];
+  node->type = type;
+  node->value = value;
+  node->child = node->sibling = node->signature = -1;
 
-      /* Search loader */
+  return node_count++;
+}
 
-    case 24:
-      switch( b ) {
-      case 0xe6: state = 25; break;	/* AND nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 25:
-      switch( b ) {
-      case 0x40: state = 26; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 26:
-      switch( b ) {
-      case 0x28: state = 12; break;     /* JR Z - Space Crusade */
-      case 0xd8: state = 27; break;	/* RET C */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 27:
-      switch( b ) {
-      case 0x00: state = 11; break;	/* NOP */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
+/* Parse one pattern byte alternative; returns 0 on success */
+static int
+parse_match( const char *token, size_t length, loader_match_t *type,
+             libspectrum_byte *value )
+{
+  char buffer[8], *end;
+  unsigned long n;
 
-    /* Alkatraz */
+  if( !length || length >= sizeof( buffer ) ) return 1;
+  memcpy( buffer, token, length ); buffer[ length ] = '\0';
 
-    case 28:
-      switch( b ) {
-      case 0xc3: state = 29; break;     /* JP nnnn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 29:
-      state = 30; break;                /* First data byte of JP */
-    case 30:
-      state = 31; break;                /* Second data byte of JP */
-    case 31:
-      switch( b ) {
-      case 0xdb: state = 32; break;	/* IN A,(nn) */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 32:
-      switch( b ) {
-      case 0xfe: state = 33; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 33:
-      switch( b ) {
-      case 0x1f: state = 34; break;	/* RRA */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 34:
-      switch( b ) {
-      case 0xc8: state = 35; break;	/* RET Z */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 35:
-      switch( b ) {
-      case 0xa9: state = 36; break;	/* XOR C */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 36:
-      switch( b ) {
-      case 0xe6: state = 37; break;	/* AND nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 37:
-      switch( b ) {
-      case 0x20: state = 38; break;	/* Data byte */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 38:
-      switch( b ) {
-      case 0x28: state = 39; break;	/* JR Z,nn */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 39:
-      switch( b ) {
-      case 0xf1:                        /* Normal data byte */
-      case 0xf3:                        /* Variant data byte */
-        return ACCELERATION_MODE_INCREASING;
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
+  if( !strcmp( buffer, "??" ) ) {
+    *type = LOADER_MATCH_ANY; *value = 0;
+    return 0;
+  }
 
-    /* "Variant" Alkatraz */
+  switch( buffer[0] ) {
+  case 'r': *type = LOADER_MATCH_RELATIVE; break;
+  case 'l': *type = LOADER_MATCH_LOW; break;
+  case 'h': *type = LOADER_MATCH_HIGH; break;
+  default:
+    if( length != 2 ) return 1;
+    n = strtoul( buffer, &end, 16 );
+    if( *end ) return 1;
+    *type = LOADER_MATCH_BYTE; *value = n;
+    return 0;
+  }
 
-    case 40:
-      switch( b ) {
-      case 0x01: state = 41; break;     /* Data byte of JR NZ */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
-    case 41:
-      switch( b ) {
-      case 0xc9: state = 31; break;     /* RET */
-      default: return ACCELERATION_MODE_NONE;
-      }
-      break;
+  n = strtoul( buffer + 1, &end, 10 );
+  if( end == buffer + 1 || *end || n >= LOADER_SIGNATURE_MAX_LENGTH ) return 1;
+  *value = n;
+
+  return 0;
+}
+
+/* Check that every alternative of every pattern byte can be parsed, so
+   that nothing gets added to the trie for an invalid signature */
+static int
+pattern_check( char **tokens, size_t count )
+{
+  const char *alternative, *end;
+  loader_match_t type;
+  libspectrum_byte value;
+  size_t i;
+
+  for( i = 0; i < count; i++ ) {
+    for( alternative = tokens[i]; ; alternative = end + 1 ) {
+
+      end = strchr( alternative, '|' );
+      if( !end ) end = alternative + strlen( alternative );
+
+      if( parse_match( alternative, end - alternative, &type, &value ) )
+        return 1;
+
+      if( !*end ) break;
+    }
+  }
+
+  return 0;
+}
+
+/* Add the pattern 'tokens' below 'parent', expanding any alternatives. The
+   pattern must already have been checked by pattern_check() */
+static int
+trie_insert( int parent, char **tokens, size_t count, int signature )
+{
+  const char *alternative, *end;
+  loader_match_t type;
+  libspectrum_byte value;
+  int child;
+
+  if( !count ) {
+    if( nodes[ parent ].signature == -1 )
+      nodes[ parent ].signature = signature;
+    return 0;
+  }
+
+  for( alternative = tokens[0]; ; alternative = end + 1 ) {
+
+    end = strchr( alternative, '|' );
+    if( !end ) end = alternative + strlen( alternative );
+
+    if( parse_match( alternative, end - alternative, &type, &value ) )
+      return 1;
+
+    for( child = nodes[ parent ].child; child != -1;
+         child = nodes[ child ].sibling )
+      if( nodes[ child ].type == type && nodes[ child ].value == value )
+        break;
+
+    if( child == -1 ) {
+      child = node_new( type, value );
+      nodes[ child ].sibling = nodes[ parent ].child;
+      nodes[ parent ].child = child;
+    }
+
+    if( trie_insert( child, tokens + 1, count - 1, signature ) ) return 1;
+
+    if( !*end ) break;
+  }
+
+  return 0;
+}
 
-    default:
-      /* Can't happen */
-      break;
+/* Compile one signature; returns 0 on success */
+static int
+signature_add( const char *definition )
+{
+  char *copy, *tokens[ LOADER_SIGNATURE_MAX_LENGTH + 3 ], *p;
+  size_t count = 0;
+  loader_signature_t *signature;
+  unsigned long level;
+  int error;
+
+  copy = utils_safe_strdup( definition );
+
+  for( p = strtok( copy, " \t\r" ); p; p = strtok( NULL, " \t\r" ) ) {
+    if( count == ARRAY_SIZE( tokens ) ) {
+      libspectrum_free( copy );
+      return 1;
     }
+    tokens[ count++ ] = p;
+  }
+
+  /* Name, mode, level mask and at least one pattern byte */
+  if( count < 4 ) {
+    libspectrum_free( copy );
+    return 1;
+  }
+
+  signatures = libspectrum_renew( loader_signature_t, signatures,
+                                  signature_count + 1 );
+  signature = &signatures[ signature_count ];
+
+  if( !strcmp( tokens[1], "increasing" ) ) {
+    signature->mode = ACCELERATION_MODE_INCREASING;
+  } else if( !strcmp( tokens[1], "decreasing" ) ) {
+    signature->mode = ACCELERATION_MODE_DECREASING;
+  } else {
+    libspectrum_free( copy );
+    return 1;
+  }
+
+  level = strtoul( tokens[2], &p, 16 );
+  if( *p || level > 0xff ) {
+    libspectrum_free( copy );
+    return 1;
   }
+  signature->level_mask = level;
 
-}      
+  if( pattern_check( tokens + 3, count - 3 ) ) {
+    libspectrum_free( copy );
+    return 1;
+  }
+
+  error = trie_insert( 0, tokens + 3, count - 3, signature_count );
+  if( !error ) {
+    signature->name = utils_safe_strdup( tokens[0] );
+    signature_count++;
+  }
+
+  libspectrum_free( copy );
+  return error;
+}
+
+static void
+signatures_read_file( const char *filename )
+{
+  utils_file file;
+  char *buffer, *line, *next;
+  int line_number;
+
+  if( utils_read_file( filename, &file ) ) return;
+
+  buffer = libspectrum_new( char, file.length + 1 );
+  memcpy( buffer, file.buffer, file.length ); buffer[ file.length ] = '\0';
+  utils_close_file( &file );
+
+  for( line = buffer, line_number = 1; line; line = next, line_number++ ) {
+
+    next = strchr( line, '\n' );
+    if( next ) *next++ = '\0';
+
+    line += strspn( line, " \t\r" );
+    if( !*line || *line == '#' ) continue;
+
+    if( signature_add( line ) )
+      ui_error( UI_ERROR_WARNING, "%s:%d: invalid loader signature",
+                filename, line_number );
+  }
+
+  libspectrum_free( buffer );
+}
+
+static int
+node_matches( const loader_node_t *node, libspectrum_byte b,
+              libspectrum_word start, int offset )
+{
+  switch( node->type ) {
+  case LOADER_MATCH_BYTE: return b == node->value;
+  case LOADER_MATCH_ANY: return 1;
+  case LOADER_MATCH_RELATIVE:
+    return b == ( ( node->value - offset - 1 ) & 0xff );
+  case LOADER_MATCH_LOW:
+    return b == ( ( start + node->value ) & 0xff );
+  case LOADER_MATCH_HIGH:
+    return b == ( ( ( start + node->value ) >> 8 ) & 0xff );
+  }
+
+  return 0;
+}
+
+static int
+trie_match( int parent, libspectrum_word start, int offset )
+{
+  libspectrum_byte b;
+  int child, signature;
+
+  if( nodes[ parent ].child == -1 ) return -1;
+
+  b = readbyte_internal( start + offset );
+
+  for( child = nodes[ parent ].child; child != -1;
+       child = nodes[ child ].sibling ) {
+
+    if( !node_matches( &nodes[ child ], b, start, offset ) ) continue;
+
+    if( nodes[ child ].signature != -1 ) return nodes[ child ].signature;
+
+    signature = trie_match( child, start, offset + 1 );
+    if( signature != -1 ) return signature;
+  }
+
+  return -1;
+}
+
+static int
+acceleration_detector( libspectrum_word pc )
+{
+  if( !node_count ) return -1;
+
+  return trie_match( 0, pc, 0 );
+}
 
 static void
 check_for_acceleration( void )
@@ -395,13 +464,63 @@ check_for_acceleration( void )
 
   /* If we're not accelerating, check if this is a loader */
   if( !acceleration_mode ) {
-    acceleration_mode = acceleration_detector( z80.pc.w - 6 );
+    int signature = acceleration_detector( z80.pc.w - 6 );
+    if( signature != -1 ) {
+      acceleration_mode = signatures[ signature ].mode;
+      acceleration_level_mask = signatures[ signature ].level_mask;
+    }
     acceleration_pc = z80.pc.w;
   }
 
   if( acceleration_mode ) do_acceleration();
 }
 
+static int
+loader_init( void *context )
+{
+  size_t i;
+
+  node_new( LOADER_MATCH_ANY, 0 );
+
+  for( i = 0; i < ARRAY_SIZE( builtin_signatures ); i++ ) {
+    if( signature_add( builtin_signatures[i] ) ) {
+      ui_error( UI_ERROR_ERROR, "invalid built-in loader signature %lu",
+                (unsigned long)i );
+      return 1;
+    }
+  }
+
+  if( settings_current.loader_signatures )
+    signatures_read_file( settings_current.loader_signatures );
+
+  return 0;
+}
+
+static void
+loader_end( void )
+{
+  size_t i;
+
+  for( i = 0; i < signature_count; i++ )
+    libspectrum_free( signatures[i].name );
+  libspectrum_free( signatures ); signatures = NULL;
+  signature_count = 0;
+
+  libspectrum_free( nodes ); nodes = NULL;
+  node_count = nodes_allocated = 0;
+
+  acceleration_mode = ACCELERATION_MODE_NONE;
+}
+
+void
+loader_register_startup( void )
+{
+  startup_manager_module dependencies[] = { STARTUP_MANAGER_MODULE_SETUID };
+  startup_manager_register( STARTUP_MANAGER_MODULE_LOADER, dependencies,
+                            ARRAY_SIZE( dependencies ), loader_init, NULL,
+                            loader_end );
+}
+
 void
 loader_detect_loader( void )
 {
@@ -410,6 +529,7 @@ loader_detect_loader( void )
 
   last_tstates_read = tstates;
   last_b_read = z80.bc.b.h;
+  frames_since_read = 0;
 
   if( settings_current.detect_loader ) {
 
@@ -466,3 +586,83 @@ loader_set_acceleration_flags( int flags, int from_acceleration )
     length_known1 = 0;
   }
 }
+
+/* Write 'code' at 'address', returning what was there before in 'saved' */
+static void
+unittest_poke( libspectrum_word address, const libspectrum_byte *code,
+               libspectrum_byte *saved, size_t length )
+{
+  size_t i;
+
+  for( i = 0; i < length; i++ ) {
+    if( saved ) saved[i] = readbyte_internal( address + i );
+    writebyte_internal( address + i, code[i] );
+  }
+}
+
+int
+loader_unittest( void )
+{
+  /* The ROM's edge detection loop, and the same ending in a byte which
+     only an invalid signature below would match */
+  static const libspectrum_byte rom_loop[] = {
+    0x04, 0xc8, 0x3e, 0x7f, 0xdb, 0xfe, 0x1f, 0xd0, 0xa9, 0xe6, 0x20, 0x28,
+    0xf3
+  };
+  static const libspectrum_byte bad_loop[] = {
+    0x04, 0xc8, 0x3e, 0x7f, 0xdb, 0xfe, 0x1f, 0xd0, 0xa9, 0xe6, 0x20, 0x11,
+    0x22
+  };
+  libspectrum_byte saved[ ARRAY_SIZE( rom_loop ) ];
+  libspectrum_word address = 0x6000;
+  size_t old_node_count = node_count, old_signature_count = signature_count;
+  int signature, r = 0;
+
+  /* Invalid signatures are rejected without changing the trie, even when
+     the problem is only in a later alternative */
+  if( !signature_add( "bad sideways 20 04" ) ||
+      !signature_add( "bad increasing 20" ) ||
+      !signature_add( "bad increasing 20 04 c8 zz" ) ||
+      !signature_add( "bad increasing 20 04 c8 3e 7f db fe 1f d0 a9 e6 20 "
+                      "11 22|zz" ) ||
+      !signature_add( "bad increasing 20 04 r64" ) ) {
+    printf( "%s:%d: invalid loader signature accepted\n", __FILE__,
+            __LINE__ );
+    r++;
+  }
+
+  if( node_count != old_node_count || signature_count != old_signature_count ) {
+    printf( "%s:%d: invalid loader signature changed the trie\n", __FILE__,
+            __LINE__ );
+    r++;
+  }
+
+  unittest_poke( address, rom_loop, saved, ARRAY_SIZE( rom_loop ) );
+
+  signature = acceleration_detector( address );
+  if( signature == -1 || strcmp( signatures[ signature ].name, "rom" ) ||
+      signatures[ signature ].mode != ACCELERATION_MODE_INCREASING ||
+      signatures[ signature ].level_mask != 0x20 ) {
+    printf( "%s:%d: ROM loader not detected\n", __FILE__, __LINE__ );
+    r++;
+  }
+
+  /* A relative jump to somewhere else isn't the ROM loop */
+  writebyte_internal( address + ARRAY_SIZE( rom_loop ) - 1, 0xf4 );
+  if( acceleration_detector( address ) != -1 ) {
+    printf( "%s:%d: wrong jump offset detected as a loader\n", __FILE__,
+            __LINE__ );
+    r++;
+  }
+
+  unittest_poke( address, bad_loop, NULL, ARRAY_SIZE( bad_loop ) );
+  if( acceleration_detector( address ) != -1 ) {
+    printf( "%s:%d: invalid signature detected as a loader\n", __FILE__,
+            __LINE__ );
+    r++;
+  }
+
+  unittest_poke( address, saved, NULL, ARRAY_SIZE( saved ) );
+
+  return r;
+}
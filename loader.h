@@ -26,10 +26,15 @@
 
 #include "libspectrum.h"
 
+void loader_register_startup( void );
+
 void loader_frame( libspectrum_dword frame_length );
+int loader_frames_since_read( void );
 void loader_tape_play( void );
 void loader_tape_stop( void );
 void loader_detect_loader( void );
 void loader_set_acceleration_flags( int flags, int from_acceleration );
 
+int loader_unittest( void );
+
 #endif			/* #ifndef FUSE_LOADER_H */
@@ -47,6 +47,7 @@
 #include "peripherals/ula.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "utils.h"
 
@@ -68,6 +69,9 @@ memory_page memory_map_write[MEMORY_PAGES_IN_64K];
 /* Standard mappings for the 'normal' RAM */
 memory_page memory_map_ram[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
 
+/* Which of those have been written to */
+libspectrum_byte memory_ram_dirty[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
+
 /* Standard mappings for the ROMs */
 memory_page memory_map_rom[SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K];
 
@@ -88,6 +92,8 @@ libspectrum_word memory_screen_mask;
 
 static void memory_from_snapshot( libspectrum_snap *snap );
 static void memory_to_snapshot( libspectrum_snap *snap );
+static void memory_state_save( state_buffer_t *buffer );
+static int memory_state_load( state_buffer_t *buffer );
 
 static module_info_t memory_module_info = {
 
@@ -96,6 +102,10 @@ static module_info_t memory_module_info = {
   NULL,
   memory_from_snapshot,
   memory_to_snapshot,
+  STATE_ID( 'R', 'A', 'M', ' ' ),
+  1,
+  memory_state_save,
+  memory_state_load,
 
 };
 
@@ -510,6 +520,10 @@ writebyte_internal( libspectrum_word address, libspectrum_byte b )
     memory_display_dirty( address, b );
 
     memory[ offset ] = b;
+
+    if( mapping->source == memory_source_ram )
+      memory_ram_dirty[ mapping->page_num * MEMORY_PAGES_IN_16K +
+                        ( mapping->offset >> MEMORY_PAGE_SIZE_LOGARITHM ) ] = 1;
   }
 }
 
@@ -539,33 +553,58 @@ memory_romcs_map( void )
   module_romcs();
 }
 
+void
+memory_ram_dirty_all( void )
+{
+  memset( memory_ram_dirty, 1, sizeof( memory_ram_dirty ) );
+}
+
+void
+memory_ram_dirty_clear( void )
+{
+  memset( memory_ram_dirty, 0, sizeof( memory_ram_dirty ) );
+}
+
+void
+memory_ram_dirty_page( int bank, libspectrum_word offset )
+{
+  memory_ram_dirty[ bank * MEMORY_PAGES_IN_16K +
+                    ( ( offset & 0x3fff ) >> MEMORY_PAGE_SIZE_LOGARITHM ) ] = 1;
+}
+
 static void
-memory_from_snapshot( libspectrum_snap *snap )
+memory_ports_restore( libspectrum_byte memoryport,
+                      libspectrum_byte memoryport2 )
 {
-  size_t i;
   int capabilities = machine_current->capabilities;
 
   if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_PENT1024_MEMORY ) {
-    pentagon1024_memoryport_write( 0x7ffd,
-			      libspectrum_snap_out_128_memoryport( snap ) );
-    pentagon1024_v22_memoryport_write( 0xeff7,
-                              libspectrum_snap_out_plus3_memoryport( snap ) );
+    pentagon1024_memoryport_write( 0x7ffd, memoryport );
+    pentagon1024_v22_memoryport_write( 0xeff7, memoryport2 );
   } else {
     if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_128_MEMORY )
-      spec128_memoryport_write( 0x7ffd,
-                                libspectrum_snap_out_128_memoryport( snap ) );
+      spec128_memoryport_write( 0x7ffd, memoryport );
 
     if( ( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_PLUS3_MEMORY ) ||
         ( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_SCORP_MEMORY )    )
-      specplus3_memoryport2_write_internal(
-        0x1ffd, libspectrum_snap_out_plus3_memoryport( snap )
-      );
+      specplus3_memoryport2_write_internal( 0x1ffd, memoryport2 );
   }
+}
+
+static void
+memory_from_snapshot( libspectrum_snap *snap )
+{
+  size_t i;
+
+  memory_ports_restore( libspectrum_snap_out_128_memoryport( snap ),
+                        libspectrum_snap_out_plus3_memoryport( snap ) );
 
   for( i = 0; i < 64; i++ )
     if( libspectrum_snap_pages( snap, i ) )
       memcpy( RAM[i], libspectrum_snap_pages( snap, i ), 0x4000 );
 
+  memory_ram_dirty_all();
+
   if( libspectrum_snap_custom_rom( snap ) ) {
     for( i = 0; i < libspectrum_snap_custom_rom_pages( snap ) && i < 4; i++ ) {
       if( libspectrum_snap_roms( snap, i ) ) {
@@ -679,6 +718,84 @@ memory_to_snapshot( libspectrum_snap *snap )
   memory_rom_to_snapshot( snap );
 }
 
+/* The number of 16K RAM pages the current machine can use */
+static size_t
+memory_ram_pages( void )
+{
+  int capabilities = machine_current->capabilities;
+
+  if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_PENT1024_MEMORY )
+    return 64;
+  if( machine_current->machine == LIBSPECTRUM_MACHINE_PENT512 ) return 32;
+  if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_SCORP_MEMORY ) return 16;
+
+  /* Even the 16K and 48K machines use page 5 */
+  return machine_current->ram.valid_pages > 8 ?
+         machine_current->ram.valid_pages : 8;
+}
+
+/* RAM is copied straight out of the page map; custom ROMs are saved only
+   if there are any */
+static void
+memory_state_save( state_buffer_t *buffer )
+{
+  size_t i, pages = memory_ram_pages() * MEMORY_PAGES_IN_16K;
+  int custom_rom = memory_custom_rom();
+
+  state_buffer_write_byte( buffer, machine_current->ram.last_byte );
+  state_buffer_write_byte( buffer, machine_current->ram.last_byte2 );
+
+  state_buffer_write_dword( buffer, pages );
+
+  buffer->ram_offset = buffer->length;
+  buffer->ram_pages = pages;
+  for( i = 0; i < pages; i++ )
+    state_buffer_write( buffer, memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+
+  state_buffer_write_byte( buffer, custom_rom );
+  if( !custom_rom ) return;
+
+  for( i = 0; i < SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K; i++ ) {
+    state_buffer_write_byte( buffer, !!memory_map_rom[i].page );
+    if( memory_map_rom[i].page )
+      state_buffer_write( buffer, memory_map_rom[i].page, MEMORY_PAGE_SIZE );
+  }
+}
+
+static int
+memory_state_load( state_buffer_t *buffer )
+{
+  size_t i, pages;
+  libspectrum_byte memoryport, memoryport2;
+
+  memoryport = state_buffer_read_byte( buffer );
+  memoryport2 = state_buffer_read_byte( buffer );
+
+  pages = state_buffer_read_dword( buffer );
+  if( pages > SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K ) return 1;
+
+  for( i = 0; i < pages; i++ )
+    state_buffer_read( buffer, memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+
+  if( state_buffer_read_byte( buffer ) ) {
+    for( i = 0; i < SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K; i++ ) {
+      if( !state_buffer_read_byte( buffer ) ) continue;
+      if( !memory_map_rom[i].page ) return 1;
+
+      state_buffer_read( buffer, memory_map_rom[i].page, MEMORY_PAGE_SIZE );
+      memory_map_rom[i].save_to_snapshot = 1;
+    }
+  }
+
+  memory_ram_dirty_all();
+
+  /* The paging may have been locked since the state was saved */
+  machine_current->ram.locked = 0;
+  memory_ports_restore( memoryport, memoryport2 );
+
+  return 0;
+}
+
 /* Check whether we're actually in the right ROM when a tape or other traps
    hit */
 int
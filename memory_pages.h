@@ -109,6 +109,11 @@ extern memory_page memory_map_write[MEMORY_PAGES_IN_64K];
 extern memory_page memory_map_ram[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
 extern memory_page memory_map_rom[SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K];
 
+/* Non-zero for each page of memory_map_ram which has been written to
+   since the flags were last cleared */
+extern libspectrum_byte
+  memory_ram_dirty[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
+
 /* Which RAM page contains the current screen */
 extern int memory_current_screen;
 
@@ -131,6 +136,14 @@ int memory_custom_rom( void );
    configuration */
 void memory_reset( void );
 
+/* Mark every RAM page as written to, for when RAM has been changed other
+   than through writebyte_internal() */
+void memory_ram_dirty_all( void );
+void memory_ram_dirty_clear( void );
+
+/* Mark the page holding 'offset' in 16Kb RAM bank 'bank' as written to */
+void memory_ram_dirty_page( int bank, libspectrum_word offset );
+
 /* Set contention for 16K of RAM */
 void memory_ram_set_16k_contention( int page_num, int contended );
 
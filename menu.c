@@ -87,23 +87,11 @@ MENU_CALLBACK( menu_file_open )
 
 MENU_CALLBACK( menu_file_recording_insertsnapshot )
 {
-  libspectrum_snap *snap;
-  libspectrum_error error;
-
   if( !rzx_recording ) return;
 
   ui_widget_finish();
 
-  libspectrum_rzx_stop_input( rzx );
-
-  snap = libspectrum_snap_alloc();
-
-  error = snapshot_copy_to( snap );
-  if( error ) { libspectrum_snap_free( snap ); return; }
-
-  libspectrum_rzx_add_snap( rzx, snap, 0 );
-
-  libspectrum_rzx_start_input( rzx, tstates );
+  rzx_insert_snapshot();
 }
 
 MENU_CALLBACK( menu_file_recording_rollback )
@@ -138,6 +126,31 @@ MENU_CALLBACK( menu_file_recording_rollbackto )
   fuse_emulation_unpause();
 }
 
+/* How far the skip menu options move RZX playback, in frames */
+static const size_t RECORDING_SKIP_FRAMES = 10 * 50;
+
+MENU_CALLBACK( menu_file_recording_skipback )
+{
+  size_t position;
+
+  if( !rzx_playback ) return;
+
+  ui_widget_finish();
+
+  position = rzx_playback_position();
+  rzx_seek( position > RECORDING_SKIP_FRAMES ?
+            position - RECORDING_SKIP_FRAMES : 0 );
+}
+
+MENU_CALLBACK( menu_file_recording_skipforward )
+{
+  if( !rzx_playback ) return;
+
+  ui_widget_finish();
+
+  rzx_seek( rzx_playback_position() + RECORDING_SKIP_FRAMES );
+}
+
 MENU_CALLBACK( menu_file_recording_play )
 {
   char *recording;
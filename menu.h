@@ -59,6 +59,8 @@ MENU_CALLBACK( menu_file_recording_insertsnapshot );
 MENU_CALLBACK( menu_file_recording_rollback );
 MENU_CALLBACK( menu_file_recording_rollbackto );
 MENU_CALLBACK( menu_file_recording_play );
+MENU_CALLBACK( menu_file_recording_skipback );
+MENU_CALLBACK( menu_file_recording_skipforward );
 MENU_CALLBACK( menu_file_recording_stop );
 MENU_CALLBACK( menu_file_recording_finalise );
 MENU_CALLBACK( menu_file_aylogging_stop );
@@ -31,9 +31,16 @@
 
 #include "compat.h"
 #include "module.h"
+#include "ui/ui.h"
 
 static GSList *registered_modules = NULL;
 
+typedef struct module_state_context_t {
+  state_buffer_t *buffer;
+  libspectrum_snap *snap;
+  int error;
+} module_state_context_t;
+
 int
 module_register( module_info_t *module )
 {
@@ -122,3 +129,68 @@ module_snapshot_to( libspectrum_snap *snap )
 {
   g_slist_foreach( registered_modules, snapshot_to, snap );
 }
+
+static void
+state_to( gpointer data, gpointer user_data )
+{
+  const module_info_t *module = data;
+  module_state_context_t *context = user_data;
+  size_t record;
+
+  if( module->state_save ) {
+    record = state_record_begin( context->buffer, module->state_id,
+                                 module->state_version );
+    module->state_save( context->buffer );
+    state_record_end( context->buffer, record );
+  } else if( module->snapshot_to ) {
+    module->snapshot_to( context->snap );
+  }
+}
+
+void
+module_state_save( state_buffer_t *buffer, libspectrum_snap *snap )
+{
+  module_state_context_t context = { buffer, snap, 0 };
+
+  g_slist_foreach( registered_modules, state_to, &context );
+}
+
+static void
+state_from( gpointer data, gpointer user_data )
+{
+  const module_info_t *module = data;
+  module_state_context_t *context = user_data;
+  size_t length, end;
+
+  if( context->error ) return;
+
+  if( module->state_load ) {
+    if( state_record_read( context->buffer, module->state_id,
+                           module->state_version, &length ) ) {
+      context->error = 1;
+      return;
+    }
+
+    end = context->buffer->position + length;
+    if( module->state_load( context->buffer ) || context->buffer->error ||
+        context->buffer->position != end ) {
+      ui_error( UI_ERROR_ERROR, "state: bad '%c%c%c%c' record",
+                (char)( module->state_id >> 24 ),
+                (char)( module->state_id >> 16 ),
+                (char)( module->state_id >> 8 ), (char)module->state_id );
+      context->error = 1;
+    }
+  } else if( module->snapshot_from ) {
+    module->snapshot_from( context->snap );
+  }
+}
+
+int
+module_state_load( state_buffer_t *buffer, libspectrum_snap *snap )
+{
+  module_state_context_t context = { buffer, snap, 0 };
+
+  g_slist_foreach( registered_modules, state_from, &context );
+
+  return context.error;
+}
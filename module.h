@@ -26,11 +26,15 @@
 
 #include "libspectrum.h"
 
+#include "state.h"
+
 typedef void (*module_reset_fn)( int hard_reset );
 typedef void (*module_romcs_fn)( void );
 typedef void (*module_snapshot_enabled_fn)( libspectrum_snap *snap );
 typedef void (*module_snapshot_from_fn)( libspectrum_snap *snap );
 typedef void (*module_snapshot_to_fn)( libspectrum_snap *snap );
+typedef void (*module_state_save_fn)( state_buffer_t *buffer );
+typedef int (*module_state_load_fn)( state_buffer_t *buffer );
 
 typedef struct module_info_t
 {
@@ -41,6 +45,13 @@ typedef struct module_info_t
   module_snapshot_from_fn snapshot_from;
   module_snapshot_to_fn snapshot_to;
 
+  /* Native in-memory state; modules which don't provide these are saved
+     and restored through snapshot_to and snapshot_from instead */
+  libspectrum_dword state_id;
+  libspectrum_byte state_version;
+  module_state_save_fn state_save;
+  module_state_load_fn state_load;
+
 } module_info_t;
 
 int module_register( module_info_t *module );
@@ -52,4 +63,7 @@ void module_snapshot_enabled( libspectrum_snap *snap );
 void module_snapshot_from( libspectrum_snap *snap );
 void module_snapshot_to( libspectrum_snap *snap );
 
+void module_state_save( state_buffer_t *buffer, libspectrum_snap *snap );
+int module_state_load( state_buffer_t *buffer, libspectrum_snap *snap );
+
 #endif			/* #ifndef FUSE_MODULE_H */
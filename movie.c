@@ -27,10 +27,15 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif				/* #ifdef HAVE_PTHREAD */
+
 #include "libspectrum.h"
 #ifdef HAVE_ZLIB_H
 #define ZLIB_CONST
@@ -47,6 +52,8 @@
 #include "screenshot.h"
 #include "settings.h"
 #include "sound.h"
+#include "sound/render.h"
+#include "ui/scaler/scaler.h"
 #include "ui/ui.h"
 
 #undef MOVIE_DEBUG_PRINT
@@ -107,12 +114,18 @@
                                                 D - Pentagon
                                                 E - 48 NTSC
       In a frame there are no, one or several screen rectangle, changed from
-      the previouse frame.
+      the previouse frame. A frame with no screen rectangles repeats the
+      previous frame.
 
       X -> End of recording
       off  len  data          description
       There is no any data... It mark the end of the last frame. So we can
       concat several FMF file without any problem...
+
+  If the movie's filename ends in .y4m, we instead write every frame in
+  full as YUV4MPEG2 4:4:4 video, and the sound as a WAV file with the same
+  name but ending in .wav. These can be read directly by most video tools,
+  so there is no need for a separate conversion step.
 */
 
 int movie_recording = 0;
@@ -138,6 +151,52 @@ static unsigned char zbuf_o[ ZBUF_SIZE ];
 
 static unsigned char alaw_table[2048 + 1] = { ALAW_ENC_TAB };
 
+/* Y4M and WAV output */
+static int movie_y4m = 0;
+static scaler_type y4m_scaler;
+static size_t y4m_width, y4m_height;
+static libspectrum_byte *y4m_planes;	/* Used only by the encoder */
+static sound_render_file_t movie_wav;
+static libspectrum_qword y4m_samples;	/* Per channel, written to the WAV */
+
+/* Run length encoding, compression and writing the file are done on a
+   separate thread where possible, so the emulation doesn't stall while
+   they happen. Everything the encoder needs is copied into a job, and the
+   encoder makes exactly the same sequence of writes as it would if called
+   directly, so the file is the same either way */
+typedef enum movie_job_type {
+  MOVIE_JOB_DATA,		/* Bytes to be written as they are */
+  MOVIE_JOB_AREA,		/* A screen area to run length encode */
+  MOVIE_JOB_ALAW,		/* Sound samples to A-law encode */
+  MOVIE_JOB_FRAME,		/* An RGB frame to write as Y4M */
+  MOVIE_JOB_WAV,		/* Sound samples to write as WAV */
+} movie_job_type;
+
+typedef struct movie_job_t {
+  movie_job_type type;
+  void *data;
+  size_t length;		/* Bytes in 'data' */
+  int w, h, planes;		/* Dimensions of a screen area, or channels
+				   of sound */
+  struct movie_job_t *next;
+} movie_job_t;
+
+/* The emulation waits for the encoder if it gets this far behind */
+#define MOVIE_QUEUE_LIMIT ( 4 * 1024 * 1024 )
+
+static struct {
+  movie_job_t *head, *tail;
+  size_t bytes;			/* Bytes of data waiting in the queue */
+#ifdef HAVE_PTHREAD
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;	/* Signalled when there is more to do */
+  pthread_cond_t space_cond;	/* Signalled when jobs are finished */
+  int running;
+  int stopping;
+#endif				/* #ifdef HAVE_PTHREAD */
+} movie_queue;
+
 void movie_start_frame( void );
 void movie_init_sound( int f, int s );
 
@@ -213,18 +272,18 @@ fwrite_compr( const void *b, size_t n, size_t m, FILE *f )
 #endif	/* HAVE_ZLIB_H */
 
 static void
-movie_compress_area( int x, int y, int w, int h, int s )
+movie_compress_area( const libspectrum_dword *area, int w, int h, int s )
 {
-  libspectrum_dword *dpoint, *dline;
+  const libspectrum_dword *dpoint, *dline;
   libspectrum_byte d, d1, *b;
   libspectrum_byte buff[ 960 ];
   int w0, h0, l;
 
-  dline = &display_last_screen[x + 40 * y];
+  dline = area;
   b = buff; l = -1;
   d1 = ( ( *dline >> s ) & 0xff ) + 1;		/* *d1 != dpoint :-) */
 
-  for( h0 = h; h0 > 0; h0--, dline += 40 ) {
+  for( h0 = h; h0 > 0; h0--, dline += w ) {
     dpoint = dline;
     for( w0 = w; w0 > 0; w0--, dpoint++) {
       d = ( *dpoint >> s ) & 0xff;	/* bitmask1 */
@@ -259,6 +318,209 @@ movie_compress_area( int x, int y, int w, int h, int s )
   }
 }
 
+static inline void write_alaw( libspectrum_signed_word *buff, int len );
+
+/* Convert a frame from RGB to Y'CbCr as in ITU-R BT.601, and write it */
+static void
+write_y4m_frame( const libspectrum_byte *rgb32, size_t pixels )
+{
+  libspectrum_byte *y = y4m_planes, *u = y + pixels, *v = u + pixels;
+  int r, g, b;
+  size_t i;
+
+  for( i = 0; i < pixels; i++, rgb32 += 4 ) {
+    r = rgb32[0]; g = rgb32[1]; b = rgb32[2];
+
+    /* The offsets keep everything positive before the shift */
+    y[i] = ( (  66 * r + 129 * g +  25 * b + 128 ) >> 8 ) +  16;
+    u[i] = ( ( -38 * r -  74 * g + 112 * b + 128 + ( 128 << 8 ) ) >> 8 );
+    v[i] = ( ( 112 * r -  94 * g -  18 * b + 128 + ( 128 << 8 ) ) >> 8 );
+  }
+
+  fwrite_compr( "FRAME\n", 6, 1, of );
+  fwrite_compr( y4m_planes, 3 * pixels, 1, of );
+}
+
+/* Do the work for one job; this is the only place which writes to the
+   file once recording has started */
+static void
+movie_encode( movie_job_t *job )
+{
+  switch( job->type ) {
+
+  case MOVIE_JOB_DATA:
+    fwrite_compr( job->data, job->length, 1, of );
+    break;
+
+  case MOVIE_JOB_AREA:
+    movie_compress_area( job->data, job->w, job->h, 0 );	/* Bitmap1 */
+    movie_compress_area( job->data, job->w, job->h, 8 );	/* Attrib/B2 */
+    if( job->planes == 3 ) {
+      movie_compress_area( job->data, job->w, job->h, 16 );/* HiRes attrib */
+    }
+    break;
+
+  case MOVIE_JOB_ALAW:
+    write_alaw( job->data, job->length / sizeof( libspectrum_signed_word ) );
+    break;
+
+  case MOVIE_JOB_FRAME:
+    write_y4m_frame( job->data, job->w * job->h );
+    break;
+
+  case MOVIE_JOB_WAV:
+    sound_render_file_write( &movie_wav, job->data,
+                             job->length / sizeof( libspectrum_signed_word ),
+                             job->planes );
+    break;
+
+  }
+}
+
+static movie_job_t*
+movie_job_alloc( movie_job_type type, size_t length )
+{
+  movie_job_t *job = libspectrum_new( movie_job_t, 1 );
+
+  job->type = type;
+  job->data = libspectrum_malloc( length );
+  job->length = length;
+  job->next = NULL;
+
+  return job;
+}
+
+static void
+movie_job_free( movie_job_t *job )
+{
+  libspectrum_free( job->data );
+  libspectrum_free( job );
+}
+
+#ifdef HAVE_PTHREAD
+
+static void*
+movie_encoder_run( void *arg GCC_UNUSED )
+{
+  movie_job_t *job;
+
+  pthread_mutex_lock( &movie_queue.lock );
+
+  while( 1 ) {
+    while( !movie_queue.head && !movie_queue.stopping )
+      pthread_cond_wait( &movie_queue.work_cond, &movie_queue.lock );
+
+    /* Only stop once everything has been written */
+    job = movie_queue.head;
+    if( !job ) break;
+
+    movie_queue.head = job->next;
+    if( !movie_queue.head ) movie_queue.tail = NULL;
+
+    pthread_mutex_unlock( &movie_queue.lock );
+    movie_encode( job );
+    pthread_mutex_lock( &movie_queue.lock );
+
+    movie_queue.bytes -= job->length;
+    movie_job_free( job );
+    pthread_cond_signal( &movie_queue.space_cond );
+  }
+
+  pthread_mutex_unlock( &movie_queue.lock );
+
+  return NULL;
+}
+
+#endif				/* #ifdef HAVE_PTHREAD */
+
+/* Start the encoder thread. If we can't, jobs are just done as they
+   are added */
+static void
+movie_encoder_start( void )
+{
+  movie_queue.head = movie_queue.tail = NULL;
+  movie_queue.bytes = 0;
+
+#ifdef HAVE_PTHREAD
+  movie_queue.stopping = 0;
+
+  if( pthread_mutex_init( &movie_queue.lock, NULL ) ) return;
+  pthread_cond_init( &movie_queue.work_cond, NULL );
+  pthread_cond_init( &movie_queue.space_cond, NULL );
+
+  if( pthread_create( &movie_queue.thread, NULL, movie_encoder_run, NULL ) ) {
+    pthread_cond_destroy( &movie_queue.space_cond );
+    pthread_cond_destroy( &movie_queue.work_cond );
+    pthread_mutex_destroy( &movie_queue.lock );
+    return;
+  }
+
+  movie_queue.running = 1;
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+/* Wait for everything queued to be written and stop the encoder thread */
+static void
+movie_encoder_stop( void )
+{
+#ifdef HAVE_PTHREAD
+  if( !movie_queue.running ) return;
+
+  pthread_mutex_lock( &movie_queue.lock );
+  movie_queue.stopping = 1;
+  pthread_cond_signal( &movie_queue.work_cond );
+  pthread_mutex_unlock( &movie_queue.lock );
+
+  pthread_join( movie_queue.thread, NULL );
+
+  pthread_cond_destroy( &movie_queue.space_cond );
+  pthread_cond_destroy( &movie_queue.work_cond );
+  pthread_mutex_destroy( &movie_queue.lock );
+
+  movie_queue.running = 0;
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+/* Hand a job to the encoder, waiting for it to catch up if it's too far
+   behind */
+static void
+movie_queue_add( movie_job_t *job )
+{
+#ifdef HAVE_PTHREAD
+  if( movie_queue.running ) {
+    pthread_mutex_lock( &movie_queue.lock );
+
+    while( movie_queue.bytes >= MOVIE_QUEUE_LIMIT )
+      pthread_cond_wait( &movie_queue.space_cond, &movie_queue.lock );
+
+    if( movie_queue.tail ) {
+      movie_queue.tail->next = job;
+    } else {
+      movie_queue.head = job;
+    }
+    movie_queue.tail = job;
+    movie_queue.bytes += job->length;
+
+    pthread_cond_signal( &movie_queue.work_cond );
+    pthread_mutex_unlock( &movie_queue.lock );
+    return;
+  }
+#endif				/* #ifdef HAVE_PTHREAD */
+
+  movie_encode( job );
+  movie_job_free( job );
+}
+
+/* Queue some bytes to be written as they are */
+static void
+movie_queue_data( const void *data, size_t length )
+{
+  movie_job_t *job = movie_job_alloc( MOVIE_JOB_DATA, length );
+
+  memcpy( job->data, data, length );
+  movie_queue_add( job );
+}
+
 /* Fetch pixel (x, y). On a Timex this will be a point on a 640x480 canvas,
    on a Sinclair/Amstrad/Russian clone this will be a point on a 320x240
    canvas */
@@ -270,6 +532,13 @@ movie_compress_area( int x, int y, int w, int h, int s )
 void
 movie_add_area( int x, int y, int w, int h )
 {
+  movie_job_t *job;
+  libspectrum_dword *area;
+  int i;
+
+  /* Y4M movies get the whole frame in movie_start_frame() */
+  if( movie_y4m ) return;
+
   if( movie_paused ) {
     movie_start_frame();
     return;
@@ -281,22 +550,30 @@ movie_add_area( int x, int y, int w, int h )
   head[4] = w;
   head[5] = h & 0xff;
   head[6] = h >> 8;
-  fwrite_compr( head, 7, 1, of );
-  movie_compress_area( x, y, w, h, 0 );	/* Bitmap1 */
-  movie_compress_area( x, y, w, h, 8 );	/* Attrib/B2 */
-  if( fmf_screen == 'R' ) {
-    movie_compress_area( x, y, w, h, 16 );	/* HiRes attrib */
-  }
+  movie_queue_data( head, 7 );
+
+  /* Take a copy of the area as the display will have moved on by the time
+     the encoder gets to it */
+  job = movie_job_alloc( MOVIE_JOB_AREA, w * h * sizeof( libspectrum_dword ) );
+  area = job->data;
+  for( i = 0; i < h; i++ )
+    memcpy( area + i * w, &display_last_screen[ x + 40 * ( y + i ) ],
+            w * sizeof( libspectrum_dword ) );
+  job->w = w;
+  job->h = h;
+  job->planes = fmf_screen == 'R' ? 3 : 2;
+  movie_queue_add( job );
+
   slice_no++;
 }
 
-static void
+static int
 movie_start_fmf( const char *name )
 {
   if( ( of = fopen(name, "wb") ) == NULL ) {  /* trunc old file ? or append ? */
     ui_error( UI_ERROR_ERROR, "error opening movie file '%s': %s", name,
               strerror( errno ) );
-    return;
+    return 1;
   }
 #ifdef WORDS_BIGENDIAN
   fwrite( "FMF_V1E", 7, 1, of );	/* write magic header Fuse Movie File */
@@ -333,17 +610,160 @@ movie_start_fmf( const char *name )
   head[6] = stereo;
   head[7] = '\n';	/* padding */
   fwrite( head, 8, 1, of );		/* write initial params */
+  movie_encoder_start();
   movie_add_area( 0, 0, 40, 240 );
+
+  return 0;
+}
+
+static int
+movie_is_y4m( const char *name )
+{
+  const char *extension = strrchr( name, '.' );
+
+  return extension && !strcasecmp( extension, ".y4m" );
+}
+
+/* "foo.y4m" gives "foo.wav" */
+static char*
+movie_wav_filename( const char *name )
+{
+  size_t base_length = strrchr( name, '.' ) - name;
+  char *buffer = libspectrum_new( char, base_length + 5 );
+
+  memcpy( buffer, name, base_length );
+  strcpy( buffer + base_length, ".wav" );
+
+  return buffer;
+}
+
+static int
+movie_start_y4m( const char *name )
+{
+  const libspectrum_byte *data;
+  size_t stride;
+  char *wav_name;
+  int error;
+
+  y4m_scaler = SCALER_NORMAL;
+  if( settings_current.movie_scaler &&
+      scaler_get_type_from_id( settings_current.movie_scaler, &y4m_scaler ) )
+    return 1;
+
+  /* Find out how big the frames will be */
+  error = screenshot_render_rgb32( y4m_scaler, &data, &stride, &y4m_width,
+                                   &y4m_height );
+  if( error ) return error;
+
+  if( ( of = fopen( name, "wb" ) ) == NULL ) {
+    ui_error( UI_ERROR_ERROR, "error opening movie file '%s': %s", name,
+              strerror( errno ) );
+    return 1;
+  }
+
+  movie_init_sound( settings_current.sound_freq,
+                    sound_stereo_ay != SOUND_STEREO_AY_NONE );
+
+  wav_name = movie_wav_filename( name );
+  error = sound_render_file_open( &movie_wav, wav_name, freq,
+                                  stereo == 'S' ? 2 : 1 );
+  libspectrum_free( wav_name );
+  if( error ) {
+    fclose( of ); of = NULL;
+    return error;
+  }
+
+  /* The frame rate is exact; movie_y4m_pad_sound() fills any gaps in the
+     sound so the WAV stays in step with it */
+  fprintf( of, "YUV4MPEG2 W%lu H%lu F%lu:%lu Ip A1:1 C444\n",
+           (unsigned long)y4m_width, (unsigned long)y4m_height,
+           (unsigned long)machine_current->timings.processor_speed,
+           (unsigned long)machine_current->timings.tstates_per_frame *
+             settings_current.frame_rate );
+
+  y4m_planes = libspectrum_new( libspectrum_byte, 3 * y4m_width * y4m_height );
+
+#ifdef HAVE_ZLIB_H
+  fmf_compr = 0;
+#endif	/* HAVE_ZLIB_H */
+
+  y4m_samples = 0;
+  movie_y4m = 1;
+  movie_encoder_start();
+
+  return 0;
+}
+
+/* No sound is generated while fastloading or with sound turned off, so
+   write silence for any frames which didn't get any */
+static void
+movie_y4m_pad_sound( void )
+{
+  libspectrum_qword frame_tstates, expected, one_frame;
+  int channels = stereo == 'S' ? 2 : 1;
+  movie_job_t *job;
+
+  frame_tstates = machine_current->timings.tstates_per_frame;
+  frame_tstates *= settings_current.frame_rate;
+  expected = frame_no * frame_tstates * freq /
+             machine_current->timings.processor_speed;
+  one_frame = frame_tstates * freq / machine_current->timings.processor_speed;
+
+  /* Differences of less than a frame are just rounding in the sound code */
+  if( y4m_samples + one_frame >= expected ) return;
+
+  job = movie_job_alloc( MOVIE_JOB_WAV, ( expected - y4m_samples ) * channels *
+                                        sizeof( libspectrum_signed_word ) );
+  memset( job->data, 0, job->length );
+  job->planes = channels;
+  movie_queue_add( job );
+
+  y4m_samples = expected;
+}
+
+/* Queue the current screen as a Y4M frame */
+static void
+movie_add_y4m_frame( void )
+{
+  const libspectrum_byte *data;
+  libspectrum_byte *pixels;
+  size_t stride, width, height, y;
+  movie_job_t *job;
+
+  if( screenshot_render_rgb32( y4m_scaler, &data, &stride, &width,
+                               &height ) ) {
+    movie_stop();
+    return;
+  }
+
+  if( width != y4m_width || height != y4m_height ) {
+    ui_error( UI_ERROR_ERROR, "screen size changed; stopping movie" );
+    movie_stop();
+    return;
+  }
+
+  job = movie_job_alloc( MOVIE_JOB_FRAME, width * height * 4 );
+  pixels = job->data;
+  for( y = 0; y < height; y++ )
+    memcpy( pixels + y * width * 4, data + y * stride, width * 4 );
+  job->w = width;
+  job->h = height;
+  movie_queue_add( job );
 }
 
 void
 movie_start( const char *name )	/* some init, open file (name)*/
 {
+  int error;
+
   frame_no = slice_no = 0;
   if( name == NULL || *name == '\0' )
     name = "fuse.fmf";			/* fuse movie file */
 
-  movie_start_fmf( name );
+  error = movie_is_y4m( name ) ? movie_start_y4m( name ) :
+                                 movie_start_fmf( name );
+  if( error ) return;
+
   movie_recording = 1;
   ui_menu_activate( UI_MENU_ITEM_FILE_MOVIE_RECORDING, 1 );
   ui_menu_activate( UI_MENU_ITEM_FILE_MOVIE_PAUSE, 1 );
@@ -354,7 +774,15 @@ movie_stop( void )
 {
   if( !movie_paused && !movie_recording ) return;
 
-  fwrite_compr( "X", 1, 1, of );	/* End of Recording! */
+  if( !movie_y4m )
+    movie_queue_data( "X", 1 );	/* End of Recording! */
+  movie_encoder_stop();
+
+  if( movie_y4m ) {
+    sound_render_file_close( &movie_wav );
+    libspectrum_free( y4m_planes ); y4m_planes = NULL;
+    movie_y4m = 0;
+  }
 #ifdef HAVE_ZLIB_H
   {
     if( fmf_compr != 0 ) {		/* close zlib */
@@ -441,16 +869,31 @@ add_sound( libspectrum_signed_word *buff, int len )
   head[5] = len & 0xff;
   head[6] = len >> 8;
   len++;		/* len :-) */
-  fwrite_compr( head, 7, 1, of );	/* Sound frame */
-  if( format == 'P' )
-    fwrite_compr( buff, len * framesiz , 1, of );	/* write frame */
-  else if( format == 'A' )
-    write_alaw( buff, len * framesiz );
+  movie_queue_data( head, 7 );	/* Sound frame */
+  if( format == 'P' ) {
+    movie_queue_data( buff, len * framesiz );	/* write frame */
+  } else if( format == 'A' ) {
+    movie_job_t *job =
+      movie_job_alloc( MOVIE_JOB_ALAW,
+                       len * framesiz * sizeof( libspectrum_signed_word ) );
+    memcpy( job->data, buff, job->length );
+    movie_queue_add( job );
+  }
 }
 
 void
 movie_add_sound( libspectrum_signed_word *buff, int len )
 {
+  if( movie_y4m ) {
+    movie_job_t *job =
+      movie_job_alloc( MOVIE_JOB_WAV, len * sizeof( libspectrum_signed_word ) );
+    memcpy( job->data, buff, job->length );
+    job->planes = stereo == 'S' ? 2 : 1;
+    movie_queue_add( job );
+    y4m_samples += len / job->planes;
+    return;
+  }
+
   while( len ) {
     if( stereo == 'S' ) {
       add_sound( buff, len > 131072 ? 65536 : len >> 1 );
@@ -467,12 +910,20 @@ movie_add_sound( libspectrum_signed_word *buff, int len )
 void
 movie_start_frame( void )
 {
+  if( movie_y4m ) {
+    movie_paused = 0;
+    movie_add_y4m_frame();
+    frame_no++;
+    movie_y4m_pad_sound();
+    return;
+  }
+
   /* $ - ZX$, T - TX$, C - HiCol, R - HiRes */
   head[0] = 'N';
   head[1] = settings_current.frame_rate;
   head[2] = get_screentype();
   head[3] = get_timing();
-  fwrite_compr( head, 4, 1, of );	/* New frame! */
+  movie_queue_data( head, 4 );	/* New frame! */
   frame_no++;
   if( movie_paused ) {
     movie_paused = 0;
@@ -35,6 +35,7 @@
 #include "printer.h"
 #include "psg.h"
 #include "sound.h"
+#include "state.h"
 
 /* Unused bits in the AY registers are silently zeroed out; these masks
    accomplish this */
@@ -48,6 +49,8 @@ static const libspectrum_byte mask[ AY_REGISTERS ] = {
 static void ay_reset( int hard_reset );
 static void ay_from_snapshot( libspectrum_snap *snap );
 static void ay_to_snapshot( libspectrum_snap *snap );
+static void ay_state_save( state_buffer_t *buffer );
+static int ay_state_load( state_buffer_t *buffer );
 static libspectrum_dword get_current_register( void );
 static void set_current_register( libspectrum_dword value );
 
@@ -58,6 +61,10 @@ static module_info_t ay_module_info = {
   /* .snapshot_enabled = */ NULL,
   /* .snapshot_from = */ ay_from_snapshot,
   /* .snapshot_to = */ ay_to_snapshot,
+  /* .state_id = */ STATE_ID( 'A', 'Y', ' ', ' ' ),
+  /* .state_version = */ 1,
+  /* .state_save = */ ay_state_save,
+  /* .state_load = */ ay_state_load,
 
 };
 
@@ -247,6 +254,27 @@ ay_to_snapshot( libspectrum_snap *snap )
 				       machine_current->ay.registers[i] );
 }
 
+static void
+ay_state_save( state_buffer_t *buffer )
+{
+  state_buffer_write_byte( buffer, machine_current->ay.current_register );
+  state_buffer_write( buffer, machine_current->ay.registers, AY_REGISTERS );
+}
+
+static int
+ay_state_load( state_buffer_t *buffer )
+{
+  size_t i;
+
+  ay_registerport_write( 0xfffd, state_buffer_read_byte( buffer ) );
+  state_buffer_read( buffer, machine_current->ay.registers, AY_REGISTERS );
+
+  for( i = 0; i < AY_REGISTERS; i++ )
+    sound_ay_write( i, machine_current->ay.registers[i], 0 );
+
+  return 0;
+}
+
 static libspectrum_dword
 get_current_register( void )
 {
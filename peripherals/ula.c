@@ -41,6 +41,7 @@
 #include "settings.h"
 #include "sound.h"
 #include "spectrum.h"
+#include "state.h"
 #include "tape.h"
 #include "ula.h"
 
@@ -56,6 +57,8 @@ libspectrum_byte ula_default_value;
 
 static void ula_from_snapshot( libspectrum_snap *snap );
 static void ula_to_snapshot( libspectrum_snap *snap );
+static void ula_state_save( state_buffer_t *buffer );
+static int ula_state_load( state_buffer_t *buffer );
 static libspectrum_byte ula_read( libspectrum_word port, libspectrum_byte *attached );
 static void ula_write( libspectrum_word port, libspectrum_byte b );
 
@@ -66,6 +69,10 @@ static module_info_t ula_module_info = {
   /* .snapshot_enabled = */ NULL,
   /* .snapshot_from = */ ula_from_snapshot,
   /* .snapshot_to = */ ula_to_snapshot,
+  /* .state_id = */ STATE_ID( 'U', 'L', 'A', ' ' ),
+  /* .state_version = */ 1,
+  /* .state_save = */ ula_state_save,
+  /* .state_load = */ ula_state_load,
 
 };
 
@@ -198,8 +205,12 @@ ula_read( libspectrum_word port, libspectrum_byte *attached )
 static void
 ula_write( libspectrum_word port GCC_UNUSED, libspectrum_byte b )
 {
+  libspectrum_byte changed = last_byte ^ b;
+
   last_byte = b;
 
+  if( tape_recording && ( changed & 0x08 ) ) tape_record_edge( tstates );
+
   display_set_lores_border( b & 0x07 );
   sound_beeper( tstates,
                 (!!(b & 0x10) << 1) + ( (!(b & 0x8)) | tape_microphone ) );
@@ -234,12 +245,6 @@ ula_last_byte( void )
   return last_byte;
 }
 
-libspectrum_byte
-ula_tape_level( void )
-{
-  return last_byte & 0x8;
-}
-
 static void
 ula_from_snapshot( libspectrum_snap *snap )
 {
@@ -256,6 +261,29 @@ ula_to_snapshot( libspectrum_snap *snap )
   libspectrum_snap_set_issue2( snap, settings_current.issue2 );
 }  
 
+static void
+ula_state_save( state_buffer_t *buffer )
+{
+  state_buffer_write_byte( buffer, last_byte );
+  state_buffer_write_dword( buffer, tstates );
+  state_buffer_write_byte( buffer, settings_current.issue2 );
+}
+
+static int
+ula_state_load( state_buffer_t *buffer )
+{
+  libspectrum_byte b = state_buffer_read_byte( buffer );
+
+  /* The beeper and the default value of the ULA depend on these, so
+     restore them before writing to the ULA */
+  tstates = state_buffer_read_dword( buffer );
+  settings_current.issue2 = state_buffer_read_byte( buffer );
+
+  ula_write( 0x00fe, b );
+
+  return 0;
+}
+
 void
 ula_contend_port_early( libspectrum_word port )
 {
@@ -36,8 +36,6 @@ void ula_register_startup( void );
 
 libspectrum_byte ula_last_byte( void );
 
-libspectrum_byte ula_tape_level( void );
-
 void ula_contend_port_early( libspectrum_word port );
 void ula_contend_port_late( libspectrum_word port );
 
@@ -27,163 +27,275 @@
 
 #include <stdlib.h>
 
+#include "display.h"
 #include "fuse.h"
 #include "rectangle.h"
 #include "settings.h"
 #include "ui/ui.h"
 
-/* Those rectangles which were modified on the last line to be displayed */
+#ifndef MAX
+#define MAX(a,b)    (((a) > (b)) ? (a) : (b))
+#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
+#endif
+
+/* The dirty spans on the line currently being processed, coalesced
+   horizontally and sorted by x */
+static struct rectangle line_spans[ DISPLAY_SCREEN_WIDTH_COLS ];
+static size_t line_span_count = 0;
+
+/* Those rectangles which were modified on the last line to be displayed,
+   sorted by x */
 static struct rectangle *rectangle_active = NULL;
 static size_t rectangle_active_count = 0, rectangle_active_allocated = 0;
 
+/* The rectangles which will be active after the current line */
+static struct rectangle *rectangle_next = NULL;
+static size_t rectangle_next_count = 0, rectangle_next_allocated = 0;
+
 /* Those rectangles which weren't */
 struct rectangle *rectangle_inactive = NULL;
 size_t rectangle_inactive_count = 0, rectangle_inactive_allocated = 0;
 
+/* Set once the inactive list has been replaced by the whole screen */
+static int rectangle_full_screen = 0;
+
+/* The cost of a rectangle, measured in the number of 8x1 chunks which could
+   be redrawn unnecessarily in the time taken to handle it */
+static int
+rectangle_cost( void )
+{
+  return settings_current.dirty_rect_cost > 0 ?
+         settings_current.dirty_rect_cost : 0;
+}
+
+static struct rectangle*
+append_rectangle( struct rectangle **list, size_t *count, size_t *allocated )
+{
+  if( ++(*count) > *allocated ) {
+
+    size_t new_alloc;
+
+    new_alloc = *allocated ? 2 * *allocated : 8;
+
+    *list = libspectrum_renew( struct rectangle, *list, new_alloc );
+    *allocated = new_alloc;
+  }
+
+  return &(*list)[ *count - 1 ];
+}
+
 /* Add the rectangle { x, line, w, 1 } to the list of rectangles to be
-   redrawn, either by extending an existing rectangle or creating a
-   new one */
+   redrawn. Spans must be added in increasing x order for each line; spans
+   separated by a gap cheaper to redraw than a new rectangle are joined */
 void
 rectangle_add( int y, int x, int w )
 {
-  size_t i;
-  struct rectangle *ptr;
+  struct rectangle *last;
 
-  /* Check through all 'active' rectangles (those which were modified
-     on the previous line) and see if we can use this new rectangle
-     to extend them */
-  for( i = 0; i < rectangle_active_count; i++ ) {
+  if( rectangle_full_screen ) return;
 
-    if( rectangle_active[i].x == x &&
-	rectangle_active[i].w == w    ) {
-      rectangle_active[i].h++;
+  if( line_span_count ) {
+    last = &line_spans[ line_span_count - 1 ];
+    if( x - ( last->x + last->w ) <= rectangle_cost() ) {
+      last->w = x + w - last->x;
       return;
     }
   }
 
-  /* We couldn't find a rectangle to extend, so create a new one */
-  if( ++rectangle_active_count > rectangle_active_allocated ) {
-
-    size_t new_alloc;
+  last = &line_spans[ line_span_count++ ];
+  last->x = x; last->y = y;
+  last->w = w; last->h = 1;
+}
 
-    new_alloc = rectangle_active_allocated     ?
-                2 * rectangle_active_allocated :
-                8;
+/* The number of extra chunks which would be redrawn if 'a' and 'b' were
+   replaced by their bounding box. Drawing them separately draws any
+   overlap twice, so overlapping rectangles are cheap (or free) to merge */
+static int
+merge_waste( const struct rectangle *a, const struct rectangle *b )
+{
+  int x0, y0, x1, y1;
 
-    ptr = libspectrum_renew( struct rectangle, rectangle_active, new_alloc );
+  x0 = MIN( a->x, b->x ); x1 = MAX( a->x + a->w, b->x + b->w );
+  y0 = MIN( a->y, b->y ); y1 = MAX( a->y + a->h, b->y + b->h );
 
-    rectangle_active_allocated = new_alloc; rectangle_active = ptr;
-  }
+  return ( x1 - x0 ) * ( y1 - y0 ) - a->w * a->h - b->w * b->h;
+}
 
-  ptr = &rectangle_active[ rectangle_active_count - 1 ];
+static void
+merge_into( struct rectangle *dest, const struct rectangle *source )
+{
+  int x1 = MAX( dest->x + dest->w, source->x + source->w );
+  int y1 = MAX( dest->y + dest->h, source->y + source->h );
 
-  ptr->x = x; ptr->y = y;
-  ptr->w = w; ptr->h = 1;
+  dest->x = MIN( dest->x, source->x ); dest->w = x1 - dest->x;
+  dest->y = MIN( dest->y, source->y ); dest->h = y1 - dest->y;
 }
 
-#ifndef MAX
-#define MAX(a,b)    (((a) > (b)) ? (a) : (b))
-#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
-#endif
+/* Replace everything with a single full screen update */
+static void
+set_full_screen( void )
+{
+  rectangle_inactive_count = 0;
+  append_rectangle( &rectangle_inactive, &rectangle_inactive_count,
+                    &rectangle_inactive_allocated );
+
+  rectangle_inactive[0].x = 0; rectangle_inactive[0].y = 0;
+  rectangle_inactive[0].w = DISPLAY_SCREEN_WIDTH_COLS;
+  rectangle_inactive[0].h = DISPLAY_SCREEN_HEIGHT;
 
-static inline int
-compare_and_merge_rectangles( struct rectangle *source )
+  rectangle_active_count = rectangle_next_count = line_span_count = 0;
+  rectangle_full_screen = 1;
+}
+
+/* Move a rectangle which is no longer growing to the inactive list, merging
+   it with an existing rectangle if that is cheaper than drawing both. These
+   occur when frame skip is on and the same lines are covered more than
+   once, or when nearby areas of the screen are changed */
+static void
+retire_rectangle( const struct rectangle *source )
 {
   size_t z;
+  int limit;
 
-  /* Now look to see if there is an overlapping rectangle in the inactive
-     list.  These occur when frame skip is on and the same lines are
-     covered more than once... */
   for( z = 0; z < rectangle_inactive_count; z++ ) {
-    if( rectangle_inactive[z].x == source->x &&
-          rectangle_inactive[z].w == source->w ) {
-      if( rectangle_inactive[z].y == source->y &&
-            rectangle_inactive[z].h == source->h )
-        return 1;
-
-      if( ( rectangle_inactive[z].y < source->y && 
-          ( source->y < ( rectangle_inactive[z].y +
-            rectangle_inactive[z].h + 1 ) ) ) ||
-          ( source->y < rectangle_inactive[z].y && 
-          ( rectangle_inactive[z].y < ( source->y + source->h + 1 ) ) ) ) {
-        /* rects overlap or touch in the y dimension, merge */
-        rectangle_inactive[z].h = MAX( rectangle_inactive[z].y +
-                                    rectangle_inactive[z].h,
-                                    source->y + source->h ) -
-                                  MIN( rectangle_inactive[z].y, source->y );
-        rectangle_inactive[z].y = MIN( rectangle_inactive[z].y, source->y );
-
-        return 1;
-      }
-    }
-    if( rectangle_inactive[z].y == source->y &&
-          rectangle_inactive[z].h == source->h ) {
-
-      if( (rectangle_inactive[z].x < source->x && 
-          ( source->x < ( rectangle_inactive[z].x +
-            rectangle_inactive[z].w + 1 ) ) ) ||
-          ( source->x < rectangle_inactive[z].x && 
-          ( rectangle_inactive[z].x < ( source->x + source->w + 1 ) ) ) ) {
-        /* rects overlap or touch in the x dimension, merge */
-        rectangle_inactive[z].w = MAX( rectangle_inactive[z].x +
-          rectangle_inactive[z].w, source->x +
-          source->w ) - MIN( rectangle_inactive[z].x, source->x );
-        rectangle_inactive[z].x = MIN( rectangle_inactive[z].x, source->x );
-        return 1;
-      }
+    if( merge_waste( &rectangle_inactive[z], source ) <= rectangle_cost() ) {
+      merge_into( &rectangle_inactive[z], source );
+      return;
     }
-     /* Handle overlaps offset by both x and y? how much overlap and hence 
-        overdraw can be tolerated? */
   }
-  return 0;
+
+  limit = settings_current.dirty_rect_limit;
+  if( limit > 0 && rectangle_inactive_count >= (size_t)limit ) {
+    set_full_screen();
+    return;
+  }
+
+  *append_rectangle( &rectangle_inactive, &rectangle_inactive_count,
+                     &rectangle_inactive_allocated ) = *source;
 }
 
-/* Move all rectangles not updated on this line to the inactive list */
+/* Finish with a rectangle from the active list: keep it if it was
+   extended onto line 'y', otherwise it's done */
+static void
+finish_active( const struct rectangle *rect, int y )
+{
+  if( rect->y + rect->h == y + 1 ) {
+    *append_rectangle( &rectangle_next, &rectangle_next_count,
+                       &rectangle_next_allocated ) = *rect;
+  } else {
+    retire_rectangle( rect );
+  }
+}
+
+/* Extend the active rectangle 'rect' to cover 'span' on line 'y' if that
+   costs less than starting a new rectangle */
+static int
+extend_active( struct rectangle *rect, const struct rectangle *span, int y )
+{
+  struct rectangle extended;
+  int extra, overlap;
+
+  extended = *rect;
+  if( extended.y + extended.h < y + 1 ) extended.h = y + 1 - extended.y;
+  merge_into( &extended, span );
+
+  extra = extended.w * extended.h - rect->w * rect->h - span->w;
+
+  /* If the rectangle has already been extended onto this line, don't count
+     the part of the span it already covers twice */
+  if( rect->y + rect->h == y + 1 ) {
+    overlap = MIN( rect->x + rect->w, span->x + span->w ) -
+              MAX( rect->x, span->x );
+    if( overlap > 0 ) extra += overlap;
+  }
+
+  if( extra > rectangle_cost() ) return 0;
+
+  *rect = extended;
+  return 1;
+}
+
+/* Match the spans on line 'y' against the active rectangles: both are
+   sorted by x, so this is a single sweep. Active rectangles not extended
+   onto this line are moved to the inactive list */
 void
 rectangle_end_line( int y )
 {
-  size_t i;
-  struct rectangle *ptr;
+  size_t i, j, k;
+  struct rectangle *rect, tmp;
+
+  if( rectangle_full_screen ) {
+    line_span_count = 0;
+    return;
+  }
 
-  for( i = 0; i < rectangle_active_count; i++ ) {
+  rectangle_next_count = 0;
 
-    /* Skip if this rectangle was updated this line */
-    if( rectangle_active[i].y + rectangle_active[i].h == y + 1 ) continue;
+  for( i = 0, j = 0; j < line_span_count; j++ ) {
+    struct rectangle *span = &line_spans[j];
 
-    if ( settings_current.frame_rate > 1 &&
-	 compare_and_merge_rectangles( &rectangle_active[i] ) ) {
+    /* Skip past active rectangles entirely to the left of this span */
+    while( i < rectangle_active_count &&
+           rectangle_active[i].x + rectangle_active[i].w < span->x ) {
+      finish_active( &rectangle_active[i++], y );
+      if( rectangle_full_screen ) return;
+    }
 
-      /* Mark the active rectangle as done */
-      rectangle_active[i].h = 0;
+    if( i < rectangle_active_count &&
+        rectangle_active[i].x <= span->x + span->w &&
+        extend_active( &rectangle_active[i], span, y ) )
       continue;
-    }
 
     /* We couldn't find a rectangle to extend, so create a new one */
-    if( ++rectangle_inactive_count > rectangle_inactive_allocated ) {
+    *append_rectangle( &rectangle_next, &rectangle_next_count,
+                       &rectangle_next_allocated ) = *span;
+  }
 
-      size_t new_alloc;
+  for( ; i < rectangle_active_count; i++ ) {
+    finish_active( &rectangle_active[i], y );
+    if( rectangle_full_screen ) return;
+  }
 
-      new_alloc = rectangle_inactive_allocated     ?
-	          2 * rectangle_inactive_allocated :
-	          8;
+  line_span_count = 0;
 
-      ptr =
-        libspectrum_renew( struct rectangle, rectangle_inactive, new_alloc );
+  /* Keep the new active list sorted by x; it's almost sorted already, so
+     use an insertion sort */
+  for( j = 1; j < rectangle_next_count; j++ ) {
+    tmp = rectangle_next[j];
+    for( k = j; k > 0 && rectangle_next[ k - 1 ].x > tmp.x; k-- )
+      rectangle_next[k] = rectangle_next[ k - 1 ];
+    rectangle_next[k] = tmp;
+  }
 
-      rectangle_inactive_allocated = new_alloc; rectangle_inactive = ptr;
+  /* Extending a rectangle can make it overlap the next one along, as a span
+     only ever extends one rectangle; merge any which now overlap */
+  for( j = 1, k = 0; j < rectangle_next_count; j++ ) {
+    if( rectangle_next[k].x + rectangle_next[k].w > rectangle_next[j].x &&
+        merge_waste( &rectangle_next[k], &rectangle_next[j] ) <=
+          rectangle_cost() ) {
+      merge_into( &rectangle_next[k], &rectangle_next[j] );
+    } else {
+      rectangle_next[ ++k ] = rectangle_next[j];
     }
+  }
+  if( rectangle_next_count ) rectangle_next_count = k + 1;
 
-    rectangle_inactive[ rectangle_inactive_count - 1 ] = rectangle_active[i];
+  /* And swap the lists over */
+  rect = rectangle_active; rectangle_active = rectangle_next;
+  rectangle_next = rect;
 
-    /* Mark the active rectangle as done */
-    rectangle_active[i].h = 0;
-  }
+  k = rectangle_active_allocated;
+  rectangle_active_allocated = rectangle_next_allocated;
+  rectangle_next_allocated = k;
 
-  /* Compress the list of active rectangles */
-  for( i = 0, ptr = rectangle_active; i < rectangle_active_count; i++ ) {
-    if( rectangle_active[i].h == 0 ) continue;
-    *ptr = rectangle_active[i]; ptr++;
-  }
+  rectangle_active_count = rectangle_next_count;
+  rectangle_next_count = 0;
+}
 
-  rectangle_active_count = ptr - rectangle_active;
+/* Empty the inactive list once it has been sent to the UI */
+void
+rectangle_clear( void )
+{
+  rectangle_inactive_count = 0;
+  rectangle_full_screen = 0;
 }
@@ -0,0 +1,681 @@
+/* rewind.c: run time backwards through recent frames
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+/* The state of the machine is stored at the end of every frame. Only the
+   newest state is kept in full; each older one is kept as the difference
+   between it and the state after it, XORed together and run-length
+   encoded so that the (mostly) unchanged bytes cost almost nothing. RAM
+   pages which haven't been written to since the last frame aren't even
+   compared.
+
+   The differences are kept in a fixed size arena used as a circular log,
+   with the oldest entries being thrown away to make room for new ones.
+   Running backwards pops the newest entry off the log and applies it to
+   the full state to get the one before */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libspectrum.h>
+
+#include "infrastructure/startup_manager.h"
+#include "machine.h"
+#include "memory_pages.h"
+#include "module.h"
+#include "rewind.h"
+#include "rzx.h"
+#include "settings.h"
+#include "state.h"
+#include "tape.h"
+#include "ui/ui.h"
+
+/* The types of log entry */
+enum {
+  REWIND_ENTRY_DELTA,		/* XOR against the state after this one */
+  REWIND_ENTRY_KEY,		/* The state in full */
+};
+
+/* Runs of unchanged bytes shorter than this are cheaper to include in
+   the surrounding literal run than to start a new run for */
+#define REWIND_MIN_GAP 4
+
+typedef struct rewind_entry_t {
+  size_t offset;
+  size_t length;
+} rewind_entry_t;
+
+static struct {
+
+  /* The arena the log entries live in */
+  libspectrum_byte *arena;
+  size_t arena_size;
+  size_t write_position;
+
+  /* Where each entry is, oldest first */
+  rewind_entry_t *entries;
+  size_t capacity;
+  size_t first;
+  size_t count;
+
+  /* The settings the buffer was allocated for */
+  int seconds;
+  int megabytes;
+
+  /* The newest state, and space for the one being stored or encoded */
+  state_t *state;
+  state_buffer_t previous, current, entry;
+  int have_previous;
+
+  int held;
+
+} rewind_buffer;
+
+static void rewind_reset( int hard_reset );
+
+static module_info_t rewind_module_info = {
+
+  /* .reset = */ rewind_reset,
+  /* .romcs = */ NULL,
+  /* .snapshot_enabled = */ NULL,
+  /* .snapshot_from = */ NULL,
+  /* .snapshot_to = */ NULL,
+
+};
+
+static void
+buffer_free( state_buffer_t *buffer )
+{
+  libspectrum_free( buffer->data );
+  memset( buffer, 0, sizeof( *buffer ) );
+}
+
+static void
+rewind_free( void )
+{
+  libspectrum_free( rewind_buffer.arena );
+  rewind_buffer.arena = NULL;
+  libspectrum_free( rewind_buffer.entries );
+  rewind_buffer.entries = NULL;
+
+  if( rewind_buffer.state ) {
+    state_free( rewind_buffer.state );
+    rewind_buffer.state = NULL;
+  }
+
+  buffer_free( &rewind_buffer.previous );
+  buffer_free( &rewind_buffer.current );
+  buffer_free( &rewind_buffer.entry );
+
+  rewind_buffer.count = 0;
+  rewind_buffer.have_previous = 0;
+}
+
+static int
+rewind_init( void *context )
+{
+  module_register( &rewind_module_info );
+
+  return 0;
+}
+
+static void
+rewind_end( void )
+{
+  rewind_free();
+}
+
+void
+rewind_register_startup( void )
+{
+  startup_manager_module dependencies[] = {
+    STARTUP_MANAGER_MODULE_MEMORY,
+    STARTUP_MANAGER_MODULE_SETUID,
+  };
+  startup_manager_register( STARTUP_MANAGER_MODULE_REWIND, dependencies,
+                            ARRAY_SIZE( dependencies ), rewind_init, NULL,
+                            rewind_end );
+}
+
+/* There's no going back past a reset */
+static void
+rewind_reset( int hard_reset GCC_UNUSED )
+{
+  rewind_buffer.count = 0;
+  rewind_buffer.write_position = 0;
+  rewind_buffer.have_previous = 0;
+
+  memory_ram_dirty_all();
+}
+
+/* Make sure the buffer matches the current settings */
+static int
+rewind_allocate( void )
+{
+  libspectrum_dword frame_rate;
+
+  if( rewind_buffer.arena &&
+      rewind_buffer.seconds == settings_current.rewind_seconds &&
+      rewind_buffer.megabytes == settings_current.rewind_memory )
+    return 0;
+
+  rewind_free();
+
+  if( settings_current.rewind_seconds <= 0 ||
+      settings_current.rewind_memory <= 0 ) {
+    ui_error( UI_ERROR_ERROR, "rewind: length and memory must be positive" );
+    settings_current.rewind = 0;
+    return 1;
+  }
+
+  frame_rate = machine_current->timings.processor_speed /
+               machine_current->timings.tstates_per_frame;
+
+  rewind_buffer.seconds = settings_current.rewind_seconds;
+  rewind_buffer.megabytes = settings_current.rewind_memory;
+
+  rewind_buffer.arena_size = (size_t)rewind_buffer.megabytes * 1024 * 1024;
+  rewind_buffer.arena = libspectrum_new( libspectrum_byte,
+                                         rewind_buffer.arena_size );
+
+  rewind_buffer.capacity = (size_t)rewind_buffer.seconds * frame_rate;
+  rewind_buffer.entries = libspectrum_new( rewind_entry_t,
+                                           rewind_buffer.capacity );
+
+  rewind_buffer.state = state_alloc();
+
+  rewind_buffer.first = rewind_buffer.count = 0;
+  rewind_buffer.write_position = 0;
+  rewind_buffer.have_previous = 0;
+
+  return 0;
+}
+
+static void
+write_number( state_buffer_t *out, size_t n )
+{
+  while( n >= 0x80 ) {
+    state_buffer_write_byte( out, ( n & 0x7f ) | 0x80 );
+    n >>= 7;
+  }
+  state_buffer_write_byte( out, n );
+}
+
+static int
+read_number( const libspectrum_byte **ptr, const libspectrum_byte *end,
+             size_t *n )
+{
+  int shift = 0;
+
+  *n = 0;
+
+  while( *ptr < end ) {
+    libspectrum_byte b = *(*ptr)++;
+    *n |= (size_t)( b & 0x7f ) << shift;
+    if( !( b & 0x80 ) ) return 0;
+    shift += 7;
+    if( shift >= 8 * (int)sizeof( size_t ) ) break;
+  }
+
+  return 1;
+}
+
+/* Is 'i' the start of a RAM page which hasn't been written to? */
+static int
+clean_page( const state_buffer_t *layout, size_t i )
+{
+  size_t page;
+
+  if( !layout || i < layout->ram_offset ) return 0;
+
+  i -= layout->ram_offset;
+  if( i % MEMORY_PAGE_SIZE ) return 0;
+
+  page = i / MEMORY_PAGE_SIZE;
+  return page < layout->ram_pages && !memory_ram_dirty[ page ];
+}
+
+/* How many bytes from 'i' onwards are the same in 'a' and 'b' */
+static size_t
+unchanged_length( const libspectrum_byte *a, const libspectrum_byte *b,
+                  size_t i, size_t length, const state_buffer_t *layout )
+{
+  size_t start = i;
+
+  while( i < length ) {
+    if( clean_page( layout, i ) ) {
+      i += MEMORY_PAGE_SIZE;
+    } else if( a[i] == b[i] ) {
+      i++;
+    } else {
+      break;
+    }
+  }
+
+  return i - start;
+}
+
+/* Encode 'older' relative to 'newer' into 'out'. If 'layout' is non-NULL,
+   pages of RAM it describes which haven't been written to are assumed to
+   be the same without looking at them */
+static void
+delta_encode( state_buffer_t *out, const state_buffer_t *older,
+              const state_buffer_t *newer, const state_buffer_t *layout )
+{
+  const libspectrum_byte *a = older->data, *b = newer->data;
+  size_t length = older->length, i = 0, zeros, start, same, j;
+
+  out->length = 0;
+
+  if( older->length != newer->length ) {
+    state_buffer_write_byte( out, REWIND_ENTRY_KEY );
+    state_buffer_write_dword( out, length );
+    state_buffer_write( out, a, length );
+    return;
+  }
+
+  state_buffer_write_byte( out, REWIND_ENTRY_DELTA );
+  state_buffer_write_dword( out, length );
+
+  while( i < length ) {
+
+    zeros = unchanged_length( a, b, i, length, layout );
+    i += zeros;
+    if( i == length ) break;
+
+    start = i;
+    while( i < length ) {
+      if( a[i] != b[i] ) { i++; continue; }
+      same = unchanged_length( a, b, i, length, layout );
+      if( same >= REWIND_MIN_GAP || i + same == length ) break;
+      i += same;
+    }
+
+    write_number( out, zeros );
+    write_number( out, i - start );
+
+    state_buffer_reserve( out, i - start );
+    for( j = start; j < i; j++ ) out->data[ out->length++ ] = a[j] ^ b[j];
+  }
+}
+
+/* Apply an encoded entry to 'state', turning it into the state before */
+static int
+delta_decode( state_buffer_t *state, const libspectrum_byte *data,
+              size_t length )
+{
+  const libspectrum_byte *ptr = data + 5, *end = data + length;
+  size_t state_length, position = 0, zeros, literal;
+
+  if( length < 5 ) return 1;
+
+  state_length =  data[1]        | ( data[2] <<  8 ) |
+                ( data[3] << 16 ) | ( (size_t)data[4] << 24 );
+
+  switch( data[0] ) {
+
+  case REWIND_ENTRY_KEY:
+    if( length - 5 != state_length ) return 1;
+    state->length = 0;
+    state_buffer_write( state, ptr, state_length );
+    return 0;
+
+  case REWIND_ENTRY_DELTA:
+    if( state->length != state_length ) return 1;
+    while( ptr < end ) {
+      if( read_number( &ptr, end, &zeros ) ||
+          read_number( &ptr, end, &literal ) ) return 1;
+      position += zeros;
+      if( position > state_length || literal > state_length - position ||
+          literal > (size_t)( end - ptr ) ) return 1;
+      while( literal-- ) state->data[ position++ ] ^= *ptr++;
+    }
+    return 0;
+
+  }
+
+  return 1;
+}
+
+/* Remove the oldest entry from the log */
+static void
+log_drop_oldest( void )
+{
+  rewind_buffer.first = ( rewind_buffer.first + 1 ) % rewind_buffer.capacity;
+  rewind_buffer.count--;
+}
+
+/* Add an entry to the log, throwing away old entries to make room */
+static void
+log_push( const state_buffer_t *entry )
+{
+  size_t start = rewind_buffer.write_position, end, skipped = 0;
+  rewind_entry_t *e;
+
+  if( entry->length > rewind_buffer.arena_size ) {
+    rewind_buffer.count = 0;
+    rewind_buffer.write_position = 0;
+    return;
+  }
+
+  /* Entries don't wrap around the end of the arena. Anything between here
+     and the end is from the last time round and is the oldest we have */
+  if( start + entry->length > rewind_buffer.arena_size ) {
+    skipped = start;
+    start = 0;
+  }
+  end = start + entry->length;
+
+  while( rewind_buffer.count ) {
+    rewind_entry_t *oldest = &rewind_buffer.entries[ rewind_buffer.first ];
+
+    if( rewind_buffer.count == rewind_buffer.capacity ||
+        ( skipped && oldest->offset >= skipped ) ||
+        ( oldest->offset < end &&
+          oldest->offset + oldest->length > start ) ) {
+      log_drop_oldest();
+    } else {
+      break;
+    }
+  }
+
+  if( !rewind_buffer.count ) {
+    start = 0; end = entry->length;
+  }
+
+  memcpy( rewind_buffer.arena + start, entry->data, entry->length );
+
+  e = &rewind_buffer.entries[ ( rewind_buffer.first + rewind_buffer.count ) %
+                              rewind_buffer.capacity ];
+  e->offset = start;
+  e->length = entry->length;
+  rewind_buffer.count++;
+
+  rewind_buffer.write_position = end;
+}
+
+/* Remove the newest entry from the log, returning where it was. Its data
+   stays valid until the next log_push() */
+static const rewind_entry_t*
+log_pop( void )
+{
+  const rewind_entry_t *newest;
+
+  if( !rewind_buffer.count ) return NULL;
+
+  newest = &rewind_buffer.entries[ ( rewind_buffer.first +
+                                     rewind_buffer.count - 1 ) %
+                                   rewind_buffer.capacity ];
+  rewind_buffer.count--;
+  rewind_buffer.write_position = newest->offset;
+
+  return newest;
+}
+
+/* Store the current state of the machine */
+static void
+rewind_store( void )
+{
+  state_buffer_t swap;
+  const state_buffer_t *layout = NULL;
+
+  if( state_save( rewind_buffer.state ) ||
+      state_write_flat( rewind_buffer.state, &rewind_buffer.current ) ) {
+    rewind_reset( 0 );
+    return;
+  }
+
+  if( rewind_buffer.have_previous ) {
+
+    if( rewind_buffer.previous.ram_pages &&
+        rewind_buffer.previous.ram_offset ==
+          rewind_buffer.current.ram_offset &&
+        rewind_buffer.previous.ram_pages == rewind_buffer.current.ram_pages )
+      layout = &rewind_buffer.current;
+
+    delta_encode( &rewind_buffer.entry, &rewind_buffer.previous,
+                  &rewind_buffer.current, layout );
+    log_push( &rewind_buffer.entry );
+  }
+
+  swap = rewind_buffer.previous;
+  rewind_buffer.previous = rewind_buffer.current;
+  rewind_buffer.current = swap;
+  rewind_buffer.have_previous = 1;
+
+  memory_ram_dirty_clear();
+}
+
+/* Go back one frame, or stay on the oldest one we have */
+static void
+rewind_step( void )
+{
+  const rewind_entry_t *newest;
+
+  if( !rewind_buffer.have_previous ) return;
+
+  newest = log_pop();
+  if( newest ) {
+    if( delta_decode( &rewind_buffer.previous,
+                      rewind_buffer.arena + newest->offset,
+                      newest->length ) ) {
+      ui_error( UI_ERROR_ERROR, "rewind: corrupt entry" );
+      rewind_reset( 0 );
+      return;
+    }
+  }
+
+  if( state_read_flat( rewind_buffer.state, &rewind_buffer.previous ) ||
+      state_load( rewind_buffer.state ) ) {
+    rewind_reset( 0 );
+    return;
+  }
+
+  /* Which RAM pages have changed isn't known until the next store */
+  rewind_buffer.previous.ram_pages = 0;
+}
+
+void
+rewind_frame( void )
+{
+  if( !settings_current.rewind ) {
+    if( rewind_buffer.arena ) rewind_free();
+    return;
+  }
+
+  /* Running backwards would break a recording, and playback has its own
+     way of moving around */
+  if( rzx_playback || rzx_recording ) return;
+
+  if( rewind_allocate() ) return;
+
+  /* Neither the tape's position nor what is being recorded to it is part
+     of the state, so they would carry on running forwards */
+  if( rewind_buffer.held && !tape_is_playing() && !tape_recording ) {
+    rewind_step();
+  } else {
+    rewind_store();
+  }
+}
+
+void
+rewind_hold( int held )
+{
+  rewind_buffer.held = held;
+}
+
+/* Push 'pushes' entries into a log of 'arena_size' bytes and 'capacity'
+   entries, entry i being lengths[ i % length_count ] copies of i, then pop
+   them all back and check the newest 'expected' come back intact */
+static int
+unittest_log( size_t arena_size, size_t capacity, const size_t *lengths,
+              size_t length_count, size_t pushes, size_t expected )
+{
+  state_buffer_t entry;
+  const rewind_entry_t *e;
+  size_t i, j, popped = 0;
+  int r = 0;
+
+  memset( &entry, 0, sizeof( entry ) );
+
+  rewind_buffer.arena_size = arena_size;
+  rewind_buffer.arena = libspectrum_new( libspectrum_byte, arena_size );
+  rewind_buffer.capacity = capacity;
+  rewind_buffer.entries = libspectrum_new( rewind_entry_t, capacity );
+  rewind_buffer.first = rewind_buffer.count = 0;
+  rewind_buffer.write_position = 0;
+
+  for( i = 0; i < pushes; i++ ) {
+    entry.length = 0;
+    for( j = 0; j < lengths[ i % length_count ]; j++ )
+      state_buffer_write_byte( &entry, i );
+    log_push( &entry );
+  }
+
+  while( !r && ( e = log_pop() ) ) {
+    i = pushes - 1 - popped++;
+    if( e->offset + e->length > arena_size ||
+        e->length != lengths[ i % length_count ] ) {
+      printf( "%s:%d: entry %lu has the wrong place or length\n", __FILE__,
+              __LINE__, (unsigned long)i );
+      r = 1;
+    }
+    for( j = 0; !r && j < e->length; j++ ) {
+      if( rewind_buffer.arena[ e->offset + j ] != (libspectrum_byte)i ) {
+        printf( "%s:%d: entry %lu was overwritten\n", __FILE__, __LINE__,
+                (unsigned long)i );
+        r = 1;
+      }
+    }
+  }
+
+  if( !r && popped != expected ) {
+    printf( "%s:%d: popped %lu entries, expected %lu\n", __FILE__, __LINE__,
+            (unsigned long)popped, (unsigned long)expected );
+    r = 1;
+  }
+
+  libspectrum_free( rewind_buffer.arena ); rewind_buffer.arena = NULL;
+  libspectrum_free( rewind_buffer.entries ); rewind_buffer.entries = NULL;
+  buffer_free( &entry );
+
+  return r;
+}
+
+int
+rewind_unittest( void )
+{
+  static const size_t short_entries[] = { 10 };
+  static const size_t long_entries[] = { 30 };
+  static const size_t mixed_entries[] = { 30, 45, 20, 7 };
+  static const size_t tail_entries[] = { 30, 30, 30, 30, 25, 50 };
+  state_buffer_t older, newer, entry;
+  size_t i, page0, page1;
+  int r = 0;
+
+  memset( &older, 0, sizeof( older ) );
+  memset( &newer, 0, sizeof( newer ) );
+  memset( &entry, 0, sizeof( entry ) );
+
+  for( i = 0; i < 1000; i++ ) state_buffer_write_byte( &older, i * 7 );
+  state_buffer_write( &newer, older.data, older.length );
+  newer.data[0] ^= 0x01;
+  newer.data[2] ^= 0x10;
+  for( i = 500; i < 600; i++ ) newer.data[i] = 0;
+  newer.data[999] ^= 0xff;
+
+  delta_encode( &entry, &older, &newer, NULL );
+  if( entry.length >= older.length / 4 ) {
+    printf( "%s:%d: delta of %lu bytes is too long\n", __FILE__, __LINE__,
+            (unsigned long)entry.length );
+    r = 1;
+  }
+
+  if( delta_decode( &newer, entry.data, entry.length ) ||
+      memcmp( newer.data, older.data, older.length ) ) {
+    printf( "%s:%d: delta didn't restore older state\n", __FILE__,
+            __LINE__ );
+    r = 1;
+  }
+
+  /* A state of a different length has to be stored in full */
+  newer.length = 10;
+  delta_encode( &entry, &older, &newer, NULL );
+  if( entry.data[0] != REWIND_ENTRY_KEY ||
+      delta_decode( &newer, entry.data, entry.length ) ||
+      newer.length != older.length ||
+      memcmp( newer.data, older.data, older.length ) ) {
+    printf( "%s:%d: key entry didn't restore older state\n", __FILE__,
+            __LINE__ );
+    r = 1;
+  }
+
+  /* Changes to RAM pages which haven't been written to aren't looked for,
+     so only the header and the dirty page are put back */
+  older.length = newer.length = 0;
+  for( i = 0; i < 16 + 2 * MEMORY_PAGE_SIZE; i++ )
+    state_buffer_write_byte( &older, i * 7 );
+  state_buffer_write( &newer, older.data, older.length );
+  newer.ram_offset = 16;
+  newer.ram_pages = 2;
+  page0 = newer.ram_offset + 10;
+  page1 = newer.ram_offset + MEMORY_PAGE_SIZE + 10;
+  newer.data[5] ^= 0xff;
+  newer.data[ page0 ] ^= 0xff;
+  newer.data[ page1 ] ^= 0xff;
+  memory_ram_dirty[0] = 0;
+  memory_ram_dirty[1] = 1;
+
+  delta_encode( &entry, &older, &newer, &newer );
+  memory_ram_dirty_all();
+
+  if( delta_decode( &newer, entry.data, entry.length ) ||
+      newer.data[5] != older.data[5] ||
+      newer.data[ page0 ] == older.data[ page0 ] ||
+      newer.data[ page1 ] != older.data[ page1 ] ) {
+    printf( "%s:%d: clean RAM page wasn't skipped\n", __FILE__, __LINE__ );
+    r = 1;
+  }
+
+  buffer_free( &older );
+  buffer_free( &newer );
+  buffer_free( &entry );
+
+  /* The log: running out of entries, wrapping around the arena, wrapping
+     with entries of different lengths, and wrapping when the oldest entry
+     is in the unused space at the end of the arena */
+  if( !rewind_buffer.arena ) {
+    r += unittest_log( 100, 4, short_entries, ARRAY_SIZE( short_entries ),
+                       10, 4 );
+    r += unittest_log( 100, 8, long_entries, ARRAY_SIZE( long_entries ),
+                       10, 3 );
+    r += unittest_log( 100, 8, mixed_entries, ARRAY_SIZE( mixed_entries ),
+                       20, 3 );
+    r += unittest_log( 100, 8, tail_entries, ARRAY_SIZE( tail_entries ),
+                       6, 1 );
+    rewind_buffer.count = 0;
+  }
+
+  return r;
+}
@@ -0,0 +1,38 @@
+/* rewind.h: run time backwards through recent frames
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_REWIND_H
+#define FUSE_REWIND_H
+
+void rewind_register_startup( void );
+
+/* Called at the end of every frame: either store the state of the
+   machine, or step back a frame if rewinding */
+void rewind_frame( void );
+
+/* Start or stop running backwards */
+void rewind_hold( int held );
+
+int rewind_unittest( void );
+
+#endif			/* #ifndef FUSE_REWIND_H */
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,6 +34,12 @@
 #include <windows.h>
 #endif				/* #ifdef WIN32 */
 
+#ifdef HAVE_ZLIB_H
+#define ZLIB_CONST
+#include <zlib.h>
+#endif				/* #ifdef HAVE_ZLIB_H */
+
+#include "compat.h"
 #include "debugger/debugger.h"
 #include "event.h"
 #include "fuse.h"
@@ -41,8 +48,10 @@
 #include "movie.h"
 #include "peripherals/ula.h"
 #include "rzx.h"
+#include "rzx_verify.h"
 #include "settings.h"
 #include "snapshot.h"
+#include "sound/render.h"
 #include "timer/timer.h"
 #include "ui/ui.h"
 #include "utils.h"
@@ -104,6 +113,77 @@ static const float SPEED_TOLERANCE = 5;
 /* How often will we create an autosave file */
 static const size_t AUTOSAVE_INTERVAL = 5 * 50;
 
+/* When streaming a recording to disk, how often do we write out the
+   input recording block, and how often do we add an autosave */
+static const size_t STREAM_FLUSH_INTERVAL = 5 * 50;
+static const size_t STREAM_AUTOSAVE_INTERVAL = 60 * 50;
+
+/* A recording being streamed to disk: everything up to the last complete
+   block is already in the file, so memory use doesn't grow with the
+   length of the recording and a crash loses at most the current block */
+static struct {
+  compat_fd fd;
+
+  libspectrum_byte *frames;	/* Frame data for the current IRB */
+  size_t length, allocated;
+  size_t frame_count;
+  libspectrum_dword tstates;	/* tstates at the start of the IRB */
+
+  size_t autosave_frame_count;
+} rzx_stream;
+
+/* Is the current recording being streamed to disk? */
+static int rzx_streaming;
+
+/* Did playback get to the end of the file? */
+static int playback_finished;
+
+/* How often, in frames, do we add keyframes during playback */
+static const size_t KEYFRAME_INTERVAL = 10 * 50;
+
+/* The most keyframes we keep during playback; beyond this, every other one
+   is thrown away and they are made half as often */
+static const size_t KEYFRAME_MAX = 64;
+
+/* A point from which playback can be restarted. Restarting means starting
+   libspectrum's playback from 'block', which puts it at 'block_frame',
+   skipping forward to 'frame' and then restoring 'snap'; for snapshots
+   embedded in the file, 'frame' is 'block_frame' and libspectrum gives us
+   the snapshot */
+typedef struct rzx_keyframe_t {
+  size_t frame;
+  int block;
+  size_t block_frame;
+  libspectrum_snap *snap;
+} rzx_keyframe_t;
+
+static struct {
+  GArray *embedded;		/* Keyframes for embedded snapshots */
+  rzx_keyframe_t *cached;	/* One slot per KEYFRAME_INTERVAL frames,
+				   filled as the file is played; 'snap' is
+				   NULL if we haven't got there yet or the
+				   slot isn't a multiple of 'cached_stride' */
+  size_t cached_count;
+  size_t cached_snaps;		/* Slots with a snapshot in */
+  size_t cached_stride;
+
+  /* The number of INs in each frame, or RZX_IN_COUNT_UNKNOWN for frames
+     we haven't played */
+  libspectrum_dword *in_counts;
+  size_t total_frames;
+
+  size_t frame;			/* The frame being played */
+  int block;			/* Where libspectrum's playback started */
+  size_t block_frame;
+  libspectrum_dword frame_in_count;	/* INs read so far in this frame */
+
+  int seek_pending;		/* Move to 'seek_target' at the next frame */
+  int seeking;			/* Running flat out until 'seek_target' */
+  size_t seek_target;
+} rzx_index;
+
+#define RZX_IN_COUNT_UNKNOWN 0xffffffff
+
 /* Debugger events */
 static const char * const event_type_string = "rzx";
 static const char * const end_event_detail_string = "end";
@@ -115,6 +195,14 @@ static void start_recording( libspectrum_rzx *to_rzx, int competition_mode );
 static int recording_frame( void );
 static int playback_frame( void );
 static int counter_reset( void );
+static int stream_start( const char *filename, int embed_snapshot );
+static int stream_add_snap( void );
+static int stream_store_frame( void );
+static int stream_stop( void );
+static void index_build( libspectrum_rzx *from_rzx );
+static void index_free( void );
+static void index_frame( void );
+static int index_seek( void );
 static void rzx_sentinel( libspectrum_dword ts, int type,
 			  void *user_data );
 
@@ -163,6 +251,16 @@ int rzx_start_recording( const char *filename, int embed_snapshot )
 
   if( rzx_playback ) return 1;
 
+  /* Competition mode recordings are signed, which needs the whole file */
+  if( settings_current.rzx_streaming && !settings_current.competition_mode ) {
+    error = stream_start( filename, embed_snapshot );
+    if( error ) return error;
+
+    rzx_streaming = 1;
+    start_recording( NULL, 0 );
+    return 0;
+  }
+
   rzx = libspectrum_rzx_alloc();
 
   /* Store the filename */
@@ -195,6 +293,19 @@ int rzx_stop_recording( void )
   rzx_recording = 0;
   if( settings_current.movie_stop_after_rzx ) movie_stop();
 
+  if( rzx_streaming ) {
+    rzx_streaming = 0;
+
+    libspectrum_free( rzx_in_bytes );
+    rzx_in_bytes = NULL;
+    rzx_in_allocated = 0;
+
+    ui_menu_activate( UI_MENU_ITEM_RECORDING, 0 );
+    ui_menu_activate( UI_MENU_ITEM_RECORDING_INSERT, 0 );
+
+    return stream_stop();
+  }
+
   /* Embed final snapshot */
   if( !rzx_competition_mode ) rzx_add_snap( rzx, 0 );
 
@@ -203,6 +314,7 @@ int rzx_stop_recording( void )
   rzx_in_allocated = 0;
 
   ui_menu_activate( UI_MENU_ITEM_RECORDING, 0 );
+  ui_menu_activate( UI_MENU_ITEM_RECORDING_INSERT, 0 );
   ui_menu_activate( UI_MENU_ITEM_RECORDING_ROLLBACK, 0 );
 
   libspectrum_creator_set_competition_code(
@@ -352,6 +464,9 @@ start_playback( libspectrum_rzx *from_rzx )
     if( error ) return error;
   }
 
+  index_build( from_rzx );
+  playback_finished = 0;
+
   /* End of frame will now be generated by the RZX code */
   event_remove_type( spectrum_frame_event );
 
@@ -365,7 +480,9 @@ start_playback( libspectrum_rzx *from_rzx )
   counter_reset();
 
   ui_menu_activate( UI_MENU_ITEM_RECORDING, 1 );
+  ui_menu_activate( UI_MENU_ITEM_RECORDING_INSERT, 0 );
   ui_menu_activate( UI_MENU_ITEM_RECORDING_ROLLBACK, 0 );
+  ui_menu_activate( UI_MENU_ITEM_RECORDING_SEEK, 1 );
 
   return 0;
 }
@@ -379,8 +496,18 @@ int rzx_stop_playback( int add_interrupt )
   rzx_playback = 0;
   if( settings_current.movie_stop_after_rzx ) movie_stop();
 
+  /* Rendering the sound from an RZX file stops when the file does */
+  if( sound_render_active ) fuse_exiting = 1;
+
+  if( rzx_verify_worker() )
+    rzx_verify_end( playback_finished, rzx_index.frame );
+
   ui_menu_activate( UI_MENU_ITEM_RECORDING, 0 );
+  ui_menu_activate( UI_MENU_ITEM_RECORDING_INSERT, 0 );
   ui_menu_activate( UI_MENU_ITEM_RECORDING_ROLLBACK, 0 );
+  ui_menu_activate( UI_MENU_ITEM_RECORDING_SEEK, 0 );
+
+  index_free();
 
   event_remove_type( sentinel_event );
 
@@ -417,7 +544,7 @@ int rzx_stop_playback( int add_interrupt )
 static void
 start_recording( libspectrum_rzx *to_rzx, int competition_mode )
 {
-  libspectrum_rzx_start_input( to_rzx, tstates );
+  if( to_rzx ) libspectrum_rzx_start_input( to_rzx, tstates );
 
   counter_reset();
   rzx_in_count = 0;
@@ -438,12 +565,40 @@ start_recording( libspectrum_rzx *to_rzx, int competition_mode )
 
   } else {
 
-    ui_menu_activate( UI_MENU_ITEM_RECORDING_ROLLBACK, 1 );
+    /* Snapshots can be inserted into either kind of recording, but
+       rolling back needs the recording to be in memory */
+    ui_menu_activate( UI_MENU_ITEM_RECORDING_INSERT, 1 );
+    if( !rzx_streaming ) ui_menu_activate( UI_MENU_ITEM_RECORDING_ROLLBACK, 1 );
     rzx_competition_mode = 0;
 
   }
 }
 
+/* Add a snapshot to the recording being made */
+int
+rzx_insert_snapshot( void )
+{
+  libspectrum_snap *snap;
+  int error;
+
+  if( !rzx_recording ) return 1;
+
+  if( rzx_streaming ) return stream_add_snap();
+
+  libspectrum_rzx_stop_input( rzx );
+
+  snap = libspectrum_snap_alloc();
+
+  error = snapshot_copy_to( snap );
+  if( error ) { libspectrum_snap_free( snap ); return error; }
+
+  libspectrum_rzx_add_snap( rzx, snap, 0 );
+
+  libspectrum_rzx_start_input( rzx, tstates );
+
+  return 0;
+}
+
 int
 rzx_continue_recording( const char *filename )
 {
@@ -655,8 +810,12 @@ static int recording_frame( void )
 {
   libspectrum_error error;
 
-  error = libspectrum_rzx_store_frame( rzx, R + rzx_instructions_offset,
-				       rzx_in_count, rzx_in_bytes );
+  if( rzx_streaming ) {
+    error = stream_store_frame();
+  } else {
+    error = libspectrum_rzx_store_frame( rzx, R + rzx_instructions_offset,
+                                         rzx_in_count, rzx_in_bytes );
+  }
   if( error ) {
     rzx_stop_recording();
     return error;
@@ -680,7 +839,8 @@ static int recording_frame( void )
 
   }
 
-  if( !rzx_competition_mode && settings_current.rzx_autosaves )
+  if( !rzx_competition_mode && !rzx_streaming &&
+      settings_current.rzx_autosaves )
     autosave_frame();
 
   return 0;
@@ -695,6 +855,7 @@ static int playback_frame( void )
   if( error ) return rzx_stop_playback( 0 );
 
   if( finished ) {
+    playback_finished = 1;
     ui_error( UI_ERROR_INFO, "Finished RZX playback" );
     return rzx_stop_playback( 0 );
   }
@@ -710,6 +871,13 @@ static int playback_frame( void )
     if( error ) return rzx_stop_playback( 0 );
   }
 
+  index_frame();
+
+  if( rzx_index.seek_pending ) {
+    error = index_seek();
+    if( error ) return rzx_stop_playback( 0 );
+  }
+
   /* If we've got another frame to do, fetch the new instruction count and
      continue */
   rzx_instruction_count = libspectrum_rzx_instructions( rzx );
@@ -748,6 +916,482 @@ int rzx_store_byte( libspectrum_byte value )
   return 0;
 }
 
+static int
+stream_write_block( libspectrum_byte id, const libspectrum_byte *header,
+                    size_t header_length, const libspectrum_byte *data,
+                    size_t data_length )
+{
+  libspectrum_byte block[5], *ptr = block;
+
+  *ptr++ = id;
+  libspectrum_write_dword( &ptr, 5 + header_length + data_length );
+
+  if( compat_file_write( rzx_stream.fd, block, 5 ) ||
+      compat_file_write( rzx_stream.fd, header, header_length ) ||
+      ( data_length &&
+        compat_file_write( rzx_stream.fd, data, data_length ) ) )
+    return 1;
+
+  /* Make sure each block is complete on disk before carrying on */
+  return compat_file_flush( rzx_stream.fd );
+}
+
+static int
+stream_write_creator( void )
+{
+  libspectrum_byte header[24], *ptr = header;
+  const char *program = libspectrum_creator_program( fuse_creator );
+
+  memset( header, 0, 20 );
+  strncpy( (char*)header, program, 19 );
+  ptr += 20;
+  libspectrum_write_word( &ptr, libspectrum_creator_major( fuse_creator ) );
+  libspectrum_write_word( &ptr, libspectrum_creator_minor( fuse_creator ) );
+
+  return stream_write_block( 0x10, header, sizeof( header ),
+                             libspectrum_creator_custom( fuse_creator ),
+                             libspectrum_creator_custom_length( fuse_creator ) );
+}
+
+static int
+stream_start( const char *filename, int embed_snapshot )
+{
+  static const libspectrum_byte signature[] = {
+    'R', 'Z', 'X', '!', 0, 13, 0, 0, 0, 0
+  };
+
+  rzx_stream.fd = compat_file_open( filename, 1 );
+  if( rzx_stream.fd == COMPAT_FILE_OPEN_FAILED ) {
+    ui_error( UI_ERROR_ERROR, "couldn't open '%s' for writing", filename );
+    return 1;
+  }
+
+  rzx_stream.frames = NULL;
+  rzx_stream.length = rzx_stream.allocated = 0;
+  rzx_stream.frame_count = 0;
+  rzx_stream.tstates = tstates;
+  rzx_stream.autosave_frame_count = 0;
+
+  if( compat_file_write( rzx_stream.fd, signature, sizeof( signature ) ) ||
+      stream_write_creator() ||
+      ( embed_snapshot && stream_add_snap() ) ) {
+    ui_error( UI_ERROR_ERROR, "couldn't write to '%s'", filename );
+    compat_file_close( rzx_stream.fd );
+    remove( filename );
+    libspectrum_free( rzx_stream.frames );
+    rzx_stream.frames = NULL;
+    rzx_stream.allocated = 0;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Write out the frames recorded since the last input recording block */
+static int
+stream_flush_frames( void )
+{
+  libspectrum_byte header[13], *ptr = header;
+  libspectrum_byte *data = rzx_stream.frames;
+  size_t length = rzx_stream.length;
+  libspectrum_dword flags = 0;
+  int error;
+
+  if( !rzx_stream.frame_count ) return 0;
+
+#ifdef HAVE_ZLIB_H
+  if( settings_current.rzx_compression ) {
+    uLongf compressed_length = compressBound( length );
+    libspectrum_byte *compressed =
+      libspectrum_new( libspectrum_byte, compressed_length );
+
+    if( compress( compressed, &compressed_length, data, length ) == Z_OK ) {
+      data = compressed; length = compressed_length;
+      flags |= 0x02;
+    } else {
+      libspectrum_free( compressed );
+    }
+  }
+#endif				/* #ifdef HAVE_ZLIB_H */
+
+  libspectrum_write_dword( &ptr, rzx_stream.frame_count );
+  *ptr++ = 0;
+  libspectrum_write_dword( &ptr, rzx_stream.tstates );
+  libspectrum_write_dword( &ptr, flags );
+
+  error = stream_write_block( 0x80, header, sizeof( header ), data, length );
+
+  if( data != rzx_stream.frames ) libspectrum_free( data );
+
+  rzx_stream.length = 0;
+  rzx_stream.frame_count = 0;
+  rzx_stream.tstates = tstates;
+
+  return error;
+}
+
+static int
+stream_add_snap( void )
+{
+  libspectrum_byte header[12], *ptr = header;
+  libspectrum_byte *buffer = NULL;
+  size_t length = 0;
+  libspectrum_snap *snap;
+  int flags, error;
+
+  error = stream_flush_frames(); if( error ) return error;
+
+  snap = libspectrum_snap_alloc();
+
+  error = snapshot_copy_to( snap );
+  if( !error )
+    error = libspectrum_snap_write( &buffer, &length, &flags, snap,
+                                    LIBSPECTRUM_ID_SNAPSHOT_SZX, fuse_creator,
+                                    0 );
+  libspectrum_snap_free( snap );
+  if( error ) return error;
+
+  libspectrum_write_dword( &ptr, 0 );
+  memcpy( ptr, "szx", 4 ); ptr += 4;
+  libspectrum_write_dword( &ptr, length );
+
+  error = stream_write_block( 0x30, header, sizeof( header ), buffer, length );
+
+  libspectrum_free( buffer );
+
+  rzx_stream.tstates = tstates;
+
+  return error;
+}
+
+static int
+stream_store_frame( void )
+{
+  size_t needed = 4 + rzx_in_count, new_allocated;
+  libspectrum_byte *ptr;
+
+  if( rzx_stream.length + needed > rzx_stream.allocated ) {
+    new_allocated = rzx_stream.allocated ? 2 * rzx_stream.allocated : 4096;
+    while( new_allocated < rzx_stream.length + needed ) new_allocated *= 2;
+    rzx_stream.frames = libspectrum_renew( libspectrum_byte,
+                                           rzx_stream.frames, new_allocated );
+    rzx_stream.allocated = new_allocated;
+  }
+
+  ptr = rzx_stream.frames + rzx_stream.length;
+  libspectrum_write_word( &ptr, R + rzx_instructions_offset );
+  libspectrum_write_word( &ptr, rzx_in_count );
+  memcpy( ptr, rzx_in_bytes, rzx_in_count );
+
+  rzx_stream.length += needed;
+  rzx_stream.frame_count++;
+
+  if( settings_current.rzx_autosaves &&
+      ++rzx_stream.autosave_frame_count == STREAM_AUTOSAVE_INTERVAL ) {
+    rzx_stream.autosave_frame_count = 0;
+    return stream_add_snap();
+  }
+
+  if( rzx_stream.frame_count >= STREAM_FLUSH_INTERVAL )
+    return stream_flush_frames();
+
+  return 0;
+}
+
+static int
+stream_stop( void )
+{
+  int error;
+
+  /* Write out any remaining frames and the final snapshot */
+  error = stream_add_snap();
+
+  if( compat_file_close( rzx_stream.fd ) ) error = 1;
+
+  libspectrum_free( rzx_stream.frames );
+  rzx_stream.frames = NULL;
+  rzx_stream.allocated = 0;
+
+  return error;
+}
+
+/* Get a byte read via IN from the RZX file being played back */
+int
+rzx_playback_byte( libspectrum_byte *value )
+{
+  libspectrum_error error;
+
+  error = libspectrum_rzx_playback( rzx, value );
+  if( error ) return error;
+
+  rzx_index.frame_in_count++;
+
+  return 0;
+}
+
+/* Find the snapshots in the file, which are where we can restart
+   playback from */
+static void
+index_build( libspectrum_rzx *from_rzx )
+{
+  libspectrum_rzx_iterator it;
+  rzx_keyframe_t keyframe;
+  size_t frames = 0, i;
+  int inputs = 0;
+
+  rzx_index.embedded = g_array_new( FALSE, FALSE, sizeof( rzx_keyframe_t ) );
+
+  /* libspectrum starts playback from the n'th input recording block,
+     giving us the snapshot immediately before it */
+  for( it = libspectrum_rzx_iterator_begin( from_rzx );
+       it;
+       it = libspectrum_rzx_iterator_next( it ) ) {
+
+    libspectrum_rzx_block_id id = libspectrum_rzx_iterator_get_type( it );
+
+    switch( id ) {
+
+    case LIBSPECTRUM_RZX_INPUT_BLOCK:
+      frames += libspectrum_rzx_iterator_get_frames( it );
+      inputs++;
+      break;
+
+    case LIBSPECTRUM_RZX_SNAPSHOT_BLOCK:
+      keyframe.frame = keyframe.block_frame = frames;
+      keyframe.block = inputs;
+      keyframe.snap = NULL;
+      g_array_append_val( rzx_index.embedded, keyframe );
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  rzx_index.total_frames = frames;
+  rzx_index.in_counts = libspectrum_new( libspectrum_dword, frames + 1 );
+  for( i = 0; i <= frames; i++ )
+    rzx_index.in_counts[i] = RZX_IN_COUNT_UNKNOWN;
+
+  rzx_index.cached_count = frames / KEYFRAME_INTERVAL + 1;
+  rzx_index.cached = libspectrum_new0( rzx_keyframe_t,
+                                       rzx_index.cached_count );
+  rzx_index.cached_snaps = 0;
+  rzx_index.cached_stride = 1;
+
+  rzx_index.frame = rzx_index.block_frame = 0;
+  rzx_index.block = 0;
+  rzx_index.frame_in_count = 0;
+  rzx_index.seek_pending = rzx_index.seeking = 0;
+
+  /* Always keep the starting point so we can get back to it even if the
+     file doesn't begin with a snapshot */
+  keyframe.snap = libspectrum_snap_alloc();
+  if( snapshot_copy_to( keyframe.snap ) ) {
+    libspectrum_snap_free( keyframe.snap );
+    return;
+  }
+  keyframe.frame = keyframe.block_frame = 0;
+  keyframe.block = 0;
+  rzx_index.cached[0] = keyframe;
+  rzx_index.cached_snaps = 1;
+}
+
+static void
+index_free( void )
+{
+  size_t i;
+
+  if( rzx_index.embedded ) {
+    g_array_free( rzx_index.embedded, TRUE );
+    rzx_index.embedded = NULL;
+  }
+
+  for( i = 0; i < rzx_index.cached_count; i++ )
+    if( rzx_index.cached[i].snap )
+      libspectrum_snap_free( rzx_index.cached[i].snap );
+  libspectrum_free( rzx_index.cached ); rzx_index.cached = NULL;
+  rzx_index.cached_count = rzx_index.cached_snaps = 0;
+
+  libspectrum_free( rzx_index.in_counts ); rzx_index.in_counts = NULL;
+  rzx_index.total_frames = 0;
+
+  rzx_index.seek_pending = rzx_index.seeking = 0;
+}
+
+/* Keep memory use bounded on long recordings by dropping every other
+   cached keyframe; slot 0, the start of the file, is always kept */
+static void
+index_thin( void )
+{
+  size_t i;
+
+  rzx_index.cached_stride *= 2;
+
+  for( i = 1; i < rzx_index.cached_count; i++ ) {
+    if( !rzx_index.cached[i].snap || !( i % rzx_index.cached_stride ) )
+      continue;
+    libspectrum_snap_free( rzx_index.cached[i].snap );
+    rzx_index.cached[i].snap = NULL;
+    rzx_index.cached_snaps--;
+  }
+}
+
+/* Called at the end of every frame played back */
+static void
+index_frame( void )
+{
+  rzx_keyframe_t *keyframe;
+  libspectrum_snap *snap;
+  size_t slot;
+
+  if( rzx_index.frame < rzx_index.total_frames )
+    rzx_index.in_counts[ rzx_index.frame ] = rzx_index.frame_in_count;
+  rzx_index.frame_in_count = 0;
+  rzx_index.frame++;
+
+  if( rzx_index.seeking && rzx_index.frame >= rzx_index.seek_target )
+    rzx_index.seeking = 0;
+
+  /* Take a snapshot every so often so we can come back here quickly */
+  if( !settings_current.rzx_keyframes ||
+      rzx_index.frame % KEYFRAME_INTERVAL )
+    return;
+
+  slot = rzx_index.frame / KEYFRAME_INTERVAL;
+  if( slot >= rzx_index.cached_count || slot % rzx_index.cached_stride )
+    return;
+
+  keyframe = &rzx_index.cached[ slot ];
+  if( keyframe->snap ) return;
+
+  snap = libspectrum_snap_alloc();
+  if( snapshot_copy_to( snap ) ) {
+    libspectrum_snap_free( snap );
+    return;
+  }
+
+  keyframe->frame = rzx_index.frame;
+  keyframe->block = rzx_index.block;
+  keyframe->block_frame = rzx_index.block_frame;
+  keyframe->snap = snap;
+
+  if( ++rzx_index.cached_snaps > KEYFRAME_MAX ) index_thin();
+}
+
+/* Find the last keyframe at or before 'frame' */
+static const rzx_keyframe_t*
+index_find_keyframe( size_t frame )
+{
+  const rzx_keyframe_t *best = NULL, *keyframe;
+  size_t i;
+
+  for( i = 0; i < rzx_index.embedded->len; i++ ) {
+    keyframe = &g_array_index( rzx_index.embedded, rzx_keyframe_t, i );
+    if( keyframe->frame > frame ) break;
+    best = keyframe;
+  }
+
+  for( i = frame / KEYFRAME_INTERVAL + 1; i > 0; i-- ) {
+    keyframe = &rzx_index.cached[ i - 1 ];
+    if( !keyframe->snap ) continue;
+    if( !best || keyframe->frame > best->frame ) best = keyframe;
+    break;
+  }
+
+  return best;
+}
+
+/* Move playback to the frame requested by rzx_seek(). Called at the end
+   of a frame, which is where all keyframes were taken */
+static int
+index_seek( void )
+{
+  const rzx_keyframe_t *keyframe;
+  libspectrum_snap *snap;
+  libspectrum_byte value;
+  libspectrum_dword count;
+  size_t frame;
+  int error, finished;
+
+  rzx_index.seek_pending = 0;
+
+  keyframe = index_find_keyframe( rzx_index.seek_target );
+
+  /* If carrying on from here is at least as good, do that */
+  if( !keyframe || ( rzx_index.frame <= rzx_index.seek_target &&
+                     rzx_index.frame >= keyframe->frame ) ) {
+    rzx_index.seeking = rzx_index.frame < rzx_index.seek_target;
+    return 0;
+  }
+
+  error = libspectrum_rzx_start_playback( rzx, keyframe->block, &snap );
+  if( error ) return error;
+
+  /* Skip forward to the keyframe by feeding libspectrum the right number
+     of INs for each frame. We only make keyframes after playing all the
+     frames back to where libspectrum's playback started, so we know these
+     counts */
+  for( frame = keyframe->block_frame; frame < keyframe->frame; frame++ ) {
+    libspectrum_snap *skipped_snap;
+
+    for( count = rzx_index.in_counts[ frame ]; count; count-- ) {
+      error = libspectrum_rzx_playback( rzx, &value );
+      if( error ) return error;
+    }
+
+    error = libspectrum_rzx_playback_frame( rzx, &finished, &skipped_snap );
+    if( error ) return error;
+    if( finished ) return 1;
+  }
+
+  if( keyframe->snap ) snap = keyframe->snap;
+  if( snap ) {
+    error = snapshot_copy_from( snap );
+    if( error ) return error;
+  }
+
+  rzx_index.frame = keyframe->frame;
+  rzx_index.block = keyframe->block;
+  rzx_index.block_frame = keyframe->block_frame;
+  rzx_index.frame_in_count = 0;
+
+  rzx_index.seeking = rzx_index.frame < rzx_index.seek_target;
+
+  return 0;
+}
+
+/* Move RZX playback to the given frame. This happens at the end of the
+   current frame: playback restarts from the nearest keyframe and then runs
+   as fast as possible until it gets to 'frame' */
+int
+rzx_seek( size_t frame )
+{
+  if( !rzx_playback ) return 1;
+
+  if( frame >= rzx_index.total_frames )
+    frame = rzx_index.total_frames ? rzx_index.total_frames - 1 : 0;
+
+  rzx_index.seek_target = frame;
+  rzx_index.seek_pending = 1;
+
+  return 0;
+}
+
+/* The number of the frame being played back */
+size_t
+rzx_playback_position( void )
+{
+  return rzx_index.frame;
+}
+
+/* Are we running flat out to get to a frame requested by rzx_seek()? */
+int
+rzx_seeking( void )
+{
+  return rzx_playback && ( rzx_index.seeking || rzx_index.seek_pending );
+}
+
 static void
 rzx_end( void )
 {
@@ -833,6 +1477,8 @@ rzx_rollback( void )
   libspectrum_snap *snap;
   int error;
 
+  if( rzx_streaming ) return 1;
+
   error = libspectrum_rzx_rollback( rzx, &snap );
   if( error ) return error;
 
@@ -849,6 +1495,8 @@ rzx_rollback_to( void )
   libspectrum_snap *snap;
   int which, error;
 
+  if( rzx_streaming ) return 1;
+
   rollback_points = get_rollback_list( rzx );
 
   which = ui_get_rollback_point( rollback_points );
@@ -882,3 +1530,126 @@ rzx_sentinel( libspectrum_dword ts GCC_UNUSED, int type GCC_UNUSED,
      this */
   event_add( RZX_SENTINEL_TIME, sentinel_event );
 }
+
+/* Stream a short recording to disk and check libspectrum reads back the
+   frames we wrote */
+int
+rzx_unittest( void )
+{
+  static const libspectrum_byte in_bytes[] = { 0xbf, 0xff, 0x1f };
+  char filename[ PATH_MAX ];
+  libspectrum_rzx *test_rzx;
+  libspectrum_rzx_iterator it;
+  libspectrum_snap *snap;
+  libspectrum_byte value;
+  utils_file file;
+  size_t i, j, frames = 0, snaps = 0;
+  int finished = 0, r = 0;
+
+  snprintf( filename, PATH_MAX, "%s" FUSE_DIR_SEP_STR "fuse-rzx-test.rzx",
+            compat_get_temp_path() );
+
+  if( stream_start( filename, 0 ) ) {
+    printf( "%s:%d: couldn't start stream\n", __FILE__, __LINE__ );
+    return 1;
+  }
+
+  /* Frame i has 100 * ( i + 1 ) instructions and the first i + 1 bytes
+     of in_bytes */
+  for( i = 0; i < 3; i++ ) {
+    counter_reset();
+    rzx_instructions_offset += 100 * ( i + 1 );
+    rzx_in_count = 0;
+    for( j = 0; j <= i; j++ ) rzx_store_byte( in_bytes[j] );
+    if( stream_store_frame() ) r = 1;
+  }
+  rzx_in_count = 0;
+
+  if( stream_stop() ) r = 1;
+  if( r ) {
+    printf( "%s:%d: couldn't write stream\n", __FILE__, __LINE__ );
+    remove( filename );
+    return r;
+  }
+
+  if( utils_read_file( filename, &file ) ) {
+    printf( "%s:%d: couldn't read stream\n", __FILE__, __LINE__ );
+    remove( filename );
+    return 1;
+  }
+
+  test_rzx = libspectrum_rzx_alloc();
+
+  if( libspectrum_rzx_read( test_rzx, file.buffer, file.length ) ) {
+    printf( "%s:%d: libspectrum couldn't read stream\n", __FILE__,
+            __LINE__ );
+    r = 1;
+    goto end;
+  }
+
+  for( it = libspectrum_rzx_iterator_begin( test_rzx );
+       it;
+       it = libspectrum_rzx_iterator_next( it ) ) {
+    switch( libspectrum_rzx_iterator_get_type( it ) ) {
+    case LIBSPECTRUM_RZX_INPUT_BLOCK:
+      frames += libspectrum_rzx_iterator_get_frames( it ); break;
+    case LIBSPECTRUM_RZX_SNAPSHOT_BLOCK:
+      snaps++; break;
+    default:
+      break;
+    }
+  }
+
+  if( frames != 3 || snaps != 1 ) {
+    printf( "%s:%d: got %lu frames and %lu snapshots, expected 3 and 1\n",
+            __FILE__, __LINE__, (unsigned long)frames, (unsigned long)snaps );
+    r = 1;
+    goto end;
+  }
+
+  if( libspectrum_rzx_start_playback( test_rzx, 0, &snap ) ) {
+    printf( "%s:%d: couldn't start playback\n", __FILE__, __LINE__ );
+    r = 1;
+    goto end;
+  }
+
+  for( i = 0; i < 3 && !finished; i++ ) {
+    if( libspectrum_rzx_instructions( test_rzx ) != 100 * ( i + 1 ) ) {
+      printf( "%s:%d: frame %lu has %lu instructions, expected %lu\n",
+              __FILE__, __LINE__, (unsigned long)i,
+              (unsigned long)libspectrum_rzx_instructions( test_rzx ),
+              (unsigned long)( 100 * ( i + 1 ) ) );
+      r = 1;
+    }
+
+    for( j = 0; j <= i; j++ ) {
+      if( libspectrum_rzx_playback( test_rzx, &value ) ||
+          value != in_bytes[j] ) {
+        printf( "%s:%d: frame %lu byte %lu is wrong\n", __FILE__, __LINE__,
+                (unsigned long)i, (unsigned long)j );
+        r = 1;
+        break;
+      }
+    }
+
+    if( libspectrum_rzx_playback_frame( test_rzx, &finished, &snap ) ) {
+      printf( "%s:%d: couldn't play frame %lu\n", __FILE__, __LINE__,
+              (unsigned long)i );
+      r = 1;
+      break;
+    }
+  }
+
+  if( !r && ( i != 3 || !finished ) ) {
+    printf( "%s:%d: playback finished after %lu frames, expected 3\n",
+            __FILE__, __LINE__, (unsigned long)i );
+    r = 1;
+  }
+
+ end:
+  libspectrum_rzx_free( test_rzx );
+  utils_close_file( &file );
+  remove( filename );
+
+  return r;
+}
@@ -59,6 +59,7 @@ int rzx_start_recording( const char *filename, int embed_snapshot );
 int rzx_stop_recording( void );
 int rzx_continue_recording( const char *filename );
 int rzx_finalise_recording( const char *filename );
+int rzx_insert_snapshot( void );
 
 int rzx_start_playback( const char *filename, int check_snapshot );
 int
@@ -66,6 +67,12 @@ rzx_start_playback_from_buffer( const unsigned char *buffer, size_t length );
 
 int rzx_stop_playback( int add_interrupt );
 
+int rzx_playback_byte( libspectrum_byte *value );
+
+int rzx_seek( size_t frame );
+size_t rzx_playback_position( void );
+int rzx_seeking( void );
+
 int rzx_frame( void );
 
 int rzx_store_byte( libspectrum_byte value );
@@ -74,4 +81,6 @@ int rzx_rollback( void );
 
 int rzx_rollback_to( void );
 
+int rzx_unittest( void );
+
 #endif			/* #ifndef FUSE_RZX_H */
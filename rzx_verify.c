@@ -0,0 +1,360 @@
+/* rzx_verify.c: batch verification of RZX files
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+/* Each file is played back in its own process, forked from a controlling
+   process before any of the emulator is initialised. A worker writes a
+   single JSON object describing its file down a pipe and exits; the
+   controller collects these and prints them as a JSON array once every
+   file has been checked */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif				/* #ifdef HAVE_FORK */
+
+#include <libspectrum.h>
+
+#include "compat.h"
+#include "debugger/debugger.h"
+#include "rzx_verify.h"
+#include "settings.h"
+#include "snapshot.h"
+#include "ui/ui.h"
+#include "utils.h"
+
+/* Space for one worker's result */
+#define RESULT_LENGTH 1024
+
+typedef struct verify_job_t {
+  const char *filename;
+#ifdef HAVE_FORK
+  pid_t pid;
+#endif				/* #ifdef HAVE_FORK */
+  int fd;
+  int exit_code;
+  char result[ RESULT_LENGTH ];
+  size_t result_length;
+} verify_job_t;
+
+/* Non-zero if we're a worker */
+static int worker;
+
+/* The worker's file, where to write its result and when it started */
+static const char *worker_filename;
+static int worker_fd = -1;
+static double worker_start_time;
+
+static int exit_code;
+
+/* Write 'string' to 'out' as a JSON string */
+static void
+json_string( char *out, size_t length, const char *string )
+{
+  size_t i = 0;
+
+  if( length < 3 ) { if( length ) *out = '\0'; return; }
+
+  out[ i++ ] = '"';
+
+  for( ; *string && i < length - 8; string++ ) {
+    unsigned char c = *string;
+
+    if( c == '"' || c == '\\' ) {
+      out[ i++ ] = '\\'; out[ i++ ] = c;
+    } else if( c < 0x20 ) {
+      i += snprintf( out + i, length - i, "\\u%04x", c );
+    } else {
+      out[ i++ ] = c;
+    }
+  }
+
+  out[ i++ ] = '"';
+  out[ i ] = '\0';
+}
+
+/* A 64-bit FNV-1a hash of the machine state, taken from an uncompressed
+   SZX snapshot written without creator information so that it doesn't
+   depend on the host or the version of Fuse */
+static int
+state_hash( libspectrum_qword *hash )
+{
+  libspectrum_snap *snap;
+  libspectrum_byte *buffer = NULL;
+  size_t length = 0, i;
+  int flags, error;
+
+  snap = libspectrum_snap_alloc();
+
+  error = snapshot_copy_to( snap );
+  if( !error )
+    error = libspectrum_snap_write( &buffer, &length, &flags, snap,
+                                    LIBSPECTRUM_ID_SNAPSHOT_SZX, NULL,
+                                    LIBSPECTRUM_FLAG_SNAPSHOT_NO_COMPRESSION );
+  libspectrum_snap_free( snap );
+  if( error ) return error;
+
+  *hash = 0xcbf29ce484222325ULL;
+  for( i = 0; i < length; i++ ) {
+    *hash ^= buffer[i];
+    *hash *= 0x100000001b3ULL;
+  }
+
+  libspectrum_free( buffer );
+
+  return 0;
+}
+
+void
+rzx_verify_end( int completed, size_t frames )
+{
+  char filename[ RESULT_LENGTH / 2 ], result[ RESULT_LENGTH ], hash_text[ 17 ];
+  libspectrum_qword hash;
+  double seconds;
+  int length;
+
+  if( !worker || worker_fd == -1 ) return;
+
+  seconds = compat_timer_get_time() - worker_start_time;
+
+  if( state_hash( &hash ) ) {
+    strcpy( hash_text, "" );
+  } else {
+    snprintf( hash_text, sizeof( hash_text ), "%08lx%08lx",
+              (unsigned long)( hash >> 32 ),
+              (unsigned long)( hash & 0xffffffff ) );
+  }
+
+  json_string( filename, sizeof( filename ), worker_filename );
+
+  length = snprintf( result, sizeof( result ),
+                     "{ \"file\": %s, \"status\": \"%s\", \"frames\": %lu, "
+                     "\"seconds\": %.3f, \"hash\": \"%s\" }",
+                     filename, completed ? "ok" : "desync",
+                     (unsigned long)frames, seconds, hash_text );
+  if( length > 0 && (size_t)length < sizeof( result ) ) {
+#ifdef HAVE_FORK
+    if( write( worker_fd, result, length ) != length )
+      ui_error( UI_ERROR_ERROR, "error writing verification result: %s",
+                strerror( errno ) );
+    close( worker_fd );
+#endif				/* #ifdef HAVE_FORK */
+  }
+  worker_fd = -1;
+
+  debugger_exit_emulator_with_code( completed ? 0 : 1 );
+}
+
+int
+rzx_verify_worker( void )
+{
+  return worker;
+}
+
+int
+rzx_verify_exit_code( void )
+{
+  return exit_code;
+}
+
+#ifdef HAVE_FORK
+
+/* Set up this process to play back 'job' */
+static void
+worker_init( verify_job_t *job )
+{
+  worker = 1;
+  worker_filename = job->filename;
+  worker_fd = job->fd;
+  worker_start_time = compat_timer_get_time();
+
+  libspectrum_free( settings_current.playback_file );
+  settings_current.playback_file = utils_safe_strdup( job->filename );
+
+  /* Run headless and as fast as possible, and leave the user's
+     configuration alone */
+  settings_current.sound = 0;
+  settings_current.unthrottled = 1;
+  settings_current.rzx_keyframes = 0;
+  settings_current.autosave_settings = 0;
+}
+
+/* The result for a file we couldn't play back at all */
+static void
+job_error_result( verify_job_t *job )
+{
+  char filename[ RESULT_LENGTH / 2 ];
+
+  json_string( filename, sizeof( filename ), job->filename );
+  snprintf( job->result, RESULT_LENGTH,
+            "{ \"file\": %s, \"status\": \"error\", \"exit_code\": %d }",
+            filename, job->exit_code );
+}
+
+static int
+job_start( verify_job_t *job )
+{
+  int fds[2];
+
+  if( pipe( fds ) ) {
+    ui_error( UI_ERROR_ERROR, "couldn't create pipe: %s", strerror( errno ) );
+    return 1;
+  }
+
+  /* Make sure nothing buffered gets written twice */
+  fflush( stdout ); fflush( stderr );
+
+  job->pid = fork();
+  if( job->pid == -1 ) {
+    ui_error( UI_ERROR_ERROR, "couldn't start worker: %s", strerror( errno ) );
+    close( fds[0] ); close( fds[1] );
+    return 1;
+  }
+
+  if( !job->pid ) {
+    close( fds[0] );
+    job->fd = fds[1];
+    worker_init( job );
+    return 0;
+  }
+
+  close( fds[1] );
+  job->fd = fds[0];
+
+  return 0;
+}
+
+/* Collect the result from a finished worker */
+static void
+job_finish( verify_job_t *job, int status )
+{
+  ssize_t bytes;
+
+  while( job->result_length < RESULT_LENGTH - 1 ) {
+    bytes = read( job->fd, job->result + job->result_length,
+                  RESULT_LENGTH - 1 - job->result_length );
+    if( bytes <= 0 ) break;
+    job->result_length += bytes;
+  }
+  job->result[ job->result_length ] = '\0';
+  close( job->fd ); job->fd = -1;
+
+  job->exit_code = WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+
+  /* If the worker couldn't even start playback, report that */
+  if( !job->result_length ) job_error_result( job );
+
+  if( job->exit_code ) exit_code = 1;
+}
+
+int
+rzx_verify_start( int argc, char **argv, int first_arg )
+{
+  verify_job_t *jobs;
+  size_t count, next = 0, running = 0, i;
+  int max_jobs = settings_current.rzx_verify_jobs, status;
+  pid_t pid;
+
+  if( first_arg >= argc ) {
+    ui_error( UI_ERROR_ERROR, "no RZX files to verify" );
+    return 1;
+  }
+
+  if( max_jobs < 1 ) max_jobs = 1;
+
+  count = argc - first_arg;
+  jobs = libspectrum_new0( verify_job_t, count );
+  for( i = 0; i < count; i++ ) {
+    jobs[i].filename = argv[ first_arg + i ];
+    jobs[i].fd = -1;
+  }
+
+  while( next < count || running ) {
+
+    while( next < count && running < (size_t)max_jobs ) {
+      verify_job_t *job = &jobs[ next++ ];
+
+      if( job_start( job ) ) {
+        job->exit_code = -1;
+        job_error_result( job );
+        exit_code = 1;
+        continue;
+      }
+
+      /* The worker carries on with its copy of the job; the other jobs
+         aren't its concern */
+      if( worker ) {
+        libspectrum_free( jobs );
+        return 0;
+      }
+
+      running++;
+    }
+
+    if( !running ) break;
+
+    pid = wait( &status );
+    if( pid == -1 ) {
+      if( errno == EINTR ) continue;
+      ui_error( UI_ERROR_ERROR, "error waiting for worker: %s",
+                strerror( errno ) );
+      libspectrum_free( jobs );
+      return 1;
+    }
+
+    for( i = 0; i < next; i++ ) {
+      if( jobs[i].fd != -1 && jobs[i].pid == pid ) {
+        job_finish( &jobs[i], status );
+        running--;
+        break;
+      }
+    }
+  }
+
+  printf( "[\n" );
+  for( i = 0; i < count; i++ )
+    printf( "  %s%s\n", jobs[i].result, i + 1 < count ? "," : "" );
+  printf( "]\n" );
+
+  libspectrum_free( jobs );
+
+  return 0;
+}
+
+#else				/* #ifdef HAVE_FORK */
+
+int
+rzx_verify_start( int argc, char **argv, int first_arg )
+{
+  ui_error( UI_ERROR_ERROR,
+            "RZX verification is not supported on this platform" );
+  return 1;
+}
+
+#endif				/* #ifdef HAVE_FORK */
@@ -0,0 +1,44 @@
+/* rzx_verify.h: batch verification of RZX files
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_RZX_VERIFY_H
+#define FUSE_RZX_VERIFY_H
+
+#include <stddef.h>
+
+/* Start verifying the RZX files given on the command line. In the
+   controlling process, this returns once every file has been checked; in
+   a worker process, it returns with the worker's file set up for
+   playback */
+int rzx_verify_start( int argc, char **argv, int first_arg );
+
+/* Non-zero if this process is a worker playing back one file */
+int rzx_verify_worker( void );
+
+/* The exit code for the controlling process */
+int rzx_verify_exit_code( void );
+
+/* Called by a worker when playback stops: report the result and exit */
+void rzx_verify_end( int completed, size_t frames );
+
+#endif			/* #ifndef FUSE_RZX_VERIFY_H */
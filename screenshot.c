@@ -32,6 +32,7 @@
 #include "display.h"
 #include "infrastructure/startup_manager.h"
 #include "machine.h"
+#include "memory_pages.h"
 #include "peripherals/scld.h"
 #include "screenshot.h"
 #include "settings.h"
@@ -45,19 +46,8 @@
 #define HIRES_ATTR HICOLOUR_SCR_SIZE
 #define HIRES_SCR_SIZE (HICOLOUR_SCR_SIZE + 1)
 
-#ifdef USE_LIBPNG
-
-#include <png.h>
-#ifdef HAVE_ZLIB_H
-#define ZLIB_CONST
-#include <zlib.h>
-#endif				/* #ifdef HAVE_ZLIB_H */
-
 static int get_rgb32_data( libspectrum_byte *rgb32_data, size_t stride,
 			   size_t height, size_t width );
-static int rgb32_to_rgb24( libspectrum_byte *rgb24_data, size_t rgb24_stride,
-			   libspectrum_byte *rgb32_data, size_t rgb32_stride,
-			   size_t height, size_t width );
 static void fill_rgb32_margin( libspectrum_byte *rgb32_data, size_t stride,
                                size_t height, size_t width );
 
@@ -69,25 +59,23 @@ static void fill_rgb32_margin( libspectrum_byte *rgb32_data, size_t stride,
 /* Pixels arround the RGB image for scalers that "smear" the screen */
 #define K_MARGIN 2
 
-/* The space used for drawing the screen image on */
+/* The space used for drawing the screen image on; big enough for a Timex
+   screen, which is twice the size of the others */
+#define RGB_STRIDE ( ( DISPLAY_SCREEN_WIDTH + K_MARGIN * 2 ) * 4 )
+#define RGB_HEIGHT ( 2 * DISPLAY_SCREEN_HEIGHT + K_MARGIN * 2 )
+#define SCALED_STRIDE ( MAX_SIZE * DISPLAY_ASPECT_WIDTH * 4 )
+
 static libspectrum_byte *rgb_data = NULL;
 static libspectrum_byte *scaled_data;
-static libspectrum_byte *png_data = NULL;
 
+/* Render the current screen through 'scaler' as 32 bits per pixel (red,
+   green, blue and a padding byte). The data is valid until the next call */
 int
-screenshot_write( const char *filename, scaler_type scaler )
+screenshot_render_rgb32( scaler_type scaler, const libspectrum_byte **data,
+                         size_t *stride, size_t *width, size_t *height )
 {
-  FILE *f;
-
-  png_structp png_ptr;
-  png_infop info_ptr;
-
-  libspectrum_byte *row_pointers[ MAX_SIZE * DISPLAY_SCREEN_HEIGHT ];
   libspectrum_byte *rgb_data_centered;
-  size_t rgb_stride = ( DISPLAY_ASPECT_WIDTH + K_MARGIN * 2 ) * 4,
-         scaled_stride = MAX_SIZE * DISPLAY_ASPECT_WIDTH * 4,
-         png_stride = MAX_SIZE * DISPLAY_ASPECT_WIDTH * 3;
-  size_t y, base_height, base_width, height, width;
+  size_t base_height, base_width;
   int error;
 
   if( machine_current->timex ) {
@@ -98,42 +86,84 @@ screenshot_write( const char *filename, scaler_type scaler )
     base_width = DISPLAY_ASPECT_WIDTH;
   }
 
+  if( base_height * scaler_get_scaling_factor( scaler ) >
+      MAX_SIZE * DISPLAY_SCREEN_HEIGHT ) {
+    ui_error( UI_ERROR_ERROR, "scaler %s is too big for this machine",
+              scaler_name( scaler ) );
+    return 1;
+  }
+
   /* Allocate buffers on demand */
   if( !rgb_data )
-    rgb_data =
-      libspectrum_new( libspectrum_byte,
-                       ( DISPLAY_SCREEN_HEIGHT + K_MARGIN * 2 ) * rgb_stride );
+    rgb_data = libspectrum_new( libspectrum_byte, RGB_HEIGHT * RGB_STRIDE );
 
   if( !scaled_data )
     scaled_data = libspectrum_new( libspectrum_byte,
                                    MAX_SIZE * DISPLAY_SCREEN_HEIGHT *
-                                   scaled_stride );
-
-  if( !png_data )
-    png_data = libspectrum_new( libspectrum_byte,
-                                MAX_SIZE * DISPLAY_SCREEN_HEIGHT * png_stride );
+                                   SCALED_STRIDE );
 
   /* first pixel of rgb_data (without margin) */
-  rgb_data_centered = rgb_data + K_MARGIN * rgb_stride + K_MARGIN * 4;
+  rgb_data_centered = rgb_data + K_MARGIN * RGB_STRIDE + K_MARGIN * 4;
 
   /* Change from paletted data to RGB data */
-  error = get_rgb32_data( rgb_data_centered, rgb_stride, base_height,
+  error = get_rgb32_data( rgb_data_centered, RGB_STRIDE, base_height,
                           base_width );
   if( error ) return error;
 
   /* Initialise margin for scalers that "smear" the screen */
   if( scaler_get_flags( scaler ) & SCALER_FLAGS_EXPAND )
-    fill_rgb32_margin( rgb_data, rgb_stride, base_height, base_width );
+    fill_rgb32_margin( rgb_data, RGB_STRIDE, base_height, base_width );
 
   /* Actually scale the data here */
-  scaler_get_proc32( scaler )( rgb_data_centered, rgb_stride, scaled_data,
-                               scaled_stride, base_width, base_height );
+  scaler_get_proc32( scaler )( rgb_data_centered, RGB_STRIDE, scaled_data,
+                               SCALED_STRIDE, base_width, base_height );
+
+  *data = scaled_data;
+  *stride = SCALED_STRIDE;
+  *height = base_height * scaler_get_scaling_factor( scaler );
+  *width  = base_width  * scaler_get_scaling_factor( scaler );
+
+  return 0;
+}
+
+#ifdef USE_LIBPNG
 
-  height = base_height * scaler_get_scaling_factor( scaler );
-  width  = base_width  * scaler_get_scaling_factor( scaler );
+#include <png.h>
+#ifdef HAVE_ZLIB_H
+#define ZLIB_CONST
+#include <zlib.h>
+#endif				/* #ifdef HAVE_ZLIB_H */
+
+static int rgb32_to_rgb24( libspectrum_byte *rgb24_data, size_t rgb24_stride,
+			   const libspectrum_byte *rgb32_data,
+			   size_t rgb32_stride, size_t height, size_t width );
+
+static libspectrum_byte *png_data = NULL;
+
+int
+screenshot_write( const char *filename, scaler_type scaler )
+{
+  FILE *f;
+
+  png_structp png_ptr;
+  png_infop info_ptr;
+
+  libspectrum_byte *row_pointers[ MAX_SIZE * DISPLAY_SCREEN_HEIGHT ];
+  const libspectrum_byte *rgb32_data;
+  size_t png_stride = MAX_SIZE * DISPLAY_ASPECT_WIDTH * 3;
+  size_t y, rgb32_stride, height, width;
+  int error;
+
+  if( !png_data )
+    png_data = libspectrum_new( libspectrum_byte,
+                                MAX_SIZE * DISPLAY_SCREEN_HEIGHT * png_stride );
+
+  error = screenshot_render_rgb32( scaler, &rgb32_data, &rgb32_stride, &width,
+                                   &height );
+  if( error ) return error;
 
   /* Reduce from RGB(padding byte) to just RGB */
-  error = rgb32_to_rgb24( png_data, png_stride, scaled_data, scaled_stride,
+  error = rgb32_to_rgb24( png_data, png_stride, rgb32_data, rgb32_stride,
 			  height, width );
   if( error ) return error;
 
@@ -199,6 +229,8 @@ screenshot_write( const char *filename, scaler_type scaler )
   return 0;
 }
 
+#endif				/* #ifdef USE_LIBPNG */
+
 static int
 get_rgb32_data( libspectrum_byte *rgb32_data, size_t stride,
 		size_t height, size_t width )
@@ -334,9 +366,11 @@ fill_rgb32_margin( libspectrum_byte *rgb32_data, size_t stride,
   }
 }
 
+#ifdef USE_LIBPNG
+
 static int
 rgb32_to_rgb24( libspectrum_byte *rgb24_data, size_t rgb24_stride,
-		libspectrum_byte *rgb32_data, size_t rgb32_stride,
+		const libspectrum_byte *rgb32_data, size_t rgb32_stride,
 		size_t height, size_t width )
 {
   size_t x, y;
@@ -391,9 +425,9 @@ screenshot_available_scalers( scaler_type scaler )
 static void
 screenshot_end( void )
 {
-#ifdef USE_LIBPNG
   libspectrum_free( rgb_data ); rgb_data = NULL;
   libspectrum_free( scaled_data ); scaled_data = NULL;
+#ifdef USE_LIBPNG
   libspectrum_free( png_data ); png_data = NULL;
 #endif
 }
@@ -657,6 +691,7 @@ screenshot_scr_read( const char *filename )
 
   utils_close_file( &screen );
 
+  memory_ram_dirty_all();
   display_refresh_all();
 
   return error;
@@ -700,6 +735,7 @@ screenshot_mlt_read( const char *filename )
 
   utils_close_file( &screen );
 
+  memory_ram_dirty_all();
   display_refresh_all();
 
   return error;
@@ -30,6 +30,9 @@
 
 void screenshot_register_startup( void );
 
+int screenshot_render_rgb32( scaler_type scaler, const libspectrum_byte **data,
+                             size_t *stride, size_t *width, size_t *height );
+
 #ifdef USE_LIBPNG
 
 int screenshot_write( const char *filename, scaler_type scaler );
@@ -28,6 +28,9 @@
 
 #include "config.h"
 
+#include <stdio.h>
+
+#include "debugger/debugger.h"
 #include "fuse.h"
 #include "infrastructure/startup_manager.h"
 #include "machine.h"
@@ -39,6 +42,17 @@
 #include "timer/timer.h"
 #include "ui/ui.h"
 #include "sound/blipbuffer.h"
+#include "sound/render.h"
+
+#ifdef SOUND_FIFO
+#include "sound/ringbuf.h"
+
+extern sound_ringbuf_t sound_fifo;
+#endif                          /* #ifdef SOUND_FIFO */
+
+#ifdef SOUND_THREAD
+#include "sound/soundthread.h"
+#endif                          /* #ifdef SOUND_THREAD */
 
 /* Do we have any of our sound devices available? */
 
@@ -47,6 +61,8 @@ int sound_enabled = 0;		/* Are we currently using the sound card */
 
 static int sound_enabled_ever = 0; /* whether sound has *ever* been in use; see
 				      sound_ay_write() and sound_ay_reset() */
+static int sound_device = 0;	/* Is the output going to the sound device, rather
+				   than just to a file? */
 int sound_stereo_ay = SOUND_STEREO_AY_NONE; /* local copy of settings_current.stereo_ay */
 
 /* assume all three tone channels together match the beeper volume (ish).
@@ -63,17 +79,49 @@ int sound_stereo_ay = SOUND_STEREO_AY_NONE; /* local copy of settings_current.st
  */
 #define AY_CHANGE_MAX		8000
 
+/* Beeper level changes are buffered and applied a batch at a time. Fast
+ * tape loaders and beeper engines can produce several thousand in a frame;
+ * if there are more than this, the batch is just applied early.
+ */
+#define BEEPER_CHANGE_MAX	8192
+
 int sound_framesiz;
 
 static int sound_channels;
+static int sound_speaker;	/* index into speaker_type[] */
+
+/* Low latency mode never changes the output rate by more than this, which
+   keeps pitch changes well below what can be heard */
+#define SOUND_RATE_MAX_DEVIATION 0.005
+
+/* The current output rate adjustment and the smoothed depth of the sound
+   device's queue, in sample frames */
+static double sound_rate_ratio = 1.0;
+static double sound_rate_integral;
+static double sound_queue_depth;
+
+/* Underruns seen by sound devices we have since closed */
+static libspectrum_dword sound_underruns_past;
+
+/* Debugger system variables */
+static const char * const debugger_type_string = "sound";
+static const char * const latency_detail_string = "latency";
+static const char * const rate_detail_string = "rate";
+static const char * const underruns_detail_string = "underruns";
 
 static unsigned int ay_tone_levels[16];
 
 static unsigned int ay_tone_tick[3], ay_tone_high[3], ay_noise_tick;
-static unsigned int ay_tone_cycles, ay_env_cycles;
 static unsigned int ay_env_internal_tick, ay_env_tick;
 static unsigned int ay_tone_period[3], ay_noise_period, ay_env_period;
 
+/* Noise shift register and envelope state */
+static libspectrum_dword ay_noise_rng = 1;
+static int ay_noise_toggle = 0;
+static int ay_env_first = 1, ay_env_rev = 0, ay_env_counter = 15;
+
+static void ay_noise_init_jump( void );
+
 /* Local copy of the AY registers */
 static libspectrum_byte sound_ay_registers[16];
 
@@ -86,6 +134,11 @@ struct ay_change_tag
 static struct ay_change_tag ay_change[ AY_CHANGE_MAX ];
 static int ay_change_count;
 
+static blip_time_t beeper_change_tstates[ BEEPER_CHANGE_MAX ];
+static int beeper_change_level[ BEEPER_CHANGE_MAX ];
+static int beeper_change_count;
+static int beeper_last_level;	/* level of the last change buffered */
+
 Blip_Buffer *left_buf = NULL;
 Blip_Buffer *right_buf = NULL;
 blip_sample_t *samples = NULL;
@@ -99,6 +152,11 @@ Blip_Synth *left_specdrum_synth = NULL, *right_specdrum_synth = NULL;
 
 Blip_Synth *left_covox_synth = NULL, *right_covox_synth = NULL;
 
+/* Each sound source on its own, used only when rendering stems */
+static Blip_Buffer *stem_buf[ SOUND_RENDER_STEM_COUNT ];
+static Blip_Synth *stem_synth[ SOUND_RENDER_STEM_COUNT ];
+static blip_sample_t *stem_samples = NULL;
+
 struct speaker_type_tag
 {
   int bass;
@@ -144,12 +202,59 @@ sound_init_blip( Blip_Buffer **buf, Blip_Synth **synth )
   blip_synth_set_volume( *synth, sound_get_volume( settings_current.volume_beeper ) );
   blip_synth_set_output( *synth, *buf );
 
-  blip_buffer_set_bass_freq( *buf, speaker_type[ option_enumerate_sound_speaker_type() ].bass );
-  blip_synth_set_treble_eq( *synth, speaker_type[ option_enumerate_sound_speaker_type() ].treble );
+  blip_buffer_set_bass_freq( *buf, speaker_type[ sound_speaker ].bass );
+  blip_synth_set_treble_eq( *synth, speaker_type[ sound_speaker ].treble );
 
   return 1;
 }
 
+static int
+sound_init_stems( void )
+{
+  int volume[ SOUND_RENDER_STEM_COUNT ];
+  double treble;
+  int i;
+
+  volume[ SOUND_RENDER_STEM_BEEPER ] = settings_current.volume_beeper;
+  volume[ SOUND_RENDER_STEM_AY_A ] = settings_current.volume_ay;
+  volume[ SOUND_RENDER_STEM_AY_B ] = settings_current.volume_ay;
+  volume[ SOUND_RENDER_STEM_AY_C ] = settings_current.volume_ay;
+  volume[ SOUND_RENDER_STEM_SPECDRUM ] = settings_current.volume_specdrum;
+  volume[ SOUND_RENDER_STEM_COVOX ] = settings_current.volume_covox;
+
+  treble = speaker_type[ sound_speaker ].treble;
+
+  for( i = 0; i < SOUND_RENDER_STEM_COUNT; i++ ) {
+    stem_buf[i] = new_Blip_Buffer();
+    blip_buffer_set_clock_rate( stem_buf[i],
+                                sound_get_effective_processor_speed() );
+    if( blip_buffer_set_sample_rate( stem_buf[i], settings_current.sound_freq,
+                                     1000 ) ) {
+      ui_error( UI_ERROR_ERROR, "out of memory at %s:%d", __FILE__, __LINE__ );
+      return 1;
+    }
+    blip_buffer_set_bass_freq( stem_buf[i],
+                   speaker_type[ sound_speaker ].bass );
+
+    stem_synth[i] = new_Blip_Synth();
+    blip_synth_set_volume( stem_synth[i], sound_get_volume( volume[i] ) );
+    blip_synth_set_output( stem_synth[i], stem_buf[i] );
+    blip_synth_set_treble_eq( stem_synth[i], treble );
+  }
+
+  stem_samples = libspectrum_new( blip_sample_t, sound_framesiz );
+
+  return 0;
+}
+
+static void
+sound_stem_update( sound_render_stem stem, libspectrum_dword at_tstates,
+                   int value )
+{
+  if( stem_synth[ stem ] )
+    blip_synth_update( stem_synth[ stem ], at_tstates, value );
+}
+
 static void
 sound_ay_init( void )
 {
@@ -172,10 +277,11 @@ sound_ay_init( void )
 
   ay_noise_tick = ay_noise_period = 0;
   ay_env_internal_tick = ay_env_tick = ay_env_period = 0;
-  ay_tone_cycles = ay_env_cycles = 0;
   for( f = 0; f < 3; f++ )
     ay_tone_tick[f] = ay_tone_high[f] = 0, ay_tone_period[f] = 1;
 
+  ay_noise_init_jump();
+
   ay_change_count = 0;
 }
 
@@ -196,28 +302,45 @@ is_in_sound_enabled_range( void )
     settings_current.emulation_speed <= MAX_SPEED_PERCENTAGE;
 }
 
+static void sound_init_output( const char *device, int use_device,
+                               int stereo_ay, int speaker );
+
 void
 sound_init( const char *device )
 {
-  float hz;
-  double treble;
-  Blip_Synth **ay_left_synth;
-  Blip_Synth **ay_mid_synth;
-  Blip_Synth **ay_mid_synth_r;
-  Blip_Synth **ay_right_synth;
-
   /* Allow sound as long as emulation speed is greater than 2%
      (less than that and a single Speccy frame generates more
      than a seconds worth of sound which is bigger than the
      maximum Blip_Buffer of 1 second) */
-  if( !( !sound_enabled && settings_current.sound &&
+  if( !( !sound_enabled &&
+         ( settings_current.sound || settings_current.sound_render ) &&
          is_in_sound_enabled_range() ) )
     return;
 
+  /* When rendering to a file, the sound device isn't used at all */
+  sound_init_output( device,
+                     settings_current.sound && !settings_current.sound_render,
+                     option_enumerate_sound_stereo_ay(),
+                     option_enumerate_sound_speaker_type() );
+}
+
+static void
+sound_init_output( const char *device, int use_device, int stereo_ay,
+                   int speaker )
+{
+  float hz;
+  double treble;
+  Blip_Synth **ay_left_synth;
+  Blip_Synth **ay_mid_synth;
+  Blip_Synth **ay_mid_synth_r;
+  Blip_Synth **ay_right_synth;
+
   /* only try for stereo if we need it */
-  sound_stereo_ay = option_enumerate_sound_stereo_ay();
+  sound_stereo_ay = stereo_ay;
+  sound_speaker = speaker;
+  sound_device = use_device;
 
-  if( settings_current.sound &&
+  if( sound_device &&
       sound_lowlevel_init( device, &settings_current.sound_freq,
                            &sound_stereo_ay ) )
     return;
@@ -227,7 +350,7 @@ sound_init( const char *device )
       !sound_init_blip(&right_buf, &right_beeper_synth) )
     return;
 
-  treble = speaker_type[ option_enumerate_sound_speaker_type() ].treble;
+  treble = speaker_type[ sound_speaker ].treble;
 
   ay_a_synth = new_Blip_Synth();
   blip_synth_set_volume( ay_a_synth,
@@ -321,11 +444,47 @@ sound_init( const char *device )
   hz = ( float )sound_get_effective_processor_speed() /
                 machine_current->timings.tstates_per_frame;
 
-  /* Size of audio data we will get from running a single Spectrum frame */
-  sound_framesiz = ( float )settings_current.sound_freq / hz;
+  /* Size of audio data we will get from running a single Spectrum frame,
+     allowing for low latency mode speeding up the output rate */
+  sound_framesiz = ( float )settings_current.sound_freq / hz *
+                   ( 1 + SOUND_RATE_MAX_DEVIATION );
   sound_framesiz++;
 
+  sound_rate_ratio = 1.0;
+  sound_rate_integral = 0;
+  sound_queue_depth =
+    settings_current.sound_latency * settings_current.sound_freq / 1000.0;
+
   samples = libspectrum_new0( blip_sample_t, sound_framesiz * sound_channels );
+
+  beeper_change_count = 0;
+  beeper_last_level = 0;
+
+  /* Rendering carries on across sound_end() and sound_init() pairs, as
+     happen when the machine is changed */
+  if( settings_current.sound_render ) {
+    if( sound_render_start( settings_current.sound_render,
+                            settings_current.sound_freq, sound_channels,
+                            settings_current.sound_render_stems ) ) {
+      sound_end();
+      fuse_exiting = 1;
+      return;
+    }
+
+    if( sound_render_stems && sound_init_stems() ) {
+      sound_end();
+      fuse_exiting = 1;
+      return;
+    }
+  }
+
+#ifdef SOUND_THREAD
+  if( sound_device &&
+      sound_thread_init( settings_current.sound_freq, sound_channels ) ) {
+    sound_end();
+    return;
+  }
+#endif                          /* #ifdef SOUND_THREAD */
   /* initialize movie settings... */
   movie_init_sound( settings_current.sound_freq, sound_stereo_ay );
 
@@ -334,6 +493,9 @@ sound_init( const char *device )
 void
 sound_pause( void )
 {
+  /* Keep rendering while paused or fastloading so the file has no gaps */
+  if( sound_render_active ) return;
+
   if( sound_enabled )
     sound_end();
 }
@@ -341,8 +503,9 @@ sound_pause( void )
 void
 sound_unpause( void )
 {
-  /* No sound if fastloading in progress */
-  if( settings_current.fastload && timer_fastloading_active() )
+  /* No sound if fastloading or turbo loading in progress */
+  if( ( settings_current.fastload && timer_fastloading_active() ) ||
+      timer_turbo_active() )
     return;
 
   sound_init( settings_current.sound_device );
@@ -351,6 +514,8 @@ sound_unpause( void )
 void
 sound_end( void )
 {
+  int i;
+
   if( sound_enabled ) {
     delete_Blip_Synth( &left_beeper_synth );
     delete_Blip_Synth( &right_beeper_synth );
@@ -371,42 +536,150 @@ sound_end( void )
     delete_Blip_Buffer( &left_buf );
     delete_Blip_Buffer( &right_buf );
 
-    if( settings_current.sound ) 
+    for( i = 0; i < SOUND_RENDER_STEM_COUNT; i++ ) {
+      delete_Blip_Synth( &stem_synth[i] );
+      delete_Blip_Buffer( &stem_buf[i] );
+    }
+    libspectrum_free( stem_samples ); stem_samples = NULL;
+
+    if( sound_device ) {
+#ifdef SOUND_FIFO
+      sound_underruns_past += sound_ringbuf_underruns( &sound_fifo );
+#endif                          /* #ifdef SOUND_FIFO */
+#ifdef SOUND_THREAD
+      sound_thread_end();
+#endif                          /* #ifdef SOUND_THREAD */
       sound_lowlevel_end();
+    }
     libspectrum_free( samples );
     sound_enabled = 0;
   }
 }
 
+static libspectrum_dword
+get_latency( void )
+{
+  if( !sound_enabled || sound_queue_depth < 0 ) return 0;
+
+  return sound_queue_depth * 1000000 / settings_current.sound_freq;
+}
+
+static libspectrum_dword
+get_rate( void )
+{
+  if( !sound_enabled ) return 0;
+
+  return settings_current.sound_freq / sound_rate_ratio + 0.5;
+}
+
+static libspectrum_dword
+get_underruns( void )
+{
+#ifdef SOUND_FIFO
+  if( sound_enabled && sound_device )
+    return sound_underruns_past + sound_ringbuf_underruns( &sound_fifo );
+#endif                          /* #ifdef SOUND_FIFO */
+
+  return sound_underruns_past;
+}
+
+static int
+sound_register_debugger( void *context )
+{
+  debugger_system_variable_register( debugger_type_string,
+                                     latency_detail_string, get_latency,
+                                     NULL );
+  debugger_system_variable_register( debugger_type_string,
+                                     rate_detail_string, get_rate, NULL );
+  debugger_system_variable_register( debugger_type_string,
+                                     underruns_detail_string, get_underruns,
+                                     NULL );
+
+  return 0;
+}
+
+static void
+sound_shutdown( void )
+{
+  sound_end();
+  sound_render_stop();
+}
+
 void
 sound_register_startup( void )
 {
-  startup_manager_module dependencies[] = { STARTUP_MANAGER_MODULE_SETUID };
+  startup_manager_module dependencies[] = {
+    STARTUP_MANAGER_MODULE_DEBUGGER,
+    STARTUP_MANAGER_MODULE_SETUID,
+  };
   startup_manager_register( STARTUP_MANAGER_MODULE_SOUND, dependencies,
-                            ARRAY_SIZE( dependencies ), NULL, NULL, sound_end );
+                            ARRAY_SIZE( dependencies ), sound_register_debugger,
+                            NULL, sound_shutdown );
 }
 
-static inline void
-ay_do_tone( int level, unsigned int tone_count, int *var, int chan )
+/* Is the output rate being adjusted to hold the sound device's queue at a
+   fixed depth? If so, the emulation is paced by the clock rather than by
+   the sound device */
+int
+sound_rate_controlled( void )
 {
-  *var = 0;
+#ifdef SOUND_FIFO
+  return sound_enabled && sound_device && settings_current.sound_latency > 0;
+#else                           /* #ifdef SOUND_FIFO */
+  return 0;
+#endif                          /* #ifdef SOUND_FIFO */
+}
 
-  ay_tone_tick[ chan ] += tone_count;
+#ifdef SOUND_FIFO
 
-  if( ay_tone_tick[ chan ] >= ay_tone_period[ chan ] ) {
-    ay_tone_tick[ chan ] -= ay_tone_period[ chan ];
-    ay_tone_high[ chan ] = !ay_tone_high[ chan ];
-  }
-
-  if( level ) {
-    if( ay_tone_high[ chan ] )
-      *var = level;
-    else {
-      *var = 0;
-    }
-  }
+/* Update the queue depth estimate after writing 'frames' sample frames to
+   the sound device and, in low latency mode, nudge the output rate towards
+   keeping the queue at the target depth */
+static void
+sound_rate_update( long frames )
+{
+  double depth, target, error, adjustment;
+  libspectrum_dword clock_rate;
+
+  /* The device will drain about a frame's worth of sound before we write
+     again, so measure the depth half way through that */
+  depth = sound_ringbuf_used( &sound_fifo ) - frames / 2.0;
+  sound_queue_depth += ( depth - sound_queue_depth ) / 8;
+
+  if( !sound_rate_controlled() ) return;
+
+  target = settings_current.sound_latency * settings_current.sound_freq /
+           1000.0;
+  error = ( sound_queue_depth - target ) / target;
+  if( error > 1 ) error = 1;
+  else if( error < -1 ) error = -1;
+
+  /* The integral term slowly soaks up any constant difference between the
+     system clock and the sound device's clock */
+  sound_rate_integral += error * SOUND_RATE_MAX_DEVIATION / 256;
+  if( sound_rate_integral > SOUND_RATE_MAX_DEVIATION )
+    sound_rate_integral = SOUND_RATE_MAX_DEVIATION;
+  else if( sound_rate_integral < -SOUND_RATE_MAX_DEVIATION )
+    sound_rate_integral = -SOUND_RATE_MAX_DEVIATION;
+
+  adjustment = error * SOUND_RATE_MAX_DEVIATION + sound_rate_integral;
+  if( adjustment > SOUND_RATE_MAX_DEVIATION )
+    adjustment = SOUND_RATE_MAX_DEVIATION;
+  else if( adjustment < -SOUND_RATE_MAX_DEVIATION )
+    adjustment = -SOUND_RATE_MAX_DEVIATION;
+
+  /* Too much queued means we are producing too many samples per frame:
+     increasing the clock rate the Blip_Buffers think they are being fed at
+     reduces that */
+  sound_rate_ratio = 1 + adjustment;
+
+  clock_rate = sound_get_effective_processor_speed() * sound_rate_ratio;
+  blip_buffer_set_clock_rate( left_buf, clock_rate );
+  if( right_buf ) blip_buffer_set_clock_rate( right_buf, clock_rate );
 }
 
+#endif                          /* #ifdef SOUND_FIFO */
+
 /* bitmasks for envelope */
 #define AY_ENV_CONT	8
 #define AY_ENV_ATTACK	4
@@ -420,22 +693,331 @@ ay_do_tone( int level, unsigned int tone_count, int *var, int chan )
    master clock by 2 to drive the AY */
 #define AY_CLOCK_RATIO 2
 
+/* The AY is emulated in steps of AY_CLOCK_DIVISOR AY cycles. Each step
+   advances the envelope and noise generators by one tick and the tone
+   generators by two ticks */
+#define AY_STEP_TSTATES ( AY_CLOCK_DIVISOR * AY_CLOCK_RATIO )
+
+/* Step one tone generator */
+static inline void
+ay_tone_step( int chan )
+{
+  ay_tone_tick[ chan ] += 2;
+
+  if( ay_tone_tick[ chan ] >= ay_tone_period[ chan ] ) {
+    ay_tone_tick[ chan ] -= ay_tone_period[ chan ];
+    ay_tone_high[ chan ] = !ay_tone_high[ chan ];
+  }
+}
+
+/* Advance one tone generator by `steps' steps at once */
+static void
+ay_tone_advance( int chan, unsigned int steps )
+{
+  unsigned int period = ay_tone_period[ chan ], flips;
+
+  /* After a period change the tick may be out of range; step until it
+     is back in range, after which the tick is simply taken modulo the
+     period */
+  while( steps && period > 2 && ay_tone_tick[ chan ] >= period ) {
+    ay_tone_step( chan );
+    steps--;
+  }
+
+  if( !steps ) return;
+
+  switch( period ) {
+  case 1:
+    /* The tick grows by one each step, flipping every time */
+    ay_tone_tick[ chan ] += steps;
+    flips = steps;
+    break;
+  case 2:
+    flips = steps;
+    break;
+  default:
+    ay_tone_tick[ chan ] += 2 * steps;
+    flips = ay_tone_tick[ chan ] / period;
+    ay_tone_tick[ chan ] %= period;
+    break;
+  }
+
+  ay_tone_high[ chan ] ^= flips & 1;
+}
+
+/* The number of steps before the tone generator next flips */
+static unsigned int
+ay_tone_quiet_steps( int chan )
+{
+  unsigned int tick = ay_tone_tick[ chan ], period = ay_tone_period[ chan ];
+
+  return tick + 2 >= period ? 0 : ( period - tick - 1 ) / 2;
+}
+
+/* The noise generator is a 17-bit shift register, with `ay_noise_toggle'
+   flipping whenever bits 0 and 1 differ. Both are linear over GF(2), so
+   `ay_noise_jump[i][b]' is the effect of 2^i ticks on bit `b' of the
+   combined state, with the toggle in bit 17 */
+#define AY_NOISE_TOGGLE_BIT 17
+#define AY_NOISE_JUMP_MAX 16
+
+static libspectrum_dword ay_noise_jump[ AY_NOISE_JUMP_MAX ][ 18 ];
+
+static libspectrum_dword
+ay_noise_tick_state( libspectrum_dword state )
+{
+  libspectrum_dword rng = state & 0x1ffff;
+
+  if( ( rng & 1 ) ^ ( ( rng & 2 ) ? 1 : 0 ) )
+    state ^= 1 << AY_NOISE_TOGGLE_BIT;
+
+  /* rng is 17-bit shift reg, bit 0 is output.
+   * input is bit 0 xor bit 3.
+   */
+  if( rng & 1 ) {
+    rng ^= 0x24000;
+  }
+  rng >>= 1;
+
+  return ( state & ~0x1ffff ) | rng;
+}
+
+static libspectrum_dword
+ay_noise_apply( const libspectrum_dword *jump, libspectrum_dword state )
+{
+  libspectrum_dword result = 0;
+  int b;
+
+  for( b = 0; state; b++, state >>= 1 )
+    result ^= jump[b] & -( state & 1 );
+
+  return result;
+}
+
+static void
+ay_noise_init_jump( void )
+{
+  int i, b;
+
+  for( b = 0; b < 18; b++ )
+    ay_noise_jump[0][b] = ay_noise_tick_state( 1 << b );
+
+  for( i = 1; i < AY_NOISE_JUMP_MAX; i++ )
+    for( b = 0; b < 18; b++ )
+      ay_noise_jump[i][b] = ay_noise_apply( ay_noise_jump[ i - 1 ],
+                                            ay_noise_jump[ i - 1 ][b] );
+}
+
+static void
+ay_noise_fire( unsigned int count )
+{
+  libspectrum_dword state = ay_noise_rng |
+    ( ay_noise_toggle ? 1 << AY_NOISE_TOGGLE_BIT : 0 );
+  int i;
+
+  if( count == 1 ) {
+    state = ay_noise_tick_state( state );
+  } else {
+    for( i = 0; count; i++, count >>= 1 ) {
+      if( i == AY_NOISE_JUMP_MAX - 1 ) {
+        while( count-- ) state = ay_noise_apply( ay_noise_jump[i], state );
+        break;
+      }
+      if( count & 1 ) state = ay_noise_apply( ay_noise_jump[i], state );
+    }
+  }
+
+  ay_noise_rng = state & 0x1ffff;
+  ay_noise_toggle = !!( state & ( 1 << AY_NOISE_TOGGLE_BIT ) );
+}
+
+/* Advance the noise generator by `steps' steps */
+static void
+ay_noise_advance( unsigned int steps )
+{
+  unsigned int count;
+
+  ay_noise_tick += steps;
+
+  if( !ay_noise_period ) {
+    /* don't keep trying if period is zero */
+    count = steps;
+  } else {
+    count = ay_noise_tick / ay_noise_period;
+    ay_noise_tick %= ay_noise_period;
+  }
+
+  if( count ) ay_noise_fire( count );
+}
+
+/* The number of steps before the noise generator is next clocked */
+static unsigned int
+ay_noise_quiet_steps( void )
+{
+  if( !ay_noise_period || ay_noise_tick + 1 >= ay_noise_period ) return 0;
+  return ay_noise_period - ay_noise_tick - 1;
+}
+
+/* Once the first cycle of a non-repeating or holding envelope is over,
+   its output never changes until register 13 is written again */
+static int
+ay_env_is_frozen( void )
+{
+  int envshape = sound_ay_registers[13];
+
+  return !ay_env_first &&
+         ( !( envshape & AY_ENV_CONT ) || ( envshape & AY_ENV_HOLD ) );
+}
+
+/* Do one 1/16th-of-period step of the envelope */
+static void
+ay_env_fire( void )
+{
+  int envshape = sound_ay_registers[13];
+
+  /* do a 1/16th-of-period incr/decr if needed */
+  if( ay_env_first ||
+      ( ( envshape & AY_ENV_CONT ) && !( envshape & AY_ENV_HOLD ) ) ) {
+    if( ay_env_rev )
+      ay_env_counter -= ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
+    else
+      ay_env_counter += ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
+    if( ay_env_counter < 0 )
+      ay_env_counter = 0;
+    if( ay_env_counter > 15 )
+      ay_env_counter = 15;
+  }
+
+  ay_env_internal_tick++;
+  while( ay_env_internal_tick >= 16 ) {
+    ay_env_internal_tick -= 16;
+
+    /* end of cycle */
+    if( !( envshape & AY_ENV_CONT ) )
+      ay_env_counter = 0;
+    else {
+      if( envshape & AY_ENV_HOLD ) {
+        if( ay_env_first && ( envshape & AY_ENV_ALT ) )
+          ay_env_counter = ( ay_env_counter ? 0 : 15 );
+      } else {
+        /* non-hold */
+        if( envshape & AY_ENV_ALT )
+          ay_env_rev = !ay_env_rev;
+        else
+          ay_env_counter = ( envshape & AY_ENV_ATTACK ) ? 0 : 15;
+      }
+    }
+
+    ay_env_first = 0;
+  }
+}
+
+/* Advance the envelope by `steps' steps */
+static void
+ay_env_advance( unsigned int steps )
+{
+  unsigned int count;
+
+  ay_env_tick += steps;
+
+  if( !ay_env_period ) {
+    /* don't keep trying if period is zero */
+    count = steps;
+  } else {
+    count = ay_env_tick / ay_env_period;
+    ay_env_tick %= ay_env_period;
+  }
+
+  if( !count ) return;
+
+  if( ay_env_is_frozen() ) {
+    /* Nothing but the position in the cycle changes */
+    ay_env_internal_tick = ( ay_env_internal_tick + count ) % 16;
+  } else {
+    while( count-- ) ay_env_fire();
+  }
+}
+
+/* The number of steps before the envelope is next stepped */
+static unsigned int
+ay_env_quiet_steps( void )
+{
+  if( !ay_env_period || ay_env_tick + 1 >= ay_env_period ) return 0;
+  return ay_env_period - ay_env_tick - 1;
+}
+
+static void
+sound_ay_apply_change( int reg, int val )
+{
+  int r;
+
+  sound_ay_registers[ reg ] = val;
+
+  /* fix things as needed for some register changes */
+  switch ( reg ) {
+  case 0: case 1: case 2: case 3: case 4: case 5:
+    r = reg >> 1;
+    /* a zero-len period is the same as 1 */
+    ay_tone_period[r] = ( sound_ay_registers[ reg & ~1 ] |
+                          ( sound_ay_registers[ reg | 1 ] & 15 ) << 8 );
+    if( !ay_tone_period[r] )
+      ay_tone_period[r]++;
+
+    /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
+     * has really scratchy, horrible-sounding vibrato.
+     */
+    if( ay_tone_tick[r] >= ay_tone_period[r] * 2 )
+      ay_tone_tick[r] %= ay_tone_period[r] * 2;
+    break;
+  case 6:
+    ay_noise_tick = 0;
+    ay_noise_period = ( sound_ay_registers[ reg ] & 31 );
+    break;
+  case 11: case 12:
+    ay_env_period =
+      sound_ay_registers[11] | ( sound_ay_registers[12] << 8 );
+    break;
+  case 13:
+    ay_env_internal_tick = ay_env_tick = 0;
+    ay_env_first = 1;
+    ay_env_rev = 0;
+    ay_env_counter = ( sound_ay_registers[13] & AY_ENV_ATTACK ) ? 0 : 15;
+    break;
+  }
+}
+
+/* Whether channel `chan' can produce anything other than silence until
+   the registers next change */
+static int
+ay_channel_is_audible( int chan )
+{
+  int volume = sound_ay_registers[ 8 + chan ];
+
+  if( volume & 16 )
+    return !ay_env_is_frozen() || ay_tone_levels[ ay_env_counter ];
+
+  return ay_tone_levels[ volume & 15 ] != 0;
+}
+
+/* Rather than stepping through every AY_STEP_TSTATES of the frame, run a
+   full step only where a register is written, or where a tone, envelope
+   or noise generator which can be heard changes state. In between, the
+   output can't change, so the generators are simply advanced in bulk.
+   The output is identical to running a full step every time */
 static void
 sound_ay_overlay( void )
 {
-  static int rng = 1;
-  static int noise_toggle = 0;
-  static int env_first = 1, env_rev = 0, env_counter = 15;
   int tone_level[3];
-  int mixer, envshape;
-  int g, level;
-  libspectrum_dword f;
+  int mixer;
+  int g, level, env_counter, noise_toggle;
+  int env_changed, noise_changed;
+  libspectrum_dword f, step, steps, next;
   struct ay_change_tag *change_ptr = ay_change;
   int changes_left = ay_change_count;
-  int reg, r;
-  int chan1, chan2, chan3;
-  int last_chan1 = 0, last_chan2 = 0, last_chan3 = 0;
-  unsigned int tone_count, noise_count;
+  int chan[3];
+  int last_chan[3] = { 0, 0, 0 };
+  unsigned int quiet, limit;
+  Blip_Synth *synth[3], *synth_r[3];
 
   /* If no AY chip, don't produce any AY sound (!) */
   if( !( periph_is_active( PERIPH_TYPE_FULLER) ||
@@ -443,45 +1025,21 @@ sound_ay_overlay( void )
          machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_AY ) )
     return;
 
-  for( f = 0; f < machine_current->timings.tstates_per_frame;
-       f+= AY_CLOCK_DIVISOR * AY_CLOCK_RATIO ) {
+  synth[0] = ay_a_synth; synth_r[0] = ay_a_synth_r;
+  synth[1] = ay_b_synth; synth_r[1] = ay_b_synth_r;
+  synth[2] = ay_c_synth; synth_r[2] = ay_c_synth_r;
+
+  steps = ( machine_current->timings.tstates_per_frame + AY_STEP_TSTATES - 1 )
+          / AY_STEP_TSTATES;
+
+  for( step = 0; step < steps; ) {
+    f = step * AY_STEP_TSTATES;
+
     /* update ay registers. */
     while( changes_left && f >= change_ptr->tstates ) {
-      sound_ay_registers[ reg = change_ptr->reg ] = change_ptr->val;
+      sound_ay_apply_change( change_ptr->reg, change_ptr->val );
       change_ptr++;
       changes_left--;
-
-      /* fix things as needed for some register changes */
-      switch ( reg ) {
-      case 0: case 1: case 2: case 3: case 4: case 5:
-        r = reg >> 1;
-        /* a zero-len period is the same as 1 */
-        ay_tone_period[r] = ( sound_ay_registers[ reg & ~1 ] |
-                              ( sound_ay_registers[ reg | 1 ] & 15 ) << 8 );
-        if( !ay_tone_period[r] )
-          ay_tone_period[r]++;
-
-        /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
-         * has really scratchy, horrible-sounding vibrato.
-         */
-        if( ay_tone_tick[r] >= ay_tone_period[r] * 2 )
-          ay_tone_tick[r] %= ay_tone_period[r] * 2;
-        break;
-      case 6:
-        ay_noise_tick = 0;
-        ay_noise_period = ( sound_ay_registers[ reg ] & 31 );
-        break;
-      case 11: case 12:
-        ay_env_period =
-          sound_ay_registers[11] | ( sound_ay_registers[12] << 8 );
-        break;
-      case 13:
-        ay_env_internal_tick = ay_env_tick = ay_env_cycles = 0;
-        env_first = 1;
-        env_rev = 0;
-        env_counter = ( sound_ay_registers[13] & AY_ENV_ATTACK ) ? 0 : 15;
-        break;
-      }
     }
 
     /* the tone level if no enveloping is being used */
@@ -489,136 +1047,100 @@ sound_ay_overlay( void )
       tone_level[g] = ay_tone_levels[ sound_ay_registers[ 8 + g ] & 15 ];
 
     /* envelope */
-    envshape = sound_ay_registers[13];
-    level = ay_tone_levels[ env_counter ];
+    level = ay_tone_levels[ ay_env_counter ];
 
     for( g = 0; g < 3; g++ )
       if( sound_ay_registers[ 8 + g ] & 16 )
         tone_level[g] = level;
 
-    /* envelope output counter gets incr'd every 16 AY cycles. */
-    ay_env_cycles += AY_CLOCK_DIVISOR;
-    noise_count = 0;
-    while( ay_env_cycles >= 16 ) {
-      ay_env_cycles -= 16;
-      noise_count++;
-      ay_env_tick++;
-      while( ay_env_tick >= ay_env_period ) {
-        ay_env_tick -= ay_env_period;
-
-        /* do a 1/16th-of-period incr/decr if needed */
-        if( env_first ||
-            ( ( envshape & AY_ENV_CONT ) && !( envshape & AY_ENV_HOLD ) ) ) {
-          if( env_rev )
-            env_counter -= ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
-          else
-            env_counter += ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
-          if( env_counter < 0 )
-            env_counter = 0;
-          if( env_counter > 15 )
-            env_counter = 15;
-        }
-
-        ay_env_internal_tick++;
-        while( ay_env_internal_tick >= 16 ) {
-          ay_env_internal_tick -= 16;
-
-          /* end of cycle */
-          if( !( envshape & AY_ENV_CONT ) )
-            env_counter = 0;
-          else {
-            if( envshape & AY_ENV_HOLD ) {
-              if( env_first && ( envshape & AY_ENV_ALT ) )
-                env_counter = ( env_counter ? 0 : 15 );
-            } else {
-              /* non-hold */
-              if( envshape & AY_ENV_ALT )
-                env_rev = !env_rev;
-              else
-                env_counter = ( envshape & AY_ENV_ATTACK ) ? 0 : 15;
-            }
-          }
-
-          env_first = 0;
-        }
-
-        /* don't keep trying if period is zero */
-        if( !ay_env_period )
-          break;
-      }
-    }
+    env_counter = ay_env_counter;
+    ay_env_advance( 1 );
+    env_changed = ay_env_counter != env_counter;
 
     /* generate tone+noise... or neither.
      * (if no tone/noise is selected, the chip just shoves the
      * level out unmodified. This is used by some sample-playing
      * stuff.)
      */
-    chan1 = tone_level[0];
-    chan2 = tone_level[1];
-    chan3 = tone_level[2];
     mixer = sound_ay_registers[7];
 
-    ay_tone_cycles += AY_CLOCK_DIVISOR;
-    tone_count = ay_tone_cycles >> 3;
-    ay_tone_cycles &= 7;
+    for( g = 0; g < 3; g++ ) {
+      chan[g] = tone_level[g];
 
-    if( ( mixer & 1 ) == 0 ) {
-      level = chan1;
-      ay_do_tone( level, tone_count, &chan1, 0 );
+      if( ( mixer & ( 1 << g ) ) == 0 ) {
+        ay_tone_step( g );
+        if( !ay_tone_high[g] ) chan[g] = 0;
+      }
+      if( ( mixer & ( 8 << g ) ) == 0 && ay_noise_toggle )
+        chan[g] = 0;
+
+      if( last_chan[g] != chan[g] ) {
+        blip_synth_update( synth[g], f, chan[g] );
+        if( synth_r[g] ) blip_synth_update( synth_r[g], f, chan[g] );
+        sound_stem_update( SOUND_RENDER_STEM_AY_A + g, f, chan[g] );
+        last_chan[g] = chan[g];
+      }
     }
-    if( ( mixer & 0x08 ) == 0 && noise_toggle )
-      chan1 = 0;
 
-    if( ( mixer & 2 ) == 0 ) {
-      level = chan2;
-      ay_do_tone( level, tone_count, &chan2, 1 );
+    /* update noise RNG/filter */
+    noise_toggle = ay_noise_toggle;
+    ay_noise_advance( 1 );
+    noise_changed = ay_noise_toggle != noise_toggle;
+
+    step++;
+
+    /* Work out how many of the following steps must give the same output
+       as this one: none once the next register change is due, or if
+       anything which feeds an audible channel has just changed */
+    quiet = steps - step;
+
+    if( changes_left ) {
+      next = ( change_ptr->tstates + AY_STEP_TSTATES - 1 ) / AY_STEP_TSTATES;
+      if( next <= step ) {
+        quiet = 0;
+      } else if( next - step < quiet ) {
+        quiet = next - step;
+      }
     }
-    if( ( mixer & 0x10 ) == 0 && noise_toggle )
-      chan2 = 0;
 
-    if( ( mixer & 4 ) == 0 ) {
-      level = chan3;
-      ay_do_tone( level, tone_count, &chan3, 2 );
-    }
-    if( ( mixer & 0x20 ) == 0 && noise_toggle )
-      chan3 = 0;
+    for( g = 0; g < 3 && quiet; g++ ) {
+      if( !ay_channel_is_audible( g ) ) {
+        if( last_chan[g] ) quiet = 0;
+        continue;
+      }
 
-    if( last_chan1 != chan1 ) {
-      blip_synth_update( ay_a_synth, f, chan1 );
-      if( ay_a_synth_r ) blip_synth_update( ay_a_synth_r, f, chan1 );
-      last_chan1 = chan1;
-    }
-    if( last_chan2 != chan2 ) {
-      blip_synth_update( ay_b_synth, f, chan2 );
-      if( ay_b_synth_r ) blip_synth_update( ay_b_synth_r, f, chan2 );
-      last_chan2 = chan2;
-    }
-    if( last_chan3 != chan3 ) {
-      blip_synth_update( ay_c_synth, f, chan3 );
-      if( ay_c_synth_r ) blip_synth_update( ay_c_synth_r, f, chan3 );
-      last_chan3 = chan3;
-    }
+      if( sound_ay_registers[ 8 + g ] & 16 ) {
+        if( env_changed ) {
+          quiet = 0;
+        } else if( !ay_env_is_frozen() ) {
+          limit = ay_env_quiet_steps();
+          if( limit < quiet ) quiet = limit;
+        }
+      }
 
-    /* update noise RNG/filter */
-    ay_noise_tick += noise_count;
-    while( ay_noise_tick >= ay_noise_period ) {
-      ay_noise_tick -= ay_noise_period;
-
-      if( ( rng & 1 ) ^ ( ( rng & 2 ) ? 1 : 0 ) )
-        noise_toggle = !noise_toggle;
-
-      /* rng is 17-bit shift reg, bit 0 is output.
-       * input is bit 0 xor bit 3.
-       */
-      if( rng & 1 ) {
-        rng ^= 0x24000;
+      if( ( mixer & ( 8 << g ) ) == 0 ) {
+        if( noise_changed ) {
+          quiet = 0;
+        } else {
+          limit = ay_noise_quiet_steps();
+          if( limit < quiet ) quiet = limit;
+        }
       }
-      rng >>= 1;
 
-      /* don't keep trying if period is zero */
-      if( !ay_noise_period )
-        break;
+      if( ( mixer & ( 1 << g ) ) == 0 ) {
+        limit = ay_tone_quiet_steps( g );
+        if( limit < quiet ) quiet = limit;
+      }
     }
+
+    if( !quiet ) continue;
+
+    for( g = 0; g < 3; g++ )
+      if( ( mixer & ( 1 << g ) ) == 0 ) ay_tone_advance( g, quiet );
+    ay_env_advance( quiet );
+    ay_noise_advance( quiet );
+
+    step += quiet;
   }
 }
 
@@ -652,7 +1174,6 @@ sound_ay_reset( void )
     sound_ay_write( f, 0, 0 );
   for( f = 0; f < 3; f++ )
     ay_tone_high[f] = 0;
-  ay_tone_cycles = ay_env_cycles = 0;
 }
 
 /*
@@ -667,6 +1188,8 @@ sound_specdrum_write( libspectrum_word port GCC_UNUSED, libspectrum_byte val )
     if( right_specdrum_synth ) {
       blip_synth_update( right_specdrum_synth, tstates, ( val - 128) * 128);
     }
+    sound_stem_update( SOUND_RENDER_STEM_SPECDRUM, tstates,
+                       ( val - 128 ) * 128 );
     machine_current->specdrum.specdrum_dac = val - 128;
   }
 }
@@ -684,17 +1207,65 @@ sound_covox_write( libspectrum_word port GCC_UNUSED, libspectrum_byte val )
     if( right_covox_synth ) {
       blip_synth_update( right_covox_synth, tstates, val * 128);
     }
+    sound_stem_update( SOUND_RENDER_STEM_COVOX, tstates, val * 128 );
     machine_current->covox.covox_dac = val;
   }
 }
 
-void
-sound_frame( void )
+/* Apply the buffered beeper changes to the Blip_Buffers. This gives the
+   same output as applying each one as it happens, as nothing moves the
+   buffers on until the end of the frame */
+static void
+sound_beeper_flush( void )
+{
+  int i;
+
+  for( i = 0; i < beeper_change_count; i++ )
+    blip_synth_update( left_beeper_synth, beeper_change_tstates[i],
+                       beeper_change_level[i] );
+
+  if( sound_stereo_ay != SOUND_STEREO_AY_NONE ) {
+    for( i = 0; i < beeper_change_count; i++ )
+      blip_synth_update( right_beeper_synth, beeper_change_tstates[i],
+                         beeper_change_level[i] );
+  }
+
+  if( stem_synth[ SOUND_RENDER_STEM_BEEPER ] ) {
+    for( i = 0; i < beeper_change_count; i++ )
+      blip_synth_update( stem_synth[ SOUND_RENDER_STEM_BEEPER ],
+                         beeper_change_tstates[i], beeper_change_level[i] );
+  }
+
+  beeper_change_count = 0;
+}
+
+/* Write the stems for this frame, if we have them */
+static void
+sound_stems_frame( void )
 {
   long count;
+  int i;
 
-  if( !sound_enabled )
-    return;
+  for( i = 0; i < SOUND_RENDER_STEM_COUNT; i++ ) {
+    if( !stem_buf[i] ) continue;
+
+    blip_buffer_end_frame( stem_buf[i],
+                           machine_current->timings.tstates_per_frame );
+    count = blip_buffer_read_samples( stem_buf[i], stem_samples,
+                                      sound_framesiz,
+                                      BLIP_BUFFER_DEF_STEREO );
+    sound_render_stem_frame( i, stem_samples, count );
+  }
+}
+
+/* Generate this frame's samples into 'samples' and return how many there
+   are */
+static long
+sound_generate_frame( void )
+{
+  long count;
+
+  sound_beeper_flush();
 
   /* overlay AY sound */
   sound_ay_overlay();
@@ -706,19 +1277,46 @@ sound_frame( void )
 
     /* Read left channel into even samples, right channel into odd samples:
        LRLRLRLRLR... */
-    count = blip_buffer_read_samples( left_buf, samples, sound_framesiz, 1 );
-    blip_buffer_read_samples( right_buf, samples + 1, count, 1 );
+    count = blip_buffer_read_samples_stereo( left_buf, right_buf, samples,
+                                             sound_framesiz );
     count <<= 1;
   } else {
     count = blip_buffer_read_samples( left_buf, samples, sound_framesiz, BLIP_BUFFER_DEF_STEREO );
   }
 
-  if( settings_current.sound ) 
+  ay_change_count = 0;
+
+  return count;
+}
+
+void
+sound_frame( void )
+{
+  long count;
+
+  if( !sound_enabled )
+    return;
+
+  count = sound_generate_frame();
+
+  if( sound_render_active ) {
+    sound_render_frame( samples, count, sound_channels );
+    sound_stems_frame();
+  }
+
+  if( sound_device ) {
+#ifdef SOUND_THREAD
+    sound_thread_frame( samples, count );
+#else                           /* #ifdef SOUND_THREAD */
     sound_lowlevel_frame( samples, count );
+#endif                          /* #ifdef SOUND_THREAD */
+#ifdef SOUND_FIFO
+    sound_rate_update( count / sound_channels );
+#endif                          /* #ifdef SOUND_FIFO */
+  }
 
   if( movie_recording )
       movie_add_sound( samples, count );
-  ay_change_count = 0;
 }
 
 void
@@ -741,7 +1339,222 @@ sound_beeper( libspectrum_dword at_tstates, int on )
 
   val = beeper_ampl[on];
 
-  blip_synth_update( left_beeper_synth, at_tstates, val );
-  if( sound_stereo_ay != SOUND_STEREO_AY_NONE )
-    blip_synth_update( right_beeper_synth, at_tstates, val );
+  /* Most writes to the ULA don't change the level at all */
+  if( val == beeper_last_level ) return;
+  beeper_last_level = val;
+
+  if( beeper_change_count == BEEPER_CHANGE_MAX ) sound_beeper_flush();
+
+  beeper_change_tstates[ beeper_change_count ] = at_tstates;
+  beeper_change_level[ beeper_change_count ] = val;
+  beeper_change_count++;
+}
+
+/* Unit tests: drive scripted sequences of writes through the sound
+   generation with fixed timings and settings, and check the samples
+   produced against known hashes. Any change to this code which is meant
+   to be an optimisation should leave these unchanged. The hashes were
+   taken from this code as it is now, after the AY overlay, Blip_Buffer
+   and beeper batching changes, so they guard against later changes but
+   don't show that those ones were bit-exact */
+
+#define SOUND_TEST_FRAMES 50
+
+/* Spectrum 48K timings, so the results don't depend on the machine the
+   tests are run on */
+#define SOUND_TEST_PROCESSOR_SPEED 3500000
+#define SOUND_TEST_TSTATES_PER_FRAME 69888
+
+typedef struct sound_test_t {
+  const char *name;
+  int stereo_ay;
+  int speaker;
+  void (*frame)( int frame );
+  libspectrum_dword expected;
+} sound_test_t;
+
+/* A square wave which changes pitch every frame, with some tape noise */
+static void
+sound_test_beeper( int frame )
+{
+  libspectrum_dword t, period = 112 * ( 1 + frame % 8 );
+  int level = 0;
+
+  for( t = ( frame * 37 ) % 200; t < SOUND_TEST_TSTATES_PER_FRAME;
+       t += period ) {
+    level ^= 0x02;
+    sound_beeper( t, level | ( t % 5 == 0 ? 0x01 : 0x00 ) );
+  }
+}
+
+/* All three AY channels, with the envelope and noise in use, and
+   register changes part way through frames */
+static void
+sound_test_ay( int frame )
+{
+  static const int setup[14] = {
+    0xc0, 0x01, 0xfe, 0x00, 0x50, 0x00, 0x0f, 0x30,
+    0x0f, 0x10, 0x0a, 0x00, 0x02, 0x0e
+  };
+  libspectrum_dword t = ( frame * 1024 ) % SOUND_TEST_TSTATES_PER_FRAME;
+  int reg;
+
+  if( frame == 0 )
+    for( reg = 0; reg < 14; reg++ ) sound_ay_write( reg, setup[ reg ], 0 );
+
+  sound_ay_write( 0, ( 0x40 + frame * 13 ) & 0xff, t );
+  sound_ay_write( 10, frame & 0x0f, t + 100 );
+  if( frame % 10 == 5 ) sound_ay_write( 13, 0x0a, t + 200 );
+  if( frame % 7 == 3 ) sound_ay_write( 7, frame & 0x3f, t + 300 );
+}
+
+/* Sawtooth and triangle waves on the Specdrum and Covox */
+static void
+sound_test_dac( int frame )
+{
+  libspectrum_dword t;
+  int i = 0;
+
+  for( t = 0; t < SOUND_TEST_TSTATES_PER_FRAME; t += 80, i++ ) {
+    tstates = t;
+    sound_specdrum_write( 0xdf, ( i * 3 + frame ) & 0xff );
+    if( i % 2 ) sound_covox_write( 0xfb, ( i & 0x80 ) ? ~i & 0x7f : i & 0x7f );
+  }
+}
+
+static void
+sound_test_mixed( int frame )
+{
+  sound_test_beeper( frame );
+  sound_test_ay( frame );
+  sound_test_dac( frame );
+}
+
+/* The speaker types are TV speaker, Beeper and Unfiltered */
+static const sound_test_t sound_tests[] = {
+  { "beeper", SOUND_STEREO_AY_NONE, 0, sound_test_beeper, 0x33d301f3 },
+  { "beeper (beeper speaker)", SOUND_STEREO_AY_NONE, 1, sound_test_beeper,
+    0xc093a27f },
+  { "AY", SOUND_STEREO_AY_NONE, 0, sound_test_ay, 0x476766c3 },
+  { "AY (ACB stereo)", SOUND_STEREO_AY_ACB, 0, sound_test_ay, 0xeec469ae },
+  { "Specdrum and Covox", SOUND_STEREO_AY_NONE, 2, sound_test_dac,
+    0x3263740d },
+  { "mixed (ABC stereo)", SOUND_STEREO_AY_ABC, 0, sound_test_mixed,
+    0xce5fae23 },
+};
+
+static libspectrum_dword
+sound_test_hash( libspectrum_dword hash, const blip_sample_t *data,
+                 long count )
+{
+  long i;
+
+  /* FNV-1a over the samples as little-endian 16-bit values */
+  for( i = 0; i < count; i++ ) {
+    hash = ( hash ^ ( data[i] & 0xff ) ) * 16777619;
+    hash = ( hash ^ ( ( data[i] >> 8 ) & 0xff ) ) * 16777619;
+  }
+
+  return hash;
+}
+
+static int
+sound_run_test( const sound_test_t *test )
+{
+  libspectrum_dword hash = 2166136261U;
+  int frame;
+
+  sound_init_output( NULL, 0, test->stereo_ay, test->speaker );
+  if( !sound_enabled ) {
+    printf( "%s:%d: sound test '%s' failed to initialise\n", __FILE__,
+            __LINE__, test->name );
+    return 1;
+  }
+
+  /* Start from the same AY state every time */
+  sound_ay_reset();
+  ay_noise_rng = 1; ay_noise_toggle = 0;
+  ay_env_first = 1; ay_env_rev = 0; ay_env_counter = 15;
+
+  for( frame = 0; frame < SOUND_TEST_FRAMES; frame++ ) {
+    test->frame( frame );
+    hash = sound_test_hash( hash, samples, sound_generate_frame() );
+  }
+
+  sound_end();
+
+  if( hash != test->expected ) {
+    printf( "%s:%d: sound test '%s' gave hash 0x%08x, expected 0x%08x\n",
+            __FILE__, __LINE__, test->name, hash, test->expected );
+    return 1;
+  }
+
+  return 0;
+}
+
+int
+sound_unittest( void )
+{
+  libspectrum_dword processor_speed, tstates_per_frame, saved_tstates;
+  int capabilities, specdrum, covox_fb, emulation_speed, sound_freq;
+  int specdrum_dac, covox_dac;
+  int volume_ay, volume_beeper, volume_specdrum, volume_covox;
+  char *sound_render;
+  size_t i;
+  int r = 0;
+
+  sound_end();
+
+  processor_speed = machine_current->timings.processor_speed;
+  tstates_per_frame = machine_current->timings.tstates_per_frame;
+  capabilities = machine_current->capabilities;
+  saved_tstates = tstates;
+  specdrum_dac = machine_current->specdrum.specdrum_dac;
+  covox_dac = machine_current->covox.covox_dac;
+  specdrum = periph_is_active( PERIPH_TYPE_SPECDRUM );
+  covox_fb = periph_is_active( PERIPH_TYPE_COVOX_FB );
+  emulation_speed = settings_current.emulation_speed;
+  sound_freq = settings_current.sound_freq;
+  volume_ay = settings_current.volume_ay;
+  volume_beeper = settings_current.volume_beeper;
+  volume_specdrum = settings_current.volume_specdrum;
+  volume_covox = settings_current.volume_covox;
+  sound_render = settings_current.sound_render;
+
+  machine_current->timings.processor_speed = SOUND_TEST_PROCESSOR_SPEED;
+  machine_current->timings.tstates_per_frame = SOUND_TEST_TSTATES_PER_FRAME;
+  machine_current->capabilities |= LIBSPECTRUM_MACHINE_CAPABILITY_AY;
+  periph_activate_type( PERIPH_TYPE_SPECDRUM, 1 );
+  periph_activate_type( PERIPH_TYPE_COVOX_FB, 1 );
+  settings_current.emulation_speed = 100;
+  settings_current.sound_freq = 44100;
+  settings_current.volume_ay = 100;
+  settings_current.volume_beeper = 100;
+  settings_current.volume_specdrum = 100;
+  settings_current.volume_covox = 100;
+  settings_current.sound_render = NULL;
+
+  for( i = 0; i < ARRAY_SIZE( sound_tests ); i++ )
+    r += sound_run_test( &sound_tests[i] );
+
+  machine_current->timings.processor_speed = processor_speed;
+  machine_current->timings.tstates_per_frame = tstates_per_frame;
+  machine_current->capabilities = capabilities;
+  tstates = saved_tstates;
+  machine_current->specdrum.specdrum_dac = specdrum_dac;
+  machine_current->covox.covox_dac = covox_dac;
+  periph_activate_type( PERIPH_TYPE_SPECDRUM, specdrum );
+  periph_activate_type( PERIPH_TYPE_COVOX_FB, covox_fb );
+  settings_current.emulation_speed = emulation_speed;
+  settings_current.sound_freq = sound_freq;
+  settings_current.volume_ay = volume_ay;
+  settings_current.volume_beeper = volume_beeper;
+  settings_current.volume_specdrum = volume_specdrum;
+  settings_current.volume_covox = volume_covox;
+  settings_current.sound_render = sound_render;
+
+  sound_ay_reset();
+  sound_init( settings_current.sound_device );
+
+  return r;
 }
@@ -40,6 +40,9 @@ void sound_covox_write( libspectrum_word port, libspectrum_byte val );
 void sound_frame( void );
 void sound_beeper( libspectrum_dword at_tstates, int on );
 libspectrum_dword sound_get_effective_processor_speed( void );
+int sound_rate_controlled( void );
+
+int sound_unittest( void );
 
 extern int sound_enabled;
 extern int sound_framesiz;
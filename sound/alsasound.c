@@ -38,11 +38,14 @@
 #include <alsa/asoundlib.h>
 
 #include "settings.h"
-#include "sfifo.h"
 #include "sound.h"
 #include "spectrum.h"
 #include "ui/ui.h"
 
+#ifdef SOUND_THREAD
+#include "soundthread.h"
+#endif                          /* #ifdef SOUND_THREAD */
+
 /* Number of Spectrum frames audio latency to use */
 #define NUM_FRAMES 3
 
@@ -381,6 +384,9 @@ sound_lowlevel_frame( libspectrum_signed_word *data, int len )
   while( ( ret = snd_pcm_writei( pcm_handle, data, len ) ) != len ) {
     if( ret < 0 ) {
       snd_pcm_prepare( pcm_handle );
+#ifdef SOUND_THREAD
+      sound_ringbuf_underrun( &sound_fifo );
+#endif                          /* #ifdef SOUND_THREAD */
       if( verb )
         fprintf( stderr, "ALSA: *buffer underrun*!\n" );
     } else {
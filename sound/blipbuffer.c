@@ -60,74 +60,31 @@ blip_synth_set_volume( Blip_Synth * synth, double v )
                                    BLIP_SYNTH_RANGE ) ) );
 }
 
-#define BLIP_FWD( i )                     \
-	t0 = i0 * delta + buf[fwd + i];   \
-	t1 = imp[BLIP_RES * (i + 1)] * delta + buf[fwd + 1 + i]; \
-	i0 = imp[BLIP_RES * (i + 2)];          \
-	buf[fwd + i] = t0;                     \
-	buf[fwd + 1 + i] = t1
-
-#define BLIP_REV( r ) \
-	t0 = i0 * delta + buf[rev - r];   \
-	t1 = imp[BLIP_RES * r] * delta + buf[rev + 1 - r];   \
-	i0 = imp[BLIP_RES * (r - 1)];          \
-	buf[rev - r] = t0;                     \
-	buf[rev + 1 - r] = t1
-
+/* Each phase's kernel is a contiguous row of BLIP_WIDEST_IMPULSE_ taps
+   (see _blip_synth_build_kernels()), so this is a fixed length
+   multiply-add which the compiler can vectorise */
 inline void
 blip_synth_offset_resampled( Blip_Synth * synth, blip_resampled_time_t time,
                              int delta, Blip_Buffer * blip_buf )
 {
-  int phase, fwd, rev, mid;
+  int phase, i;
+
+  const short *kernel;
 
-  imp_t *imp;
+  buf_t_ *buf;
 
-  long *buf, i0, t0, t1;
+  int scaled_delta = delta * synth->impl.delta_factor;
 
-  delta *= synth->impl.delta_factor;
   phase =
     ( int )( time >> ( BLIP_BUFFER_ACCURACY - BLIP_PHASE_BITS ) &
              ( BLIP_RES - 1 ) );
-  imp = synth->impulses + BLIP_RES - phase;
+  kernel = synth->impl.kernels + phase * BLIP_WIDEST_IMPULSE_;
   buf = blip_buf->buffer_ + ( time >> BLIP_BUFFER_ACCURACY );
-  i0 = *imp;
-
-  fwd = ( BLIP_WIDEST_IMPULSE_ - BLIP_SYNTH_QUALITY ) / 2;
-  rev = fwd + BLIP_SYNTH_QUALITY - 2;
-
-  BLIP_FWD( 0 );
-  if( BLIP_SYNTH_QUALITY > 8 ) {
-    BLIP_FWD( 2 );
-  }
-  if( BLIP_SYNTH_QUALITY > 12 ) {
-    BLIP_FWD( 4 );
-  }
-
-  mid = BLIP_SYNTH_QUALITY / 2 - 1;
-  t0 = i0 * delta + buf[fwd + mid - 1];
-  t1 = imp[BLIP_RES * mid] * delta + buf[fwd + mid];
-  imp = synth->impulses + phase;
-  i0 = imp[BLIP_RES * mid];
-  buf[fwd + mid - 1] = t0;
-  buf[fwd + mid] = t1;
 
-  if( BLIP_SYNTH_QUALITY > 12 ) {
-    BLIP_REV( 6 );
-  }
-  if( BLIP_SYNTH_QUALITY > 8 ) {
-    BLIP_REV( 4 );
-  }
-  BLIP_REV( 2 );
-
-  t0 = i0 * delta + buf[rev];
-  t1 = *imp * delta + buf[rev + 1];
-  buf[rev] = t0;
-  buf[rev + 1] = t1;
+  for( i = 0; i < BLIP_WIDEST_IMPULSE_; i++ )
+    buf[i] += kernel[i] * scaled_delta;
 }
 
-#undef BLIP_FWD
-#undef BLIP_REV
-
 void
 blip_synth_update( Blip_Synth * synth, blip_time_t t, int amp )
 {
@@ -212,6 +169,12 @@ blip_synth_init( Blip_Synth * synth )
               1 ) * sizeof( imp_t ) * 4 );
   if( synth->impulses ) {
     _blip_synth_init( &synth->impl, ( short * )synth->impulses );       /* sorry, somewhere imp_t, somewhere short ???? */
+    synth->impl.kernels =
+      calloc( BLIP_RES * BLIP_WIDEST_IMPULSE_, sizeof( short ) );
+    if( !synth->impl.kernels ) {
+      free( synth->impulses );
+      synth->impulses = NULL;
+    }
   }
 }
 
@@ -222,6 +185,10 @@ blip_synth_end( Blip_Synth * synth )
     free( synth->impulses );
     synth->impulses = NULL;
   }
+  if( synth->impl.kernels ) {
+    free( synth->impl.kernels );
+    synth->impl.kernels = NULL;
+  }
 }
 
 Blip_Synth *
@@ -366,6 +333,7 @@ _blip_synth_init( Blip_Synth_ * synth_, short *p )
   synth_->buf = NULL;
   synth_->last_amp = 0;
   synth_->delta_factor = 0;
+  synth_->kernels = NULL;
 }
 
 #define PI 3.1415926535897932384626433832795029
@@ -434,6 +402,39 @@ blip_eq_generate( blip_eq_t * eq, float *out, int count )
 
 }
 
+/* Unpack the impulses into one row per phase, in the order the taps are
+   added to the buffer. The first half of each kernel runs forwards through
+   the impulses from the mirror image phase, the second half backwards from
+   the phase itself; the rows are padded with zeros either side to the
+   widest impulse */
+static void
+_blip_synth_build_kernels( Blip_Synth_ * synth_ )
+{
+  int phase, i, fwd;
+
+  short *kernel;
+
+  const short *imp;
+
+  if( !synth_->kernels )
+    return;
+
+  fwd = ( BLIP_WIDEST_IMPULSE_ - BLIP_SYNTH_QUALITY ) / 2;
+
+  for( phase = 0; phase < BLIP_RES; phase++ ) {
+    kernel = synth_->kernels + phase * BLIP_WIDEST_IMPULSE_;
+    memset( kernel, 0, BLIP_WIDEST_IMPULSE_ * sizeof( *kernel ) );
+
+    imp = synth_->impulses + BLIP_RES - phase;
+    for( i = 0; i < BLIP_SYNTH_QUALITY / 2; i++ )
+      kernel[ fwd + i ] = imp[ BLIP_RES * i ];
+
+    imp = synth_->impulses + phase;
+    for( i = BLIP_SYNTH_QUALITY / 2; i < BLIP_SYNTH_QUALITY; i++ )
+      kernel[ fwd + i ] = imp[ BLIP_RES * ( BLIP_SYNTH_QUALITY - 1 - i ) ];
+  }
+}
+
 void
 _blip_synth_adjust_impulse( Blip_Synth_ * synth_ )
 {
@@ -455,6 +456,8 @@ _blip_synth_adjust_impulse( Blip_Synth_ * synth_ )
 
     synth_->impulses[size - BLIP_RES + p] += error;
   }
+
+  _blip_synth_build_kernels( synth_ );
 }
 
 
@@ -560,6 +563,17 @@ _blip_synth_volume_unit( Blip_Synth_ * synth_, double new_unit )
   }
 }
 
+/* Convert an accumulator value to an output sample, saturating if
+   necessary */
+static inline blip_sample_t
+blip_sample_clamp( long s )
+{
+  if( ( blip_sample_t ) s != s )
+    return ( blip_sample_t ) ( 0x7FFF - ( s >> 24 ) );
+
+  return ( blip_sample_t ) s;
+}
+
 long
 blip_buffer_read_samples( Blip_Buffer * buff, blip_sample_t * out,
                           long max_samples, int stereo )
@@ -578,39 +592,74 @@ blip_buffer_read_samples( Blip_Buffer * buff, blip_sample_t * out,
 
     buf_t_ *in = buff->buffer_;
 
-    if( !stereo ) {
-      int n;
+    int step = stereo ? 2 : 1;
 
-      for( n = count; n--; ) {
-        long s = accum >> sample_shift;
+    long n;
 
-        accum -= accum >> my_bass_shift;
-        accum += *in++;
-        *out++ = ( blip_sample_t ) s;
+    for( n = 0; n < count; n++ ) {
+      long s = accum >> sample_shift;
 
-        /* clamp sample */
-        if( ( blip_sample_t ) s != s )
-          out[-1] = ( blip_sample_t ) ( 0x7FFF - ( s >> 24 ) );
-      }
-    } else {
-      int n;
+      accum -= accum >> my_bass_shift;
+      accum += in[n];
+      out[n * step] = blip_sample_clamp( s );
+    }
 
-      for( n = count; n--; ) {
-        long s = accum >> sample_shift;
+    buff->reader_accum = accum;
+    blip_buffer_remove_samples( buff, count );
+  }
 
-        accum -= accum >> my_bass_shift;
-        accum += *in++;
-        *out = ( blip_sample_t ) s;
-        out += 2;
+  return count;
+}
 
-        /* clamp sample */
-        if( ( blip_sample_t ) s != s )
-          out[-2] = ( blip_sample_t ) ( 0x7FFF - ( s >> 24 ) );
-      }
+/*  Read at most 'max_samples' from each of 'left' and 'right' in a single
+ pass, interleaving them into 'out'. Equivalent to two calls to
+ blip_buffer_read_samples() with 'stereo' set */
+long
+blip_buffer_read_samples_stereo( Blip_Buffer * left, Blip_Buffer * right,
+                                 blip_sample_t * out, long max_samples )
+{
+  long count = blip_buffer_samples_avail( left );
+
+  if( blip_buffer_samples_avail( right ) < count )
+    count = blip_buffer_samples_avail( right );
+  if( count > max_samples )
+    count = max_samples;
+
+  if( count ) {
+    int sample_shift = BLIP_SAMPLE_BITS - 16;
+
+    int left_bass_shift = left->bass_shift;
+
+    int right_bass_shift = right->bass_shift;
+
+    /* The two channels are independent, so their updates can overlap */
+    long left_accum = left->reader_accum;
+
+    long right_accum = right->reader_accum;
+
+    buf_t_ *left_in = left->buffer_;
+
+    buf_t_ *right_in = right->buffer_;
+
+    long n;
+
+    for( n = 0; n < count; n++ ) {
+      long l = left_accum >> sample_shift;
+
+      long r = right_accum >> sample_shift;
+
+      left_accum -= left_accum >> left_bass_shift;
+      right_accum -= right_accum >> right_bass_shift;
+      left_accum += left_in[n];
+      right_accum += right_in[n];
+      out[2 * n] = blip_sample_clamp( l );
+      out[2 * n + 1] = blip_sample_clamp( r );
     }
 
-    buff->reader_accum = accum;
-    blip_buffer_remove_samples( buff, count );
+    left->reader_accum = left_accum;
+    right->reader_accum = right_accum;
+    blip_buffer_remove_samples( left, count );
+    blip_buffer_remove_samples( right, count );
   }
 
   return count;
@@ -49,7 +49,10 @@ typedef short blip_sample_t;
 
 typedef const char *blargg_err_t;
 
-typedef long buf_t_;
+/* As in the original Blip_Buffer, 32 bits is enough for the buffer: samples
+   are BLIP_SAMPLE_BITS wide. Keeping it narrow lets the impulse and read
+   loops work on twice as many samples per vector */
+typedef int buf_t_;
 
 typedef unsigned long blip_resampled_time_t;
 
@@ -100,6 +103,14 @@ void blip_buffer_end_frame( Blip_Buffer * buff, blip_time_t time );
 long blip_buffer_read_samples( Blip_Buffer * buff, blip_sample_t * dest,
                                long max_samples, int stereo );
 
+/*  Read at most 'max_samples' out of each of two buffers, interleaving them
+ into 'dest' as left, right, left, right... Returns the number of samples
+ read from each buffer.
+*/
+long blip_buffer_read_samples_stereo( Blip_Buffer * left, Blip_Buffer * right,
+                                      blip_sample_t * dest,
+                                      long max_samples );
+
 /*  Additional optional features */
 
 /*  Set frequency high-pass filter frequency, where higher values reduce bass more */
@@ -156,6 +167,7 @@ typedef struct Blip_Synth_s_ {
   Blip_Buffer *buf;
   int last_amp;
   int delta_factor;
+  short *kernels;   /* BLIP_RES rows of BLIP_WIDEST_IMPULSE_ taps */
 } Blip_Synth_;
 
 int _blip_synth_impulses_size( Blip_Synth_ * synth_ );
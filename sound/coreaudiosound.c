@@ -20,18 +20,19 @@
 #include "config.h"
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <AssertMacros.h>
 
 #include <AudioToolbox/AudioToolbox.h>
 
+#include "ringbuf.h"
 #include "settings.h"
-#include "sfifo.h"
 #include "sound.h"
 #include "ui/ui.h"
 
-sfifo_t sound_fifo;
+sound_ringbuf_t sound_fifo;
 
 /* Number of Spectrum frames audio latency to use */
 #define NUM_FRAMES 2
@@ -113,7 +114,6 @@ sound_lowlevel_init( const char *dev, int *freqptr, int *stereoptr )
 {
   OSStatus err = kAudioHardwareNoError;
   AudioDeviceID device = kAudioObjectUnknown; /* the default device */
-  int error;
   float hz;
   int sound_framesiz;
 
@@ -200,12 +200,11 @@ sound_lowlevel_init( const char *dev, int *freqptr, int *stereoptr )
   if( hz > 100.0 ) hz = 100.0;
   sound_framesiz = deviceFormat.mSampleRate / hz;
 
-  if( ( error = sfifo_init( &sound_fifo, NUM_FRAMES
-                                         * deviceFormat.mBytesPerFrame
-                                         * deviceFormat.mChannelsPerFrame
-                                         * sound_framesiz + 1 ) ) ) {
-    ui_error( UI_ERROR_ERROR, "Problem initialising sound fifo: %s",
-              strerror ( error ) );
+  if( sound_ringbuf_init( &sound_fifo, NUM_FRAMES * sound_framesiz +
+                          deviceFormat.mSampleRate *
+                          settings_current.sound_latency / 1000,
+                          deviceFormat.mChannelsPerFrame ) ) {
+    ui_error( UI_ERROR_ERROR, "Problem initialising sound fifo" );
     return 1;
   }
 
@@ -238,32 +237,20 @@ sound_lowlevel_end( void )
     ui_error( UI_ERROR_ERROR, "AudioComponentInstanceDispose=%ld", (long)err );
   }
 
-  sfifo_flush( &sound_fifo );
-  sfifo_close( &sound_fifo );
+  sound_ringbuf_end( &sound_fifo );
 }
 
 /* Copy data to fifo */
 void
 sound_lowlevel_frame( libspectrum_signed_word *data, int len )
 {
-  int i = 0;
+  size_t frames = len / sound_fifo.channels;
+  size_t i;
 
-  /* Convert to bytes */
-  libspectrum_signed_byte* bytes = (libspectrum_signed_byte*)data;
-  len <<= 1;
-
-  while( len ) {
-    if( ( i = sfifo_write( &sound_fifo, bytes, len ) ) < 0 ) {
-      break;
-    } else if( !i ) {
-      usleep( 10000 );
-    }
-    bytes += i;
-    len -= i;
-  }
-  if( i < 0 ) {
-    ui_error( UI_ERROR_ERROR, "Couldn't write sound fifo: %s",
-              strerror( i ) );
+  while( ( i = sound_ringbuf_write( &sound_fifo, data, frames ) ) < frames ) {
+    data += i * sound_fifo.channels;
+    frames -= i;
+    sound_ringbuf_wait_space( &sound_fifo, frames );
   }
 
   if( !audio_output_started ) {
@@ -280,10 +267,6 @@ sound_lowlevel_frame( libspectrum_signed_word *data, int len )
   }
 }
 
-#ifndef MIN
-#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
-#endif
-
 /* This is the audio processing callback. */
 OSStatus coreaudiowrite( void *inRefCon,
                          AudioUnitRenderActionFlags *ioActionFlags,
@@ -292,25 +275,28 @@ OSStatus coreaudiowrite( void *inRefCon,
                          UInt32 inNumberFrames,                       
                          AudioBufferList *ioData )
 {
-  int f;
-  int len = deviceFormat.mBytesPerFrame * inNumberFrames;
+  size_t framesize = deviceFormat.mBytesPerFrame;
+  size_t frames = inNumberFrames;
   uint8_t* out = ioData->mBuffers[0].mData;
 
-  /* Try to only read an even number of bytes so as not to fragment a sample */
-  len = MIN( len, sfifo_used( &sound_fifo ) );
-  len &= sound_stereo_ay != SOUND_STEREO_AY_NONE ? 0xfffc : 0xfffe;
+  /* Copy straight out of the ring buffer; this takes at most two passes */
+  while( frames ) {
+    const libspectrum_signed_word *ptr;
+    size_t count = sound_ringbuf_read_reserve( &sound_fifo, &ptr );
+
+    if( !count ) break;
+    if( count > frames ) count = frames;
 
-  /* Read input_size bytes from fifo into sound stream */
-  while( ( f = sfifo_read( &sound_fifo, out, len ) ) > 0 ) {
-    out += f;
-    len -= f;
+    memcpy( out, ptr, count * framesize );
+    sound_ringbuf_read_commit( &sound_fifo, count );
+    out += count * framesize;
+    frames -= count;
   }
 
   /* If we ran out of sound, make do with silence :( */
-  if( f < 0 ) {
-    for( f=0; f<len; f++ ) {
-      *out++ = 0;
-    }
+  if( frames ) {
+    memset( out, 0, frames * framesize );
+    sound_ringbuf_underrun( &sound_fifo );
   }
 
   return noErr;
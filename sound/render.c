@@ -0,0 +1,276 @@
+/* render.c: Render the sound output to WAV files
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "compat.h"
+#include "fuse.h"
+#include "render.h"
+#include "settings.h"
+#include "ui/ui.h"
+#include "utils.h"
+
+/* Size of a canonical PCM WAV header */
+#define RENDER_HEADER_LENGTH 44
+
+/* Offsets of the fields we can only fill in once rendering has finished */
+#define RENDER_RIFF_LENGTH_OFFSET 4
+#define RENDER_DATA_LENGTH_OFFSET 40
+
+/* Samples are converted to little-endian bytes in chunks of this many */
+#define RENDER_CHUNK_SAMPLES 4096
+
+int sound_render_active = 0;
+int sound_render_stems = 0;
+
+static sound_render_file_t render_mix;
+static sound_render_file_t render_stem[ SOUND_RENDER_STEM_COUNT ];
+
+static libspectrum_dword render_frames;
+
+static const char * const stem_names[ SOUND_RENDER_STEM_COUNT ] = {
+  "beeper", "ay-a", "ay-b", "ay-c", "specdrum", "covox",
+};
+
+static void
+write_dword( libspectrum_byte *ptr, libspectrum_dword value )
+{
+  ptr[0] = value & 0xff; ptr[1] = ( value >> 8 ) & 0xff;
+  ptr[2] = ( value >> 16 ) & 0xff; ptr[3] = value >> 24;
+}
+
+static void
+write_word( libspectrum_byte *ptr, libspectrum_word value )
+{
+  ptr[0] = value & 0xff; ptr[1] = value >> 8;
+}
+
+int
+sound_render_file_open( sound_render_file_t *file, const char *filename,
+                        int freq, int channels )
+{
+  libspectrum_byte header[ RENDER_HEADER_LENGTH ];
+
+  file->f = fopen( filename, "wb" );
+  if( !file->f ) {
+    ui_error( UI_ERROR_ERROR, "error opening '%s': %s", filename,
+              strerror( errno ) );
+    return 1;
+  }
+
+  file->filename = utils_safe_strdup( filename );
+  file->channels = channels;
+  file->data_length = 0;
+
+  /* The RIFF and data chunk lengths are filled in by
+     sound_render_file_close() */
+  memcpy( header, "RIFF", 4 );
+  write_dword( header + RENDER_RIFF_LENGTH_OFFSET, 0 );
+  memcpy( header + 8, "WAVEfmt ", 8 );
+  write_dword( header + 16, 16 );
+  write_word( header + 20, 1 );           /* PCM */
+  write_word( header + 22, channels );
+  write_dword( header + 24, freq );
+  write_dword( header + 28, freq * channels * 2 );
+  write_word( header + 32, channels * 2 );
+  write_word( header + 34, 16 );
+  memcpy( header + 36, "data", 4 );
+  write_dword( header + RENDER_DATA_LENGTH_OFFSET, 0 );
+
+  if( fwrite( header, RENDER_HEADER_LENGTH, 1, file->f ) != 1 ) {
+    ui_error( UI_ERROR_ERROR, "error writing to '%s'", filename );
+    fclose( file->f ); file->f = NULL;
+    libspectrum_free( file->filename ); file->filename = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+void
+sound_render_file_write( sound_render_file_t *file,
+                         const libspectrum_signed_word *data, long len,
+                         int channels )
+{
+  libspectrum_byte buffer[ RENDER_CHUNK_SAMPLES * 2 ];
+  long frames, i, j, n;
+  int sample;
+
+  if( !file->f ) return;
+
+  frames = len / channels;
+
+  while( frames ) {
+
+    n = frames;
+    if( n * file->channels > RENDER_CHUNK_SAMPLES )
+      n = RENDER_CHUNK_SAMPLES / file->channels;
+
+    for( i = 0, j = 0; i < n; i++, data += channels ) {
+      if( channels == file->channels ) {
+        write_word( buffer + j, data[0] ); j += 2;
+        if( channels == 2 ) { write_word( buffer + j, data[1] ); j += 2; }
+      } else if( channels == 2 ) {
+        /* Stereo was turned off part way through */
+        sample = ( data[0] + data[1] ) / 2;
+        write_word( buffer + j, sample ); j += 2;
+      } else {
+        /* And the other way round */
+        write_word( buffer + j, data[0] ); j += 2;
+        write_word( buffer + j, data[0] ); j += 2;
+      }
+    }
+
+    if( fwrite( buffer, j, 1, file->f ) != 1 ) {
+      ui_error( UI_ERROR_ERROR, "error writing to '%s'", file->filename );
+      fclose( file->f ); file->f = NULL;
+      return;
+    }
+
+    file->data_length += j;
+    frames -= n;
+  }
+}
+
+void
+sound_render_file_close( sound_render_file_t *file )
+{
+  libspectrum_byte length[4];
+
+  if( file->f ) {
+    write_dword( length, file->data_length + RENDER_HEADER_LENGTH - 8 );
+    if( fseek( file->f, RENDER_RIFF_LENGTH_OFFSET, SEEK_SET ) ||
+        fwrite( length, 4, 1, file->f ) != 1 )
+      ui_error( UI_ERROR_ERROR, "error writing to '%s'", file->filename );
+
+    write_dword( length, file->data_length );
+    if( fseek( file->f, RENDER_DATA_LENGTH_OFFSET, SEEK_SET ) ||
+        fwrite( length, 4, 1, file->f ) != 1 )
+      ui_error( UI_ERROR_ERROR, "error writing to '%s'", file->filename );
+
+    if( fclose( file->f ) )
+      ui_error( UI_ERROR_ERROR, "error closing '%s': %s", file->filename,
+                strerror( errno ) );
+    file->f = NULL;
+  }
+
+  libspectrum_free( file->filename ); file->filename = NULL;
+}
+
+/* "foo.wav" gives "foo-beeper.wav" and so on */
+static char*
+stem_filename( const char *filename, sound_render_stem stem )
+{
+  const char *extension = strrchr( filename, '.' );
+  const char *separator = strrchr( filename, FUSE_DIR_SEP_CHR );
+  size_t base_length, length;
+  char *buffer;
+
+  if( !extension || ( separator && extension < separator ) )
+    extension = filename + strlen( filename );
+
+  base_length = extension - filename;
+  length = strlen( filename ) + strlen( stem_names[ stem ] ) + 2;
+  buffer = libspectrum_new( char, length );
+
+  snprintf( buffer, length, "%.*s-%s%s", (int)base_length, filename,
+            stem_names[ stem ], extension );
+
+  return buffer;
+}
+
+/* Start writing the mixed output to 'filename' and, if 'stems' is set,
+   each individual sound source to a mono file alongside it */
+int
+sound_render_start( const char *filename, int freq, int channels, int stems )
+{
+  char *stem_file;
+  int i, error;
+
+  if( sound_render_active ) return 0;
+
+  if( sound_render_file_open( &render_mix, filename, freq, channels ) ) return 1;
+
+  if( stems ) {
+    for( i = 0; i < SOUND_RENDER_STEM_COUNT; i++ ) {
+      stem_file = stem_filename( filename, i );
+      error = sound_render_file_open( &render_stem[i], stem_file, freq, 1 );
+      libspectrum_free( stem_file );
+      if( error ) {
+        while( i-- ) sound_render_file_close( &render_stem[i] );
+        sound_render_file_close( &render_mix );
+        return 1;
+      }
+    }
+  }
+
+  render_frames = 0;
+  sound_render_stems = stems;
+  sound_render_active = 1;
+
+  return 0;
+}
+
+/* Write one Spectrum frame's worth of mixed output, and stop the emulator
+   once the requested number of frames has been rendered */
+void
+sound_render_frame( const libspectrum_signed_word *data, long len,
+                    int channels )
+{
+  if( !sound_render_active ) return;
+
+  sound_render_file_write( &render_mix, data, len, channels );
+
+  render_frames++;
+  if( settings_current.sound_render_frames &&
+      render_frames >= settings_current.sound_render_frames )
+    fuse_exiting = 1;
+}
+
+void
+sound_render_stem_frame( sound_render_stem stem,
+                         const libspectrum_signed_word *data, long len )
+{
+  if( !sound_render_active || !sound_render_stems ) return;
+
+  sound_render_file_write( &render_stem[ stem ], data, len, 1 );
+}
+
+void
+sound_render_stop( void )
+{
+  int i;
+
+  if( !sound_render_active ) return;
+
+  sound_render_file_close( &render_mix );
+  if( sound_render_stems )
+    for( i = 0; i < SOUND_RENDER_STEM_COUNT; i++ )
+      sound_render_file_close( &render_stem[i] );
+
+  sound_render_active = sound_render_stems = 0;
+}
@@ -0,0 +1,70 @@
+/* render.h: Render the sound output to WAV files
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_SOUND_RENDER_H
+#define FUSE_SOUND_RENDER_H
+
+#include <stdio.h>
+
+#include <libspectrum.h>
+
+/* A WAV file being written */
+typedef struct sound_render_file_t {
+  FILE *f;
+  char *filename;
+  int channels;
+  libspectrum_dword data_length;
+} sound_render_file_t;
+
+int sound_render_file_open( sound_render_file_t *file, const char *filename,
+                            int freq, int channels );
+void sound_render_file_write( sound_render_file_t *file,
+                              const libspectrum_signed_word *data, long len,
+                              int channels );
+void sound_render_file_close( sound_render_file_t *file );
+
+/* The sound sources which can be written to their own files */
+typedef enum sound_render_stem {
+  SOUND_RENDER_STEM_BEEPER,
+  SOUND_RENDER_STEM_AY_A,
+  SOUND_RENDER_STEM_AY_B,
+  SOUND_RENDER_STEM_AY_C,
+  SOUND_RENDER_STEM_SPECDRUM,
+  SOUND_RENDER_STEM_COVOX,
+
+  SOUND_RENDER_STEM_COUNT
+} sound_render_stem;
+
+extern int sound_render_active;
+extern int sound_render_stems;
+
+int sound_render_start( const char *filename, int freq, int channels,
+                        int stems );
+void sound_render_frame( const libspectrum_signed_word *data, long len,
+                         int channels );
+void sound_render_stem_frame( sound_render_stem stem,
+                              const libspectrum_signed_word *data,
+                              long len );
+void sound_render_stop( void );
+
+#endif			/* #ifndef FUSE_SOUND_RENDER_H */
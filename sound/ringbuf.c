@@ -0,0 +1,351 @@
+/* ringbuf.c: Single producer, single consumer ring buffer for sound samples
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <sys/time.h>
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+#include "ringbuf.h"
+#include "timer/timer.h"
+
+/* The indices are plain size_t accessed through the compiler's atomic
+   builtins where available, falling back to C11 atomics otherwise */
+#if defined( __ATOMIC_ACQUIRE )
+
+#define ringbuf_load_acquire( p ) __atomic_load_n( p, __ATOMIC_ACQUIRE )
+#define ringbuf_load_relaxed( p ) __atomic_load_n( p, __ATOMIC_RELAXED )
+#define ringbuf_store_release( p, v ) \
+  __atomic_store_n( p, v, __ATOMIC_RELEASE )
+#define ringbuf_load_flag( p ) __atomic_load_n( p, __ATOMIC_RELAXED )
+#define ringbuf_store_flag( p, v ) __atomic_store_n( p, v, __ATOMIC_SEQ_CST )
+#define ringbuf_fence() __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
+#elif defined( __STDC_VERSION__ ) && __STDC_VERSION__ >= 201112L && \
+      !defined( __STDC_NO_ATOMICS__ )
+
+#include <stdatomic.h>
+
+#define ringbuf_load_acquire( p ) \
+  atomic_load_explicit( (_Atomic size_t*)(p), memory_order_acquire )
+#define ringbuf_load_relaxed( p ) \
+  atomic_load_explicit( (_Atomic size_t*)(p), memory_order_relaxed )
+#define ringbuf_store_release( p, v ) \
+  atomic_store_explicit( (_Atomic size_t*)(p), v, memory_order_release )
+#define ringbuf_load_flag( p ) \
+  atomic_load_explicit( (_Atomic int*)(p), memory_order_relaxed )
+#define ringbuf_store_flag( p, v ) \
+  atomic_store_explicit( (_Atomic int*)(p), v, memory_order_seq_cst )
+#define ringbuf_fence() atomic_thread_fence( memory_order_seq_cst )
+
+#else
+
+#error "No atomic operations available for the sound ring buffer"
+
+#endif
+
+/* How long to wait for the other side before rechecking the buffer. The
+   waiting protocol means we shouldn't miss a wakeup, but this stops us
+   hanging forever if the sound device stops consuming data */
+static const int RINGBUF_WAIT_MS = 10;
+
+int
+sound_ringbuf_init( sound_ringbuf_t *rb, size_t frames, int channels )
+{
+  size_t allocated = 1;
+
+  if( !frames || channels < 1 ) return 1;
+
+  while( allocated < frames ) allocated <<= 1;
+
+  rb->data = libspectrum_new0( libspectrum_signed_word, allocated * channels );
+  rb->channels = channels;
+  rb->size = frames;
+  rb->mask = allocated - 1;
+  rb->head = rb->tail = 0;
+  rb->space_waiter = rb->data_waiter = 0;
+  rb->closed = 0;
+  rb->underruns = 0;
+
+#ifdef HAVE_PTHREAD
+  if( pthread_mutex_init( &rb->lock, NULL ) ) {
+    libspectrum_free( rb->data ); rb->data = NULL;
+    return 1;
+  }
+  pthread_cond_init( &rb->space_cond, NULL );
+  pthread_cond_init( &rb->data_cond, NULL );
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+  return 0;
+}
+
+void
+sound_ringbuf_end( sound_ringbuf_t *rb )
+{
+  if( !rb->data ) return;
+
+#ifdef HAVE_PTHREAD
+  pthread_cond_destroy( &rb->data_cond );
+  pthread_cond_destroy( &rb->space_cond );
+  pthread_mutex_destroy( &rb->lock );
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+  libspectrum_free( rb->data ); rb->data = NULL;
+}
+
+/* Discard everything in the buffer. Must only be called by the consumer,
+   or when the consumer is known not to be running */
+void
+sound_ringbuf_flush( sound_ringbuf_t *rb )
+{
+  sound_ringbuf_read_commit( rb, sound_ringbuf_used( rb ) );
+}
+
+size_t
+sound_ringbuf_used( sound_ringbuf_t *rb )
+{
+  return ringbuf_load_acquire( &rb->head ) - ringbuf_load_acquire( &rb->tail );
+}
+
+size_t
+sound_ringbuf_space( sound_ringbuf_t *rb )
+{
+  return rb->size - sound_ringbuf_used( rb );
+}
+
+void
+sound_ringbuf_underrun( sound_ringbuf_t *rb )
+{
+  ringbuf_store_release( &rb->underruns,
+                         ringbuf_load_relaxed( &rb->underruns ) + 1 );
+}
+
+size_t
+sound_ringbuf_underruns( sound_ringbuf_t *rb )
+{
+  return ringbuf_load_acquire( &rb->underruns );
+}
+
+#ifdef HAVE_PTHREAD
+
+static void
+ringbuf_wake( sound_ringbuf_t *rb, int *waiter, pthread_cond_t *cond )
+{
+  /* Pairs with the fence in ringbuf_wait(): either the waiter sees our
+     update to the index, or we see its flag and signal it */
+  ringbuf_fence();
+  if( !ringbuf_load_flag( waiter ) ) return;
+
+  pthread_mutex_lock( &rb->lock );
+  pthread_cond_signal( cond );
+  pthread_mutex_unlock( &rb->lock );
+}
+
+static void
+ringbuf_timed_wait( sound_ringbuf_t *rb, pthread_cond_t *cond )
+{
+  struct timeval now;
+  struct timespec until;
+
+  gettimeofday( &now, NULL );
+  until.tv_sec = now.tv_sec;
+  until.tv_nsec = now.tv_usec * 1000 + RINGBUF_WAIT_MS * 1000000L;
+  if( until.tv_nsec >= 1000000000L ) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000L;
+  }
+
+  pthread_cond_timedwait( cond, &rb->lock, &until );
+}
+
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+size_t
+sound_ringbuf_write_reserve( sound_ringbuf_t *rb,
+                             libspectrum_signed_word **ptr )
+{
+  size_t head = ringbuf_load_relaxed( &rb->head );
+  size_t space = rb->size - ( head - ringbuf_load_acquire( &rb->tail ) );
+  size_t contiguous = rb->mask + 1 - ( head & rb->mask );
+
+  *ptr = rb->data + ( head & rb->mask ) * rb->channels;
+
+  return space < contiguous ? space : contiguous;
+}
+
+void
+sound_ringbuf_write_commit( sound_ringbuf_t *rb, size_t frames )
+{
+  if( !frames ) return;
+
+  ringbuf_store_release( &rb->head,
+                         ringbuf_load_relaxed( &rb->head ) + frames );
+
+#ifdef HAVE_PTHREAD
+  ringbuf_wake( rb, &rb->data_waiter, &rb->data_cond );
+#endif                          /* #ifdef HAVE_PTHREAD */
+}
+
+size_t
+sound_ringbuf_read_reserve( sound_ringbuf_t *rb,
+                            const libspectrum_signed_word **ptr )
+{
+  size_t tail = ringbuf_load_relaxed( &rb->tail );
+  size_t used = ringbuf_load_acquire( &rb->head ) - tail;
+  size_t contiguous = rb->mask + 1 - ( tail & rb->mask );
+
+  *ptr = rb->data + ( tail & rb->mask ) * rb->channels;
+
+  return used < contiguous ? used : contiguous;
+}
+
+void
+sound_ringbuf_read_commit( sound_ringbuf_t *rb, size_t frames )
+{
+  if( !frames ) return;
+
+  ringbuf_store_release( &rb->tail,
+                         ringbuf_load_relaxed( &rb->tail ) + frames );
+
+#ifdef HAVE_PTHREAD
+  ringbuf_wake( rb, &rb->space_waiter, &rb->space_cond );
+#endif                          /* #ifdef HAVE_PTHREAD */
+}
+
+size_t
+sound_ringbuf_write( sound_ringbuf_t *rb, const libspectrum_signed_word *data,
+                     size_t frames )
+{
+  size_t done = 0;
+
+  /* At most two passes: up to the end of the storage, then from the start */
+  while( done < frames ) {
+    libspectrum_signed_word *ptr;
+    size_t count = sound_ringbuf_write_reserve( rb, &ptr );
+
+    if( !count ) break;
+    if( count > frames - done ) count = frames - done;
+
+    memcpy( ptr, data + done * rb->channels,
+            count * rb->channels * sizeof( *ptr ) );
+    sound_ringbuf_write_commit( rb, count );
+    done += count;
+  }
+
+  return done;
+}
+
+size_t
+sound_ringbuf_read( sound_ringbuf_t *rb, libspectrum_signed_word *data,
+                    size_t frames )
+{
+  size_t done = 0;
+
+  while( done < frames ) {
+    const libspectrum_signed_word *ptr;
+    size_t count = sound_ringbuf_read_reserve( rb, &ptr );
+
+    if( !count ) break;
+    if( count > frames - done ) count = frames - done;
+
+    memcpy( data + done * rb->channels, ptr,
+            count * rb->channels * sizeof( *ptr ) );
+    sound_ringbuf_read_commit( rb, count );
+    done += count;
+  }
+
+  return done;
+}
+
+/* Wait until there are at least 'frames' frames of space (if 'space' is
+   set) or of data, or the buffer is closed */
+static void
+ringbuf_wait( sound_ringbuf_t *rb, size_t frames, int space )
+{
+  size_t (*available)( sound_ringbuf_t *rb ) =
+    space ? sound_ringbuf_space : sound_ringbuf_used;
+
+  if( frames > rb->size ) frames = rb->size;
+
+  if( available( rb ) >= frames ) return;
+
+#ifdef HAVE_PTHREAD
+  {
+    int *waiter = space ? &rb->space_waiter : &rb->data_waiter;
+    pthread_cond_t *cond = space ? &rb->space_cond : &rb->data_cond;
+
+    pthread_mutex_lock( &rb->lock );
+
+    ringbuf_store_flag( waiter, 1 );
+    ringbuf_fence();
+
+    while( available( rb ) < frames && !ringbuf_load_flag( &rb->closed ) )
+      ringbuf_timed_wait( rb, cond );
+
+    ringbuf_store_flag( waiter, 0 );
+
+    pthread_mutex_unlock( &rb->lock );
+  }
+#else                           /* #ifdef HAVE_PTHREAD */
+
+  while( available( rb ) < frames && !ringbuf_load_flag( &rb->closed ) )
+    timer_sleep( 1 );
+
+#endif                          /* #ifdef HAVE_PTHREAD */
+}
+
+void
+sound_ringbuf_wait_space( sound_ringbuf_t *rb, size_t frames )
+{
+  ringbuf_wait( rb, frames, 1 );
+}
+
+size_t
+sound_ringbuf_wait_data( sound_ringbuf_t *rb, size_t frames )
+{
+  ringbuf_wait( rb, frames, 0 );
+
+  return sound_ringbuf_used( rb );
+}
+
+void
+sound_ringbuf_close( sound_ringbuf_t *rb )
+{
+  ringbuf_store_flag( &rb->closed, 1 );
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock( &rb->lock );
+  pthread_cond_broadcast( &rb->space_cond );
+  pthread_cond_broadcast( &rb->data_cond );
+  pthread_mutex_unlock( &rb->lock );
+#endif                          /* #ifdef HAVE_PTHREAD */
+}
+
+int
+sound_ringbuf_closed( sound_ringbuf_t *rb )
+{
+  return ringbuf_load_flag( &rb->closed );
+}
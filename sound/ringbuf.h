@@ -0,0 +1,110 @@
+/* ringbuf.h: Single producer, single consumer ring buffer for sound samples
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_SOUND_RINGBUF_H
+#define FUSE_SOUND_RINGBUF_H
+
+#include <stddef.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+#include <libspectrum.h>
+
+/* A ring buffer of interleaved 16-bit sample frames, safe for exactly one
+   writer thread and one reader thread to use without locking. 'head' and
+   'tail' count frames written and read since the buffer was last flushed;
+   they are only ever advanced by their owning side and published with
+   release semantics, so the data they cover is visible to the other side
+   by the time it sees the new count */
+typedef struct sound_ringbuf_t {
+
+  libspectrum_signed_word *data;
+  int channels;
+
+  size_t size;                  /* Usable size in frames */
+  size_t mask;                  /* Allocated size in frames, less one */
+
+  size_t head;                  /* Written by the producer only */
+  size_t tail;                  /* Written by the consumer only */
+
+  /* Non-zero while a thread is blocked waiting for space or data; the
+     other side only takes the lock to wake it up when these are set */
+  int space_waiter;
+  int data_waiter;
+
+  int closed;                   /* Non-zero once waits should give up */
+
+  size_t underruns;             /* Times the consumer found too little data */
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+  pthread_cond_t space_cond;
+  pthread_cond_t data_cond;
+#endif                          /* #ifdef HAVE_PTHREAD */
+
+} sound_ringbuf_t;
+
+int sound_ringbuf_init( sound_ringbuf_t *rb, size_t frames, int channels );
+void sound_ringbuf_end( sound_ringbuf_t *rb );
+void sound_ringbuf_flush( sound_ringbuf_t *rb );
+
+size_t sound_ringbuf_used( sound_ringbuf_t *rb );
+size_t sound_ringbuf_space( sound_ringbuf_t *rb );
+
+/* Zero-copy access: the reserve functions return the number of frames
+   which can be written or read contiguously at '*ptr', and the commit
+   functions then make the first 'frames' of those available to the other
+   side */
+size_t sound_ringbuf_write_reserve( sound_ringbuf_t *rb,
+                                    libspectrum_signed_word **ptr );
+void sound_ringbuf_write_commit( sound_ringbuf_t *rb, size_t frames );
+size_t sound_ringbuf_read_reserve( sound_ringbuf_t *rb,
+                                   const libspectrum_signed_word **ptr );
+void sound_ringbuf_read_commit( sound_ringbuf_t *rb, size_t frames );
+
+/* Copying access: transfer as many frames as possible without blocking
+   and return the number transferred */
+size_t sound_ringbuf_write( sound_ringbuf_t *rb,
+                            const libspectrum_signed_word *data,
+                            size_t frames );
+size_t sound_ringbuf_read( sound_ringbuf_t *rb, libspectrum_signed_word *data,
+                           size_t frames );
+
+/* Statistics: the consumer calls sound_ringbuf_underrun() whenever it has
+   to output silence because the buffer ran dry */
+void sound_ringbuf_underrun( sound_ringbuf_t *rb );
+size_t sound_ringbuf_underruns( sound_ringbuf_t *rb );
+
+/* Block the producer until at least 'frames' frames of space are free, or
+   the consumer until at least 'frames' frames are queued. Both give up when
+   the buffer is closed */
+void sound_ringbuf_wait_space( sound_ringbuf_t *rb, size_t frames );
+size_t sound_ringbuf_wait_data( sound_ringbuf_t *rb, size_t frames );
+
+/* Wake up any waiting thread and stop future waits from blocking */
+void sound_ringbuf_close( sound_ringbuf_t *rb );
+int sound_ringbuf_closed( sound_ringbuf_t *rb );
+
+#endif			/* #ifndef FUSE_SOUND_RINGBUF_H */
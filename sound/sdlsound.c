@@ -31,14 +31,14 @@
 
 #include <SDL.h>
 
+#include "ringbuf.h"
 #include "settings.h"
-#include "sfifo.h"
 #include "sound.h"
 #include "ui/ui.h"
 
 static void sdlwrite( void *userdata, Uint8 *stream, int len );
 
-sfifo_t sound_fifo;
+sound_ringbuf_t sound_fifo;
 
 /* Number of Spectrum frames audio latency to use */
 #define NUM_FRAMES 2
@@ -46,6 +46,27 @@ sfifo_t sound_fifo;
 /* Records sound writer status information */
 static int audio_output_started;
 
+/* Number of sample frames the device should ask for in each callback */
+static Uint16
+sdlsound_device_samples( int freq, int sound_framesiz )
+{
+  int samples = sound_framesiz;
+
+#ifdef __FreeBSD__
+  samples = pow( 2.0, floor( log2( samples ) ) );
+#endif			/* #ifdef __FreeBSD__ */
+
+  /* In low latency mode, don't let a single callback take more than half
+     of the target queue */
+  if( settings_current.sound_latency > 0 ) {
+    int limit = freq * settings_current.sound_latency / 2000;
+    if( limit < 64 ) limit = 64;
+    if( samples > limit ) samples = pow( 2.0, floor( log2( limit ) ) );
+  }
+
+  return samples;
+}
+
 int
 sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
 {
@@ -93,11 +114,7 @@ sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
      speed to about 2000% on my Mac, 100Hz allows up to 5000% for me) */
   if( hz > 100.0 ) hz = 100.0;
   sound_framesiz = *freqptr / hz;
-#ifdef __FreeBSD__
-  requested.samples = pow( 2.0, floor( log2( sound_framesiz ) ) );
-#else			/* #ifdef __FreeBSD__ */
-  requested.samples = sound_framesiz;
-#endif			/* #ifdef __FreeBSD__ */
+  requested.samples = sdlsound_device_samples( *freqptr, sound_framesiz );
 
   if ( SDL_OpenAudio( &requested, &received ) < 0 ) {
     settings_current.sound = 0;
@@ -115,7 +132,7 @@ sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
 
     requested.freq = *freqptr;
     sound_framesiz = *freqptr / hz;
-    requested.samples = sound_framesiz;
+    requested.samples = sdlsound_device_samples( *freqptr, sound_framesiz );
 
     if( SDL_OpenAudio( &requested, NULL ) < 0 ) {
       settings_current.sound = 0;
@@ -128,13 +145,13 @@ sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
   }
 
   sound_framesiz = *freqptr / hz;
-  sound_framesiz <<= 1;
 
-  if( ( error = sfifo_init( &sound_fifo, NUM_FRAMES
-                                         * received.channels
-                                         * sound_framesiz + 1 ) ) ) {
-    ui_error( UI_ERROR_ERROR, "Problem initialising sound fifo: %s",
-              strerror ( error ) );
+  /* Leave room for the low latency mode's target queue on top of the
+     usual latency, so the rate control never has to block */
+  if( sound_ringbuf_init( &sound_fifo, NUM_FRAMES * sound_framesiz +
+                          *freqptr * settings_current.sound_latency / 1000,
+                          *stereoptr ? 2 : 1 ) ) {
+    ui_error( UI_ERROR_ERROR, "Problem initialising sound fifo" );
     return 1;
   }
 
@@ -151,32 +168,22 @@ sound_lowlevel_end( void )
   SDL_LockAudio();
   SDL_CloseAudio();
   SDL_QuitSubSystem( SDL_INIT_AUDIO );
-  sfifo_flush( &sound_fifo );
-  sfifo_close( &sound_fifo );
+  sound_ringbuf_end( &sound_fifo );
 }
 
 /* Copy data to fifo */
 void
 sound_lowlevel_frame( libspectrum_signed_word *data, int len )
 {
-  int i = 0;
-
-  /* Convert to bytes */
-  libspectrum_signed_byte* bytes = (libspectrum_signed_byte*)data;
-  len <<= 1;
-
-  while( len ) {
-    if( ( i = sfifo_write( &sound_fifo, bytes, len ) ) < 0 ) {
-      break;
-    } else if (!i) {
-      SDL_Delay(10);
-    }
-    bytes += i;
-    len -= i;
-  }
-  if( i < 0 ) {
-    ui_error( UI_ERROR_ERROR, "Couldn't write sound fifo: %s",
-              strerror( i ) );
+  size_t frames = len / sound_fifo.channels;
+  size_t i;
+
+  /* The timer normally waits for space before running the frame, so this
+     will only block if we were asked for more than it anticipated */
+  while( ( i = sound_ringbuf_write( &sound_fifo, data, frames ) ) < frames ) {
+    data += i * sound_fifo.channels;
+    frames -= i;
+    sound_ringbuf_wait_space( &sound_fifo, frames );
   }
 
   if( !audio_output_started ) {
@@ -185,26 +192,28 @@ sound_lowlevel_frame( libspectrum_signed_word *data, int len )
   }
 }
 
-#ifndef MIN
-#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
-#endif
-
-/* Write len samples from fifo into stream */
+/* Write len bytes from fifo into stream */
 void
 sdlwrite( void *userdata, Uint8 *stream, int len )
 {
-  int f;
+  size_t framesize = sound_fifo.channels * sizeof( libspectrum_signed_word );
+  size_t frames = len / framesize;
+
+  /* Copy straight out of the ring buffer; this takes at most two passes */
+  while( frames ) {
+    const libspectrum_signed_word *ptr;
+    size_t count = sound_ringbuf_read_reserve( &sound_fifo, &ptr );
 
-  /* Try to only read an even number of bytes so as not to fragment a sample */
-  len = MIN( len, sfifo_used( &sound_fifo ) );
-  len &= sound_stereo_ay ? 0xfffc : 0xfffe;
+    if( !count ) break;
+    if( count > frames ) count = frames;
 
-  /* Read input_size bytes from fifo into sound stream */
-  while( ( f = sfifo_read( &sound_fifo, stream, len ) ) > 0 ) {
-    stream += f;
-    len -= f;
+    memcpy( stream, ptr, count * framesize );
+    sound_ringbuf_read_commit( &sound_fifo, count );
+    stream += count * framesize;
+    frames -= count;
   }
 
   /* If we ran out of sound, do nothing else as SDL has prefilled
      the output buffer with silence :( */
+  if( frames ) sound_ringbuf_underrun( &sound_fifo );
 }
@@ -0,0 +1,134 @@
+/* soundthread.c: Feed blocking sound devices from their own thread
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+/* Devices such as ALSA, OSS and PulseAudio block in sound_lowlevel_frame()
+   until they have room for more sound. Rather than stall the emulation
+   while that happens, sound_frame() puts its output into a ring buffer and
+   this thread passes it on to the device. */
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include "settings.h"
+#include "sound.h"
+#include "soundthread.h"
+#include "ui/ui.h"
+
+/* Number of Spectrum frames the emulation may run ahead of the sound
+   device */
+#define NUM_FRAMES 1
+
+sound_ringbuf_t sound_fifo;
+
+static pthread_t sound_thread;
+static int sound_thread_running = 0;
+
+/* The most we pass to the device in one go */
+static size_t sound_thread_chunk;
+
+static void*
+sound_thread_run( void *arg )
+{
+  sound_ringbuf_t *rb = arg;
+
+  while( !sound_ringbuf_closed( rb ) ) {
+    const libspectrum_signed_word *ptr;
+    size_t count;
+
+    if( !sound_ringbuf_wait_data( rb, 1 ) ) continue;
+
+    count = sound_ringbuf_read_reserve( rb, &ptr );
+    if( count > sound_thread_chunk ) count = sound_thread_chunk;
+
+    /* The frames stay ours until we commit the read, so the device can
+       write straight from the ring */
+    sound_lowlevel_frame( (libspectrum_signed_word*)ptr,
+                          count * rb->channels );
+    sound_ringbuf_read_commit( rb, count );
+  }
+
+  return NULL;
+}
+
+int
+sound_thread_init( int freq, int channels )
+{
+  size_t frames;
+  int error;
+
+  /* Allow for the low latency mode's target queue on top of our usual
+     allowance */
+  frames = NUM_FRAMES * sound_framesiz +
+           freq * settings_current.sound_latency / 1000;
+
+  if( sound_ringbuf_init( &sound_fifo, frames, channels ) ) {
+    ui_error( UI_ERROR_ERROR, "Problem initialising sound fifo" );
+    return 1;
+  }
+
+  sound_thread_chunk = sound_framesiz;
+
+  error = pthread_create( &sound_thread, NULL, sound_thread_run,
+                          &sound_fifo );
+  if( error ) {
+    ui_error( UI_ERROR_ERROR, "error %d creating sound thread", error );
+    sound_ringbuf_end( &sound_fifo );
+    return 1;
+  }
+
+  sound_thread_running = 1;
+
+  return 0;
+}
+
+void
+sound_thread_end( void )
+{
+  if( !sound_thread_running ) return;
+
+  /* Anything still queued is dropped; the thread finishes its current
+     write to the device and then exits */
+  sound_ringbuf_close( &sound_fifo );
+  pthread_join( sound_thread, NULL );
+
+  sound_ringbuf_end( &sound_fifo );
+  sound_thread_running = 0;
+}
+
+void
+sound_thread_frame( libspectrum_signed_word *data, int len )
+{
+  size_t frames = len / sound_fifo.channels;
+  size_t i;
+
+  if( !sound_thread_running ) return;
+
+  /* The timer normally waits for space before running the frame, so this
+     will only block if we were asked for more than it anticipated */
+  while( ( i = sound_ringbuf_write( &sound_fifo, data, frames ) ) < frames ) {
+    data += i * sound_fifo.channels;
+    frames -= i;
+    sound_ringbuf_wait_space( &sound_fifo, frames );
+  }
+}
@@ -0,0 +1,37 @@
+/* soundthread.h: Feed blocking sound devices from their own thread
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_SOUND_SOUNDTHREAD_H
+#define FUSE_SOUND_SOUNDTHREAD_H
+
+#include <libspectrum.h>
+
+#include "ringbuf.h"
+
+extern sound_ringbuf_t sound_fifo;
+
+int sound_thread_init( int freq, int channels );
+void sound_thread_end( void );
+void sound_thread_frame( libspectrum_signed_word *data, int len );
+
+#endif			/* #ifndef FUSE_SOUND_SOUNDTHREAD_H */
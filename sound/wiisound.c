@@ -23,7 +23,7 @@
 #include <unistd.h>
 
 #include "fuse.h"
-#include "sfifo.h"
+#include "ringbuf.h"
 
 #include <gccore.h>
 #include <ogc/audio.h>
@@ -34,7 +34,7 @@
 
 int samplerate;
 int streamstate;
-sfifo_t sound_fifo;
+sound_ringbuf_t sound_fifo;
 
 #define BUFSIZE 16384
 u8 dmabuf[BUFSIZE<<1] ATTRIBUTE_ALIGN(32);
@@ -43,10 +43,16 @@ int dmalen = BUFSIZE;
 static void
 sound_dmacallback( void )
 {
-  if( sfifo_used( &sound_fifo ) < 128) return;
-  
-  dmalen = MIN( BUFSIZE, sfifo_used( &sound_fifo ) );
-  sfifo_read( &sound_fifo, dmabuf, dmalen );
+  size_t frames = sound_ringbuf_used( &sound_fifo );
+
+  if( frames < 32 ) {
+    sound_ringbuf_underrun( &sound_fifo );
+    return;
+  }
+
+  frames = MIN( BUFSIZE / 4, frames );
+  dmalen = sound_ringbuf_read( &sound_fifo, (libspectrum_signed_word*)dmabuf,
+                               frames ) * 4;
   DCFlushRange( dmabuf, dmalen );
   AUDIO_InitDMA( (u32)dmabuf, dmalen );
   AUDIO_StartDMA();
@@ -67,7 +73,7 @@ sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
     return 1;
   }
 
-  sfifo_init( &sound_fifo, BUFSIZE );
+  sound_ringbuf_init( &sound_fifo, BUFSIZE / 4, 2 );
   *stereoptr = 1;
   
   AUDIO_Init( NULL );
@@ -87,25 +93,19 @@ sound_lowlevel_init( const char *device, int *freqptr, int *stereoptr )
 void
 sound_lowlevel_end( void )
 {
-  sfifo_flush( &sound_fifo );
-  sfifo_close( &sound_fifo );
   AUDIO_StopDMA();
+  sound_ringbuf_end( &sound_fifo );
 }
 
 void
 sound_lowlevel_frame(libspectrum_signed_word *data, int len)
 {
-  int i;
-  
-  libspectrum_signed_byte *bytes = (libspectrum_signed_byte*)data;
-  len <<= 1;
-
-  while(len) {
-    if( ( i = sfifo_write( &sound_fifo, bytes, len ) ) < 0 ) 
-      break;
-    else if( !i )
-      usleep(10000);
-    bytes += i;
-    len -= i;
+  size_t frames = len / 2;
+  size_t i;
+
+  while( ( i = sound_ringbuf_write( &sound_fifo, data, frames ) ) < frames ) {
+    data += i * 2;
+    frames -= i;
+    sound_ringbuf_wait_space( &sound_fifo, frames );
   }
 }
@@ -39,6 +39,7 @@
 #include "peripherals/ula.h"
 #include "phantom_typist.h"
 #include "psg.h"
+#include "rewind.h"
 #include "profile.h"
 #include "rzx.h"
 #include "settings.h"
@@ -95,6 +96,7 @@ spectrum_frame_event_fn( libspectrum_dword last_tstates, int type,
   rzx_frame();
   psg_frame();
   spectrum_frame();
+  rewind_frame();
   z80_interrupt();
   ui_joystick_poll();
   timer_estimate_speed();
@@ -165,7 +167,9 @@ spectrum_frame( void )
                spectrum_frame_event );
 
   loader_frame( frame_length );
+  tape_frame( frame_length );
   phantom_typist_frame();
+  timer_turbo_frame();
 
   frames_since_reset++;
 
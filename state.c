@@ -0,0 +1,450 @@
+/* state.c: fast in-memory machine state
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+/* A state is a flat buffer: a header giving the machine it was taken from,
+   then one record per module with native support, each being a four
+   character identifier, a version byte, a length and the module's data.
+   Nothing is compressed, and the state never leaves this process, so
+   saving and restoring are little more than a few memcpy()s. Modules
+   without native support are saved to and restored from an in-memory
+   libspectrum_snap, which is never written out as a snapshot file */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libspectrum.h>
+
+#include "display.h"
+#include "infrastructure/startup_manager.h"
+#include "machine.h"
+#include "memory_pages.h"
+#include "module.h"
+#include "periph.h"
+#include "settings.h"
+#include "spectrum.h"
+#include "state.h"
+#include "ui/ui.h"
+#include "z80/z80.h"
+
+#define STATE_MAGIC STATE_ID( 'F', 'S', 'T', 'A' )
+#define STATE_FORMAT_VERSION 1
+
+/* Bumped every time the machine is reset. A state saved with the current
+   generation can be restored without resetting the machine first, as
+   the machine and its peripherals are still set up as they were */
+static libspectrum_dword state_generation;
+
+static void state_reset( int hard_reset );
+
+static module_info_t state_module_info = {
+
+  /* .reset = */ state_reset,
+  /* .romcs = */ NULL,
+  /* .snapshot_enabled = */ NULL,
+  /* .snapshot_from = */ NULL,
+  /* .snapshot_to = */ NULL,
+
+};
+
+static int
+state_init( void *context )
+{
+  module_register( &state_module_info );
+
+  return 0;
+}
+
+void
+state_register_startup( void )
+{
+  startup_manager_register_no_dependencies( STARTUP_MANAGER_MODULE_STATE,
+                                            state_init, NULL, NULL );
+}
+
+static void
+state_reset( int hard_reset GCC_UNUSED )
+{
+  state_generation++;
+}
+
+/* Make sure there's space for another 'length' bytes in 'buffer' */
+void
+state_buffer_reserve( state_buffer_t *buffer, size_t length )
+{
+  size_t needed = buffer->length + length;
+
+  if( needed <= buffer->allocated ) return;
+
+  if( !buffer->allocated ) buffer->allocated = 65536;
+  while( buffer->allocated < needed ) buffer->allocated *= 2;
+
+  buffer->data = libspectrum_renew( libspectrum_byte, buffer->data,
+                                    buffer->allocated );
+}
+
+void
+state_buffer_write( state_buffer_t *buffer, const void *data, size_t length )
+{
+  state_buffer_reserve( buffer, length );
+  memcpy( buffer->data + buffer->length, data, length );
+  buffer->length += length;
+}
+
+void
+state_buffer_write_byte( state_buffer_t *buffer, libspectrum_byte b )
+{
+  state_buffer_reserve( buffer, 1 );
+  buffer->data[ buffer->length++ ] = b;
+}
+
+void
+state_buffer_write_dword( state_buffer_t *buffer, libspectrum_dword d )
+{
+  state_buffer_reserve( buffer, 4 );
+  buffer->data[ buffer->length++ ] =   d         & 0xff;
+  buffer->data[ buffer->length++ ] = ( d >>  8 ) & 0xff;
+  buffer->data[ buffer->length++ ] = ( d >> 16 ) & 0xff;
+  buffer->data[ buffer->length++ ] = ( d >> 24 ) & 0xff;
+}
+
+void
+state_buffer_read( state_buffer_t *buffer, void *data, size_t length )
+{
+  if( buffer->error || length > buffer->length - buffer->position ) {
+    buffer->error = 1;
+    memset( data, 0, length );
+    return;
+  }
+
+  memcpy( data, buffer->data + buffer->position, length );
+  buffer->position += length;
+}
+
+libspectrum_byte
+state_buffer_read_byte( state_buffer_t *buffer )
+{
+  libspectrum_byte b;
+
+  state_buffer_read( buffer, &b, 1 );
+
+  return b;
+}
+
+libspectrum_dword
+state_buffer_read_dword( state_buffer_t *buffer )
+{
+  libspectrum_byte d[4];
+
+  state_buffer_read( buffer, d, 4 );
+
+  return d[0] | ( d[1] << 8 ) | ( d[2] << 16 ) |
+         ( (libspectrum_dword)d[3] << 24 );
+}
+
+size_t
+state_record_begin( state_buffer_t *buffer, libspectrum_dword id,
+                    libspectrum_byte version )
+{
+  size_t record = buffer->length;
+
+  state_buffer_write_dword( buffer, id );
+  state_buffer_write_byte( buffer, version );
+  state_buffer_write_dword( buffer, 0 );	/* Filled in later */
+
+  return record;
+}
+
+void
+state_record_end( state_buffer_t *buffer, size_t record )
+{
+  size_t end = buffer->length;
+
+  /* The length goes after the identifier and version */
+  buffer->length = record + 5;
+  state_buffer_write_dword( buffer, end - record - 9 );
+  buffer->length = end;
+}
+
+int
+state_record_read( state_buffer_t *buffer, libspectrum_dword id,
+                   libspectrum_byte version, size_t *length )
+{
+  libspectrum_dword read_id;
+  libspectrum_byte read_version;
+
+  read_id = state_buffer_read_dword( buffer );
+  read_version = state_buffer_read_byte( buffer );
+  *length = state_buffer_read_dword( buffer );
+
+  if( buffer->error || read_id != id || read_version != version ||
+      *length > buffer->length - buffer->position ) {
+    ui_error( UI_ERROR_ERROR,
+              "state: expected version %d of record '%c%c%c%c'", version,
+              (char)( id >> 24 ), (char)( id >> 16 ), (char)( id >> 8 ),
+              (char)id );
+    return 1;
+  }
+
+  return 0;
+}
+
+state_t*
+state_alloc( void )
+{
+  return libspectrum_new0( state_t, 1 );
+}
+
+void
+state_free( state_t *state )
+{
+  if( !state ) return;
+
+  if( state->snap ) libspectrum_snap_free( state->snap );
+  libspectrum_free( state->buffer.data );
+  libspectrum_free( state );
+}
+
+int
+state_save( state_t *state )
+{
+  state_buffer_t *buffer = &state->buffer;
+
+  /* Keep the allocated buffer so that repeatedly saving into the same
+     state doesn't need to allocate anything */
+  buffer->length = 0;
+  buffer->ram_offset = buffer->ram_pages = 0;
+
+  state_buffer_write_dword( buffer, STATE_MAGIC );
+  state_buffer_write_byte( buffer, STATE_FORMAT_VERSION );
+  state_buffer_write_dword( buffer, machine_current->machine );
+  state_buffer_write_byte( buffer, settings_current.late_timings );
+  state_buffer_write_dword( buffer, state_generation );
+
+  if( state->snap ) libspectrum_snap_free( state->snap );
+  state->snap = libspectrum_snap_alloc();
+
+  libspectrum_snap_set_machine( state->snap, machine_current->machine );
+  libspectrum_snap_set_late_timings( state->snap,
+                                     settings_current.late_timings );
+
+  /* Memory is saved natively, but the Multiface 3 restores its copy of
+     the paging registers from these */
+  libspectrum_snap_set_out_128_memoryport( state->snap,
+                                           machine_current->ram.last_byte );
+  libspectrum_snap_set_out_plus3_memoryport( state->snap,
+                                             machine_current->ram.last_byte2 );
+
+  module_state_save( buffer, state->snap );
+
+  return 0;
+}
+
+int
+state_load( state_t *state )
+{
+  state_buffer_t *buffer = &state->buffer;
+  libspectrum_machine machine;
+  libspectrum_dword generation;
+  int late_timings, error;
+
+  buffer->position = 0;
+  buffer->error = 0;
+
+  if( !state->snap ||
+      state_buffer_read_dword( buffer ) != STATE_MAGIC ||
+      state_buffer_read_byte( buffer ) != STATE_FORMAT_VERSION ) {
+    ui_error( UI_ERROR_ERROR, "state: not a saved state" );
+    return 1;
+  }
+
+  machine = state_buffer_read_dword( buffer );
+  late_timings = state_buffer_read_byte( buffer );
+  generation = state_buffer_read_dword( buffer );
+  if( buffer->error ) {
+    ui_error( UI_ERROR_ERROR, "state: truncated header" );
+    return 1;
+  }
+
+  /* If the machine has been changed or reset since the state was saved,
+     set it up again as snapshot_copy_from() would. Otherwise, everything
+     can be restored straight over the top of the running machine */
+  if( machine != machine_current->machine ||
+      late_timings != settings_current.late_timings ||
+      generation != state_generation ) {
+
+    periph_disable_optional();
+    module_snapshot_enabled( state->snap );
+
+    settings_current.late_timings = late_timings;
+
+    if( machine != machine_current->machine ) {
+      error = machine_select( machine );
+      if( error ) {
+        ui_error( UI_ERROR_ERROR,
+                  "Loading a %s state, but that's not available",
+                  libspectrum_machine_name( machine ) );
+        return error;
+      }
+    } else {
+      machine_reset( 0 );
+    }
+  }
+
+  error = module_state_load( buffer, state->snap );
+
+  /* As with snapshots, the memory map can only be set once every module
+     has been restored */
+  machine_current->memory_map();
+  display_refresh_all();
+
+  return error;
+}
+
+size_t
+state_length( const state_t *state )
+{
+  return state->buffer.length;
+}
+
+int
+state_write_flat( const state_t *state, state_buffer_t *flat )
+{
+  libspectrum_byte *szx = NULL;
+  size_t szx_length = 0;
+  int flags, error;
+
+  error = libspectrum_snap_write( &szx, &szx_length, &flags, state->snap,
+                                  LIBSPECTRUM_ID_SNAPSHOT_SZX, NULL,
+                                  LIBSPECTRUM_FLAG_SNAPSHOT_NO_COMPRESSION );
+  if( error ) return error;
+
+  flat->length = 0;
+  state_buffer_write_dword( flat, state->buffer.length );
+  state_buffer_write( flat, state->buffer.data, state->buffer.length );
+  state_buffer_write( flat, szx, szx_length );
+
+  flat->ram_offset = state->buffer.ram_offset + 4;
+  flat->ram_pages = state->buffer.ram_pages;
+
+  libspectrum_free( szx );
+
+  return 0;
+}
+
+int
+state_read_flat( state_t *state, state_buffer_t *flat )
+{
+  size_t length;
+  int error;
+
+  flat->position = 0;
+  flat->error = 0;
+
+  length = state_buffer_read_dword( flat );
+  if( flat->error || length > flat->length - flat->position ) {
+    ui_error( UI_ERROR_ERROR, "state: truncated flat state" );
+    return 1;
+  }
+
+  state->buffer.length = 0;
+  state_buffer_write( &state->buffer, flat->data + flat->position, length );
+  flat->position += length;
+
+  if( state->snap ) libspectrum_snap_free( state->snap );
+  state->snap = libspectrum_snap_alloc();
+
+  error = libspectrum_snap_read( state->snap, flat->data + flat->position,
+                                 flat->length - flat->position,
+                                 LIBSPECTRUM_ID_SNAPSHOT_SZX, NULL );
+  if( error ) {
+    libspectrum_snap_free( state->snap );
+    state->snap = NULL;
+    return error;
+  }
+
+  return 0;
+}
+
+int
+state_unittest( void )
+{
+  state_t *state;
+  libspectrum_byte *ram;
+  processor saved_z80;
+  libspectrum_dword saved_tstates;
+  size_t i;
+  int r = 0;
+
+  ram = libspectrum_new( libspectrum_byte, 8 * 0x4000 );
+
+  state = state_alloc();
+  state_save( state );
+
+  for( i = 0; i < 8; i++ ) memcpy( ram + i * 0x4000, RAM[i], 0x4000 );
+  memcpy( &saved_z80, &z80, sizeof( z80 ) );
+  saved_tstates = tstates;
+
+  /* Scribble over everything the state should put back */
+  for( i = 0; i < 8; i++ ) memset( RAM[i], 0xa5, 0x4000 );
+  z80.pc.w ^= 0x1234; z80.af.w ^= 0x5678; z80.im ^= 0x01;
+  tstates += 100;
+
+  if( state_load( state ) ) {
+    printf( "%s:%d: state failed to load\n", __FILE__, __LINE__ );
+    r++;
+  }
+
+  for( i = 0; i < 8; i++ ) {
+    if( memcmp( ram + i * 0x4000, RAM[i], 0x4000 ) ) {
+      printf( "%s:%d: RAM page %lu not restored\n", __FILE__, __LINE__,
+              (unsigned long)i );
+      r++;
+    }
+  }
+
+  if( memcmp( &saved_z80, &z80, sizeof( z80 ) ) ) {
+    printf( "%s:%d: Z80 state not restored\n", __FILE__, __LINE__ );
+    r++;
+  }
+
+  if( saved_tstates != tstates ) {
+    printf( "%s:%d: tstates was %lu, expected %lu\n", __FILE__, __LINE__,
+            (unsigned long)tstates, (unsigned long)saved_tstates );
+    r++;
+  }
+
+  if( libspectrum_snap_out_128_memoryport( state->snap ) !=
+        machine_current->ram.last_byte ||
+      libspectrum_snap_out_plus3_memoryport( state->snap ) !=
+        machine_current->ram.last_byte2 ) {
+    printf( "%s:%d: paging registers not in state\n", __FILE__, __LINE__ );
+    r++;
+  }
+
+  state_free( state );
+  libspectrum_free( ram );
+
+  return r;
+}
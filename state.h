@@ -0,0 +1,107 @@
+/* state.h: fast in-memory machine state
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#ifndef FUSE_STATE_H
+#define FUSE_STATE_H
+
+#include <stddef.h>
+
+#include <libspectrum.h>
+
+/* Build the four character identifier for a module's state record */
+#define STATE_ID( a, b, c, d ) \
+  ( ( (libspectrum_dword)(a) << 24 ) | ( (libspectrum_dword)(b) << 16 ) | \
+    ( (libspectrum_dword)(c) <<  8 ) |   (libspectrum_dword)(d) )
+
+/* A flat, growable buffer which modules write their state into and read
+   it back from. Reading past the end of the data sets 'error' rather than
+   failing each call, so modules can read all their fields and check once */
+typedef struct state_buffer_t {
+
+  libspectrum_byte *data;
+  size_t length;		/* Bytes of data in the buffer */
+  size_t allocated;		/* Bytes allocated for the buffer */
+
+  size_t position;		/* Where the next read comes from */
+  int error;			/* Non-zero if a read ran off the end */
+
+  /* Where the RAM pages were written, so that anything comparing two
+     states can skip pages which haven't been written to in between */
+  size_t ram_offset;
+  size_t ram_pages;
+
+} state_buffer_t;
+
+void state_buffer_reserve( state_buffer_t *buffer, size_t length );
+
+void state_buffer_write( state_buffer_t *buffer, const void *data,
+                         size_t length );
+void state_buffer_write_byte( state_buffer_t *buffer, libspectrum_byte b );
+void state_buffer_write_dword( state_buffer_t *buffer, libspectrum_dword d );
+
+void state_buffer_read( state_buffer_t *buffer, void *data, size_t length );
+libspectrum_byte state_buffer_read_byte( state_buffer_t *buffer );
+libspectrum_dword state_buffer_read_dword( state_buffer_t *buffer );
+
+/* Start and finish one module's record; state_record_begin() returns the
+   position of the record, to be passed to state_record_end() */
+size_t state_record_begin( state_buffer_t *buffer, libspectrum_dword id,
+                           libspectrum_byte version );
+void state_record_end( state_buffer_t *buffer, size_t record );
+
+/* Read the header of the next record, checking it's the one we expect.
+   Returns the length of the record's data in 'length' */
+int state_record_read( state_buffer_t *buffer, libspectrum_dword id,
+                       libspectrum_byte version, size_t *length );
+
+/* A saved machine state. Modules with native support write their state
+   into 'buffer'; anything else is kept in 'snap', which is serialised
+   only by state_write_flat() */
+typedef struct state_t {
+
+  state_buffer_t buffer;
+  libspectrum_snap *snap;
+
+} state_t;
+
+void state_register_startup( void );
+
+state_t* state_alloc( void );
+void state_free( state_t *state );
+
+int state_save( state_t *state );
+int state_load( state_t *state );
+
+/* The number of bytes used by the native part of 'state' */
+size_t state_length( const state_t *state );
+
+/* Convert between a state and a single flat buffer, serialising the part
+   kept in a libspectrum_snap as an uncompressed SZX snapshot. Slower than
+   saving and loading, but it means the whole state can be stored and
+   compared as one block of bytes */
+int state_write_flat( const state_t *state, state_buffer_t *flat );
+int state_read_flat( state_t *state, state_buffer_t *flat );
+
+int state_unittest( void );
+
+#endif			/* #ifndef FUSE_STATE_H */
@@ -78,20 +78,52 @@ static const char * const microphone_variable_name = "microphone";
 
 /* Spectrum events */
 int tape_edge_event;
-static int record_event;
 static int tape_mic_off_event;
 
 static libspectrum_dword next_tape_edge_tstates;
 
+/* The edges of the whole tape, as produced by playing it from the start,
+   so playback doesn't need to go through libspectrum for every edge. Runs
+   of identical edges (pilot tones, and much of the data) are stored as a
+   single entry */
+typedef struct tape_pulse_t {
+  libspectrum_dword tstates;	/* Time since the previous edge */
+  libspectrum_dword repeats;	/* Number of identical edges */
+  libspectrum_word flags;	/* LIBSPECTRUM_TAPE_FLAGS_* */
+  libspectrum_word block;	/* Current block after this edge */
+} tape_pulse_t;
+
+/* Limit the cache to 24Mb; anything on the tape beyond this is played
+   directly by libspectrum */
+#define TAPE_CACHE_MAX_PULSES ( 1 << 21 )
+
+static struct {
+  tape_pulse_t *pulses;
+  long count;
+
+  /* The index of blocks on the tape */
+  long *block_start;	/* The first entry of each block, or -1 if playing
+			   from the start never reaches that block */
+  size_t block_count;
+
+  long cursor;		/* The next entry to play, or -1 if libspectrum is
+			   playing the tape */
+  libspectrum_dword played;	/* Edges already played from that entry */
+  long block_begin;	/* The first entry of the block being played */
+  int block;		/* The block being played */
+} tape_cache = { NULL, 0, NULL, 0, -1, 0, -1, -1 };
+
 /* Function prototypes */
 
 static int tape_autoload( libspectrum_machine hardware );
 static int trap_load_block( libspectrum_tape_block *block );
 static int tape_play( int autoplay );
 static void make_name( unsigned char *name, const unsigned char *data );
-static void
-tape_event_record_sample( libspectrum_dword last_tstates, int type,
-			  void *user_data );
+static int tape_position( void );
+static void tape_cache_build( void );
+static void tape_cache_rebuild( void );
+static void tape_cache_free( void );
+static void tape_cache_seek( int block );
 static void tape_stop_mic_off( libspectrum_dword last_tstates, int type,
                                void *user_data );
 
@@ -124,8 +156,6 @@ tape_init( void *context )
 
   tape_edge_event = event_register( next_edge, "Tape edge" );
   tape_mic_off_event = event_register( tape_stop_mic_off, "Tape stop MIC off" );
-  record_event = event_register( tape_event_record_sample,
-				 "Tape sample record" );
 
   tape_modified = 0;
 
@@ -191,6 +221,8 @@ tape_read_buffer( unsigned char *buffer, size_t length, libspectrum_id_t type,
   error = libspectrum_tape_read( tape, buffer, length, type, filename );
   if( error ) return error;
 
+  tape_cache_build();
+
   tape_modified = 0;
   ui_tape_browser_update( UI_TAPE_BROWSER_NEW_TAPE, NULL );
 
@@ -282,6 +314,8 @@ tape_close( void )
   }
 
   /* And then remove it from memory */
+  tape_cache_free();
+
   error = libspectrum_tape_clear( tape );
   if( error ) return error;
 
@@ -317,12 +351,27 @@ tape_select_block( size_t n )
 int
 tape_select_block_no_update( size_t n )
 {
-  return libspectrum_tape_nth_block( tape, n );
+  int error;
+
+  error = libspectrum_tape_nth_block( tape, n ); if( error ) return error;
+
+  tape_cache_seek( n );
+
+  return 0;
 }
 
 /* Which block is current? */
 int
 tape_get_current_block( void )
+{
+  if( tape_cache.cursor >= 0 ) return tape_cache.block;
+
+  return tape_position();
+}
+
+/* Which block is libspectrum playing? */
+static int
+tape_position( void )
 {
   int n;
   libspectrum_error error;
@@ -399,16 +448,23 @@ tape_load_trap( void )
   block = libspectrum_tape_current_block( tape );
 
   /* Skip over any meta-data blocks */
-  while( libspectrum_tape_block_metadata( block ) ) {
-    block = libspectrum_tape_select_next_block( tape );
-    if( !block ) return 1;
+  if( libspectrum_tape_block_metadata( block ) ) {
+    while( libspectrum_tape_block_metadata( block ) ) {
+      block = libspectrum_tape_select_next_block( tape );
+      if( !block ) return 1;
+    }
+    tape_cache_seek( tape_position() );
   }
   
   /* If this block isn't a ROM loader, start the block playing. After
      that, return with `error' so that we actually do whichever
-     instruction it was that caused the trap to hit */
+     instruction it was that caused the trap to hit. If the cache is
+     playing the tape, libspectrum is always at the start of the block */
   if( libspectrum_tape_block_type( block ) != LIBSPECTRUM_TAPE_BLOCK_ROM ||
-      libspectrum_tape_state( tape ) != LIBSPECTRUM_TAPE_STATE_PILOT ) {
+      libspectrum_tape_state( tape ) != LIBSPECTRUM_TAPE_STATE_PILOT ||
+      ( tape_cache.cursor >= 0 &&
+        ( tape_cache.cursor != tape_cache.block_begin ||
+          tape_cache.played ) ) ) {
     tape_play( 1 );
     return -1;
   }
@@ -443,14 +499,19 @@ tape_load_trap( void )
     next_block = libspectrum_tape_select_next_block( tape );
     if( !next_block ) return 1;
 
+    tape_cache_seek( tape_position() );
+
     ui_tape_browser_update( UI_TAPE_BROWSER_SELECT_BLOCK, NULL );
 
     return 0;
   }
 
   /* If the next block isn't a ROM block, set ourselves up such that the
-     next thing to occur is the pause at the end of the current block */
+     next thing to occur is the pause at the end of the current block.
+     The cache can't start part way through a block, so leave it to
+     libspectrum until the next one */
   libspectrum_tape_set_state( tape, LIBSPECTRUM_TAPE_STATE_PAUSE );
+  tape_cache.cursor = -1;
 
   return 0;
 }
@@ -607,6 +668,7 @@ tape_save_trap( void )
   libspectrum_tape_block_set_pause( block, 1000 );
 
   libspectrum_tape_append_block( tape, block );
+  tape_cache_rebuild();
 
   tape_modified = 1;
   ui_tape_browser_update( UI_TAPE_BROWSER_NEW_BLOCK, block );
@@ -728,14 +790,20 @@ tape_present( void )
   return libspectrum_tape_present( tape );
 }
 
+/* Recording works from the edges written to the ULA's MIC output, each
+   pulse being stored as its exact length in T-states. Every time the
+   buffer fills, it's written out to the tape as an RLE pulse block and a
+   new one started, so the buffer never has to grow */
+#define TAPE_RECORD_BUFFER_SIZE 0x100000
+
 typedef struct
 {
   libspectrum_byte *tape_buffer;
-  libspectrum_dword tape_buffer_size;
   libspectrum_dword tape_buffer_used;
-  int tstates_per_sample;
-  int last_level;
-  int last_level_count;
+  libspectrum_dword last_edge_tstates; /* Time of the last edge in this
+                                          frame */
+  libspectrum_dword carried_tstates;   /* Length of the current pulse
+                                          before this frame */
 } tape_rec_state;
 
 int tape_recording = 0;
@@ -745,21 +813,12 @@ static tape_rec_state rec_state;
 void
 tape_record_start( void )
 {
-  /* sample rate will be 44.1KHz */
-  rec_state.tstates_per_sample =
-    machine_current->timings.processor_speed/44100;
-
-  rec_state.tape_buffer_size = 8192;
-  rec_state.tape_buffer = libspectrum_new(libspectrum_byte,
-					  rec_state.tape_buffer_size);
+  rec_state.tape_buffer = libspectrum_new( libspectrum_byte,
+                                          TAPE_RECORD_BUFFER_SIZE );
   rec_state.tape_buffer_used = 0;
 
-  /* start scheduling events that record into a buffer that we
-     start allocating here */
-  event_add( tstates + rec_state.tstates_per_sample, record_event );
-
-  rec_state.last_level = ula_tape_level();
-  rec_state.last_level_count = 1;
+  rec_state.last_edge_tstates = tstates;
+  rec_state.carried_tstates = 0;
 
   tape_recording = 1;
 
@@ -767,80 +826,106 @@ tape_record_start( void )
   ui_menu_activate( UI_MENU_ITEM_TAPE_RECORDING, 1 );
 }
 
-static int
-write_rec_buffer( libspectrum_byte *tape_buffer,
-                  libspectrum_dword tape_buffer_used,
-                  int last_level_count )
+/* Write the pulses recorded so far to the tape as a block. The block
+   takes over the buffer */
+static void
+flush_rec_buffer( void )
 {
-  if( last_level_count <= 0xff ) {
-    tape_buffer[ tape_buffer_used++ ] = last_level_count;
-  } else {
-    tape_buffer[ tape_buffer_used++ ] = 0;
-    tape_buffer[ tape_buffer_used++ ] = ( last_level_count & 0x000000ff )      ;
-    tape_buffer[ tape_buffer_used++ ] = ( last_level_count & 0x0000ff00 ) >>  8;
-    tape_buffer[ tape_buffer_used++ ] = ( last_level_count & 0x00ff0000 ) >> 16;
-    tape_buffer[ tape_buffer_used++ ] = ( last_level_count & 0xff000000 ) >> 24;
-  }
+  libspectrum_tape_block* block;
+
+  block = libspectrum_tape_block_alloc( LIBSPECTRUM_TAPE_BLOCK_RLE_PULSE );
 
-  return tape_buffer_used;
+  libspectrum_tape_block_set_scale( block, 1 );
+  libspectrum_tape_block_set_data_length( block, rec_state.tape_buffer_used );
+  libspectrum_tape_block_set_data( block, rec_state.tape_buffer );
+
+  libspectrum_tape_append_block( tape, block );
+  tape_cache_free();
+
+  rec_state.tape_buffer = NULL;
+  rec_state.tape_buffer_used = 0;
+
+  tape_modified = 1;
+  ui_tape_browser_update( UI_TAPE_BROWSER_NEW_BLOCK, block );
 }
 
-void
-tape_event_record_sample( libspectrum_dword last_tstates, int type,
-			  void *user_data )
+/* Append one pulse to the recording, in the format used by RLE pulse
+   blocks */
+static void
+write_rec_pulse( libspectrum_dword length )
 {
-  if( rec_state.last_level != (ula_tape_level()) ) {
-    /* put a sample into the recording buffer */
-    rec_state.tape_buffer_used =
-      write_rec_buffer( rec_state.tape_buffer,
-                        rec_state.tape_buffer_used,
-                        rec_state.last_level_count );
-
-    rec_state.last_level_count = 0;
-    rec_state.last_level = ula_tape_level();
-    /* make sure we can still fit a dword and a flag byte in the buffer */
-    if( rec_state.tape_buffer_used+5 >= rec_state.tape_buffer_size ) {
-      rec_state.tape_buffer_size = rec_state.tape_buffer_size*2;
-      rec_state.tape_buffer =
-        libspectrum_renew( libspectrum_byte, rec_state.tape_buffer,
-                           rec_state.tape_buffer_size );
-    }
+  libspectrum_byte *ptr;
+
+  /* make sure we can still fit a dword and a flag byte in the buffer */
+  if( rec_state.tape_buffer_used + 5 > TAPE_RECORD_BUFFER_SIZE ) {
+    flush_rec_buffer();
+    rec_state.tape_buffer = libspectrum_new( libspectrum_byte,
+                                            TAPE_RECORD_BUFFER_SIZE );
   }
 
-  rec_state.last_level_count++;
+  ptr = rec_state.tape_buffer + rec_state.tape_buffer_used;
 
-  /* schedule next timer */
-  event_add( last_tstates + rec_state.tstates_per_sample, record_event );
+  /* A single zero byte introduces a long pulse, so a zero length pulse
+     has to be written out in full */
+  if( length && length <= 0xff ) {
+    *ptr = length;
+    rec_state.tape_buffer_used++;
+  } else {
+    ptr[0] = 0;
+    ptr[1] = ( length & 0x000000ff )      ;
+    ptr[2] = ( length & 0x0000ff00 ) >>  8;
+    ptr[3] = ( length & 0x00ff0000 ) >> 16;
+    ptr[4] = ( length & 0xff000000 ) >> 24;
+    rec_state.tape_buffer_used += 5;
+  }
 }
 
-int
-tape_record_stop( void )
+/* The length of the pulse ending at 'edge_tstates' in this frame */
+static libspectrum_dword
+rec_pulse_length( libspectrum_dword edge_tstates )
 {
-  libspectrum_tape_block* block;
+  libspectrum_dword length = edge_tstates - rec_state.last_edge_tstates;
 
-  /* put last sample into the recording buffer */
-  rec_state.tape_buffer_used = write_rec_buffer( rec_state.tape_buffer,
-                                                 rec_state.tape_buffer_used,
-                                                 rec_state.last_level_count );
+  /* Saturate rather than wrap if the level hasn't changed for over 20
+     minutes */
+  if( rec_state.carried_tstates > 0xffffffff - length ) return 0xffffffff;
 
-  /* stop scheduling events and turn buffer into a block and
-     pop into the current tape */
-  event_remove_type( record_event );
+  return rec_state.carried_tstates + length;
+}
 
-  block = libspectrum_tape_block_alloc( LIBSPECTRUM_TAPE_BLOCK_RLE_PULSE );
+/* Called by the ULA whenever the MIC output level changes */
+void
+tape_record_edge( libspectrum_dword edge_tstates )
+{
+  if( !tape_recording ) return;
 
-  libspectrum_tape_block_set_scale( block, rec_state.tstates_per_sample );
-  libspectrum_tape_block_set_data_length( block, rec_state.tape_buffer_used );
-  libspectrum_tape_block_set_data( block, rec_state.tape_buffer );
+  write_rec_pulse( rec_pulse_length( edge_tstates ) );
 
-  libspectrum_tape_append_block( tape, block );
+  rec_state.last_edge_tstates = edge_tstates;
+  rec_state.carried_tstates = 0;
+}
 
-  rec_state.tape_buffer = NULL;
-  rec_state.tape_buffer_size = 0;
-  rec_state.tape_buffer_used = 0;
+void
+tape_frame( libspectrum_dword frame_length )
+{
+  if( !tape_recording ) return;
 
-  tape_modified = 1;
-  ui_tape_browser_update( UI_TAPE_BROWSER_NEW_BLOCK, block );
+  /* Carry the current pulse over into the next frame */
+  if( rec_state.last_edge_tstates >= frame_length ) {
+    rec_state.last_edge_tstates -= frame_length;
+  } else {
+    rec_state.carried_tstates = rec_pulse_length( frame_length );
+    rec_state.last_edge_tstates = 0;
+  }
+}
+
+int
+tape_record_stop( void )
+{
+  /* put last pulse into the recording buffer, and that onto the tape */
+  write_rec_pulse( rec_pulse_length( tstates ) );
+  flush_rec_buffer();
+  tape_cache_rebuild();
 
   tape_recording = 0;
 
@@ -850,6 +935,184 @@ tape_record_stop( void )
   return 0;
 }
 
+static void
+tape_cache_free( void )
+{
+  libspectrum_free( tape_cache.pulses ); tape_cache.pulses = NULL;
+  libspectrum_free( tape_cache.block_start ); tape_cache.block_start = NULL;
+  tape_cache.count = 0;
+  tape_cache.block_count = 0;
+  tape_cache.cursor = tape_cache.block_begin = tape_cache.block = -1;
+  tape_cache.played = 0;
+}
+
+/* Play the whole tape from the start into the cache, then rewind it.
+   Tapes which loop or jump aren't cached: the cache can only say where
+   each block is first played, so it couldn't pick up again part way
+   through a loop */
+static void
+tape_cache_build( void )
+{
+  libspectrum_tape_iterator iterator;
+  libspectrum_tape_block *block;
+  libspectrum_dword edge_tstates;
+  tape_pulse_t *pulse;
+  size_t allocated = 65536, i;
+  long last_boundary = 0;
+  int flags, current;
+
+  tape_cache_free();
+
+  for( block = libspectrum_tape_iterator_init( &iterator, tape );
+       block;
+       block = libspectrum_tape_iterator_next( &iterator ) ) {
+
+    switch( libspectrum_tape_block_type( block ) ) {
+    case LIBSPECTRUM_TAPE_BLOCK_JUMP:
+    case LIBSPECTRUM_TAPE_BLOCK_LOOP_START:
+    case LIBSPECTRUM_TAPE_BLOCK_LOOP_END:
+    case LIBSPECTRUM_TAPE_BLOCK_CALLS:
+    case LIBSPECTRUM_TAPE_BLOCK_RETURN:
+      tape_cache.block_count = 0;
+      return;
+    default:
+      break;
+    }
+
+    tape_cache.block_count++;
+  }
+
+  if( !tape_cache.block_count || tape_cache.block_count > 0xffff ) return;
+
+  if( libspectrum_tape_nth_block( tape, 0 ) ) return;
+
+  tape_cache.block_start = libspectrum_new( long, tape_cache.block_count );
+  for( i = 0; i < tape_cache.block_count; i++ )
+    tape_cache.block_start[i] = -1;
+  tape_cache.block_start[0] = 0;
+
+  tape_cache.pulses = libspectrum_new( tape_pulse_t, allocated );
+  current = 0;
+
+  while( tape_cache.count < TAPE_CACHE_MAX_PULSES ) {
+
+    if( libspectrum_tape_get_next_edge( &edge_tstates, &flags, tape ) )
+      break;
+
+    /* Finding the position is slow, so only do it when it may change */
+    if( flags & LIBSPECTRUM_TAPE_FLAGS_BLOCK )
+      current = tape_position();
+
+    /* Extend the previous entry if this edge is the same */
+    pulse = tape_cache.count ? &tape_cache.pulses[ tape_cache.count - 1 ] :
+                               NULL;
+    if( pulse && pulse->tstates == edge_tstates && pulse->flags == flags &&
+        !( flags & LIBSPECTRUM_TAPE_FLAGS_BLOCK ) &&
+        pulse->repeats < 0xffffffff ) {
+      pulse->repeats++;
+      continue;
+    }
+
+    if( tape_cache.count == allocated ) {
+      allocated *= 2;
+      tape_cache.pulses =
+        libspectrum_renew( tape_pulse_t, tape_cache.pulses, allocated );
+    }
+
+    pulse = &tape_cache.pulses[ tape_cache.count++ ];
+    pulse->tstates = edge_tstates;
+    pulse->repeats = 1;
+    pulse->flags = flags;
+    pulse->block = current;
+
+    if( flags & LIBSPECTRUM_TAPE_FLAGS_BLOCK ) {
+      last_boundary = tape_cache.count;
+      if( current >= 0 && tape_cache.block_start[ current ] == -1 )
+        tape_cache.block_start[ current ] = tape_cache.count;
+      if( flags & LIBSPECTRUM_TAPE_FLAGS_TAPE ) break;
+    }
+  }
+
+  /* Always end the cache at a block boundary, so libspectrum can carry on
+     from where it leaves off */
+  tape_cache.count = last_boundary;
+
+  libspectrum_tape_nth_block( tape, 0 );
+
+  if( !tape_cache.count ) {
+    tape_cache_free();
+    return;
+  }
+
+  tape_cache.pulses =
+    libspectrum_renew( tape_pulse_t, tape_cache.pulses, tape_cache.count );
+  tape_cache.cursor = tape_cache.block_begin = tape_cache.block = 0;
+}
+
+/* Rebuild the cache after a block has been added to the tape, leaving the
+   tape where it was */
+static void
+tape_cache_rebuild( void )
+{
+  int position = tape_position();
+
+  tape_cache_build();
+
+  if( position > 0 && !libspectrum_tape_nth_block( tape, position ) )
+    tape_cache_seek( position );
+}
+
+/* The tape has been moved to the start of 'block' */
+static void
+tape_cache_seek( int block )
+{
+  long start;
+
+  if( !tape_cache.pulses ) return;
+
+  start = block >= 0 && (size_t)block < tape_cache.block_count ?
+          tape_cache.block_start[ block ] : -1;
+
+  if( start >= tape_cache.count ) start = -1;
+
+  tape_cache.cursor = tape_cache.block_begin = start;
+  tape_cache.played = 0;
+  tape_cache.block = block;
+}
+
+/* Get the next edge from the cache if it's playing the tape. libspectrum
+   is kept at the start of the current block for the benefit of the tape
+   browser and the traps */
+static int
+tape_cache_next_edge( libspectrum_dword *edge_tstates, int *flags )
+{
+  tape_pulse_t *pulse;
+
+  if( tape_cache.cursor < 0 ) return 0;
+
+  pulse = &tape_cache.pulses[ tape_cache.cursor ];
+
+  *edge_tstates = pulse->tstates;
+  *flags = pulse->flags;
+
+  if( ++tape_cache.played < pulse->repeats ) return 1;
+
+  tape_cache.played = 0;
+  tape_cache.cursor++;
+
+  if( pulse->flags & LIBSPECTRUM_TAPE_FLAGS_BLOCK ) {
+    libspectrum_tape_nth_block( tape, pulse->block );
+    if( tape_cache.cursor < tape_cache.count ) {
+      tape_cache.block_begin = tape_cache.cursor;
+      tape_cache.block = pulse->block;
+    } else {
+      tape_cache_seek( pulse->block );
+    }
+  }
+
+  return 1;
+}
+
 void
 tape_next_edge( libspectrum_dword last_tstates, int from_acceleration )
 {
@@ -863,9 +1126,14 @@ tape_next_edge( libspectrum_dword last_tstates, int from_acceleration )
   if( ! tape_playing ) return;
 
   /* Get the time until the next edge */
-  libspec_error = libspectrum_tape_get_next_edge( &edge_tstates, &flags,
-						  tape );
-  if( libspec_error != LIBSPECTRUM_ERROR_NONE ) return;
+  if( !tape_cache_next_edge( &edge_tstates, &flags ) ) {
+    libspec_error = libspectrum_tape_get_next_edge( &edge_tstates, &flags,
+                                                    tape );
+    if( libspec_error != LIBSPECTRUM_ERROR_NONE ) return;
+
+    if( flags & LIBSPECTRUM_TAPE_FLAGS_BLOCK )
+      tape_cache_seek( tape_position() );
+  }
 
   /* Invert the microphone state */
   if( edge_tstates ||
@@ -58,6 +58,9 @@ int tape_present( void );
 
 void tape_record_start( void );
 int tape_record_stop( void );
+void tape_record_edge( libspectrum_dword edge_tstates );
+
+void tape_frame( libspectrum_dword frame_length );
 
 /* Call a user-supplied function for every block in the current tape */
 int
@@ -23,12 +23,17 @@
 
 #include "config.h"
 
+#include "display.h"
 #include "event.h"
 #include "infrastructure/startup_manager.h"
+#include "keyboard.h"
+#include "loader.h"
 #include "movie.h"
 #include "phantom_typist.h"
+#include "rzx.h"
 #include "settings.h"
 #include "sound.h"
+#include "sound/render.h"
 #include "tape.h"
 #include "timer.h"
 #include "ui/ui.h"
@@ -57,6 +62,12 @@ static double start_time;
 
 static const int TEN_MS = 10;
 
+/* Non-zero while the tape is being loaded in turbo mode */
+static int turbo_active = 0;
+
+/* Leave turbo mode once the tape hasn't been read for this many frames */
+static const int TURBO_IDLE_FRAMES = 2;
+
 int timer_event;
 
 static void timer_frame( libspectrum_dword last_tstates, int event GCC_UNUSED,
@@ -141,23 +152,15 @@ timer_register_startup( void )
 #ifdef SOUND_FIFO
 
 /* Callback-style sound based timer */
-#include "sound/sfifo.h"
+#include "sound/ringbuf.h"
 
-extern sfifo_t sound_fifo;
+extern sound_ringbuf_t sound_fifo;
 
 static void
 timer_frame_callback_sound( libspectrum_dword last_tstates )
 {
-  for(;;) {
-
-    /* Sleep while fifo is full */
-    if( sfifo_space( &sound_fifo ) < sound_framesiz ) {
-      timer_sleep( TEN_MS );
-    } else {
-      break;
-    }
-
-  }
+  /* Block until the sound callback has made room for the next frame */
+  sound_ringbuf_wait_space( &sound_fifo, sound_framesiz );
 
   event_add( last_tstates + machine_current->timings.tstates_per_frame,
              timer_event );
@@ -199,6 +202,60 @@ timer_fastloading_active( void )
   return tape_is_playing() || phantom_typist_is_active();
 }
 
+static int
+turbo_key_pressed( void )
+{
+  int i;
+
+  for( i = 0; i < 8; i++ )
+    if( ( keyboard_return_values[i] & 0x1f ) != 0x1f ) return 1;
+
+  return 0;
+}
+
+static int
+turbo_wanted( void )
+{
+  /* Seeking in an RZX file runs flat out until we get there, unless every
+     frame is being written to a movie */
+  if( rzx_seeking() ) return !movie_recording && !sound_render_active;
+
+  return settings_current.tape_turbo &&
+         tape_is_playing() &&
+         loader_frames_since_read() < TURBO_IDLE_FRAMES &&
+         !phantom_typist_is_active() &&
+         !turbo_key_pressed() &&
+         !rzx_playback && !rzx_recording &&
+         !movie_recording && !sound_render_active;
+}
+
+/* Called once per frame to start or stop turbo loading, during which
+   nothing is displayed, there is no sound and the emulation runs as fast
+   as possible */
+void
+timer_turbo_frame( void )
+{
+  int wanted = turbo_wanted();
+
+  if( wanted == turbo_active ) return;
+
+  turbo_active = wanted;
+
+  if( turbo_active ) {
+    sound_pause();
+  } else {
+    sound_unpause();
+    display_refresh_all();
+    timer_estimate_reset();
+  }
+}
+
+int
+timer_turbo_active( void )
+{
+  return turbo_active;
+}
+
 static void
 timer_frame( libspectrum_dword last_tstates, int event GCC_UNUSED,
 	     void *user_data GCC_UNUSED )
@@ -206,7 +263,17 @@ timer_frame( libspectrum_dword last_tstates, int event GCC_UNUSED,
   double current_time, difference;
   long tstates;
 
-  if( sound_enabled && settings_current.sound ) {
+  /* If we're running unthrottled, turbo loading or rendering sound to a
+     file, never wait for the sound device or the clock */
+  if( settings_current.unthrottled || turbo_active || sound_render_active ) {
+    event_add( last_tstates + machine_current->timings.tstates_per_frame,
+               timer_event );
+    return;
+  }
+
+  /* In low latency mode, the sound code adjusts its output rate to follow
+     us instead */
+  if( sound_enabled && settings_current.sound && !sound_rate_controlled() ) {
     timer_frame_callback_sound( last_tstates );
     return;
   }
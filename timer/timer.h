@@ -38,6 +38,9 @@ void timer_start_fastloading( void );
 void timer_stop_fastloading( void );
 int timer_fastloading_active( void );
 
+void timer_turbo_frame( void );
+int timer_turbo_active( void );
+
 /* Internal routines */
 
 double timer_get_time( void );
@@ -653,11 +653,16 @@ static const struct menu_item_entries menu_item_lookup[] = {
     "/File/Recording/Play...", 1,
     "/File/Recording/Finalise...", 1 },
 
+  { UI_MENU_ITEM_RECORDING_INSERT, "/File/Recording/Insert snapshot" },
+
   { UI_MENU_ITEM_RECORDING_ROLLBACK,
-    "/File/Recording/Insert snapshot",
-    "/File/Recording/Rollback", 0,
+    "/File/Recording/Rollback",
     "/File/Recording/Rollback to...", 0 },
 
+  { UI_MENU_ITEM_RECORDING_SEEK,
+    "/File/Recording/Skip forward",
+    "/File/Recording/Skip back", 0 },
+
   { UI_MENU_ITEM_AY_LOGGING,
     "/File/AY Logging/Stop",
     "/File/AY Logging/Record...", 1, },
@@ -296,8 +296,10 @@ static void
 add_filter_movie_files( GtkFileFilter *filter )
 {
   gtk_file_filter_add_pattern( filter, "*.fmf" );
+  gtk_file_filter_add_pattern( filter, "*.y4m" );
 
   gtk_file_filter_add_pattern( filter, "*.FMF" );
+  gtk_file_filter_add_pattern( filter, "*.Y4M" );
 }
 
 static void
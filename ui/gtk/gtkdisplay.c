@@ -501,6 +501,26 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   }
 }
 
+/* Fill the `w' chunks of 8 pixels starting at ( (8*x) , y ) with colour
+   `colour' */
+void
+uidisplay_fill8( int x, int y, int w, libspectrum_byte colour )
+{
+  libspectrum_word *dest;
+  int i, n;
+
+  if( machine_current->timex ) {
+    x <<= 4; y <<= 1; w <<= 4;
+    for( i=0; i<2; i++,y++ ) {
+      dest = &gtkdisplay_image[y][x];
+      for( n = w; n; n-- ) *dest++ = colour;
+    }
+  } else {
+    dest = &gtkdisplay_image[y][x << 3];
+    for( n = w << 3; n; n-- ) *dest++ = colour;
+  }
+}
+
 /* Print the 16 pixels in `data' using ink colour `ink' and paper
    colour `paper' to the screen at ( (16*x) , y ) */
 void
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "keyboard.h"
+#include "nulldisplay.h"
 #include "ui/ui.h"
 
 #include "../uijoystick.c"
@@ -96,8 +97,7 @@ ui_debugger_update( void )
 int
 ui_end( void )
 {
-  /* No error */
-  return 0;
+  return nulldisplay_end();
 }
 
 int
@@ -204,56 +204,3 @@ ui_widgets_reset( void )
   /* No error */
   return 0;
 }
-
-void
-uidisplay_area( int x, int y, int w, int h )
-{
-  /* Do nothing */
-}
-
-int
-uidisplay_end( void )
-{
-  /* No error */
-  return 0;
-}
-
-void
-uidisplay_frame_end( void )
-{
-  /* Do nothing */
-}
-
-int
-uidisplay_hotswap_gfx_mode( void )
-{
-  /* No error */
-  return 0;
-}
-
-int
-uidisplay_init( int width, int height )
-{
-  /* No error */
-  return 0;
-}
-
-void
-uidisplay_plot16( int x, int y, libspectrum_word data,
-    libspectrum_byte ink, libspectrum_byte paper )
-{
-  /* Do nothing */
-}
-
-void
-uidisplay_plot8( int x, int y, libspectrum_byte data,
-    libspectrum_byte ink, libspectrum_byte paper )
-{
-  /* Do nothing */
-}
-
-void
-uidisplay_putpixel( int x, int y, int colour )
-{
-  /* Do nothing */
-}
@@ -0,0 +1,406 @@
+/* nulldisplay.c: Routines for dealing with the null UI's headless display
+   Copyright (c) 2026 agent
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: agent@local
+
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libspectrum.h"
+
+#include "display.h"
+#include "machine.h"
+#include "nulldisplay.h"
+#include "settings.h"
+#include "ui/ui.h"
+#include "ui/uidisplay.h"
+
+/* The formats we can stream frames in */
+typedef enum nulldisplay_format {
+  NULLDISPLAY_FORMAT_RAW,	/* Packed 24-bit RGB, no headers */
+  NULLDISPLAY_FORMAT_Y4M,	/* YUV4MPEG2, 4:4:4 */
+} nulldisplay_format;
+
+/* A copy of every pixel on the screen, as a palette index. As with the
+   framebuffer UI, Timex machines use the whole image, other machines only
+   the top left quarter */
+static libspectrum_byte
+  nulldisplay_image[ 2 * DISPLAY_SCREEN_HEIGHT ][ DISPLAY_SCREEN_WIDTH ];
+
+/* The file we're streaming frames to, if any */
+static FILE *output;
+static nulldisplay_format output_format;
+
+/* The size of each frame written to the stream; fixed when the stream is
+   opened so that consumers see a constant frame size even if the emulated
+   machine changes */
+static int output_hires, output_width, output_height;
+
+/* The converted frame waiting to be written */
+static libspectrum_byte *output_buffer;
+static size_t output_buffer_size;
+
+/* The frame hash of the image in output_buffer, and whether the buffer is
+   valid at all; identical frames are written again without conversion */
+static libspectrum_qword output_buffer_hash;
+static int output_buffer_valid;
+
+/* The number of frames until we next write one to the stream */
+static int frames_until_output;
+
+/* The colours we write for each palette entry, as RGB and Y'CbCr */
+static libspectrum_byte output_rgb[16][3];
+static libspectrum_byte output_ycbcr[16][3];
+
+static const	                   /*  R    G    B */
+libspectrum_byte palette[16][3] = { {   0,   0,   0 },
+                                    {   0,   0, 192 },
+                                    { 192,   0,   0 },
+                                    { 192,   0, 192 },
+                                    {   0, 192,   0 },
+                                    {   0, 192, 192 },
+                                    { 192, 192,   0 },
+                                    { 192, 192, 192 },
+                                    {   0,   0,   0 },
+                                    {   0,   0, 255 },
+                                    { 255,   0,   0 },
+                                    { 255,   0, 255 },
+                                    {   0, 255,   0 },
+                                    {   0, 255, 255 },
+                                    { 255, 255,   0 },
+                                    { 255, 255, 255 } };
+
+static void
+init_colours( void )
+{
+  size_t i;
+
+  for( i = 0; i < 16; i++ ) {
+    double red, green, blue, luma;
+
+    red   = palette[i][0];
+    green = palette[i][1];
+    blue  = palette[i][2];
+
+    if( settings_current.bw_tv ) {
+      /* Addition of 0.5 is to avoid rounding errors */
+      red = green = blue =
+        (libspectrum_byte)( 0.299 * red + 0.587 * green + 0.114 * blue + 0.5 );
+    }
+
+    output_rgb[i][0] = red;
+    output_rgb[i][1] = green;
+    output_rgb[i][2] = blue;
+
+    /* ITU-R BT.601, studio swing */
+    luma = 0.299 * red + 0.587 * green + 0.114 * blue;
+    output_ycbcr[i][0] = 16 + 219.0 * luma / 255.0 + 0.5;
+    output_ycbcr[i][1] = 128 + 224.0 * ( blue - luma ) / ( 1.772 * 255.0 ) + 0.5;
+    output_ycbcr[i][2] = 128 + 224.0 * ( red - luma ) / ( 1.402 * 255.0 ) + 0.5;
+  }
+}
+
+static int
+output_open( void )
+{
+  const char *format = settings_current.headless_format;
+  libspectrum_dword frame_length;
+  int interval;
+
+  if( !format || !strcmp( format, "raw" ) ) {
+    output_format = NULLDISPLAY_FORMAT_RAW;
+  } else if( !strcmp( format, "y4m" ) ) {
+    output_format = NULLDISPLAY_FORMAT_Y4M;
+  } else {
+    ui_error( UI_ERROR_ERROR, "Unknown headless output format `%s'", format );
+    return 1;
+  }
+
+  output = fopen( settings_current.headless_output, "wb" );
+  if( !output ) {
+    ui_error( UI_ERROR_ERROR, "Couldn't open `%s': %s",
+              settings_current.headless_output, strerror( errno ) );
+    return 1;
+  }
+
+  output_hires = machine_current->timex;
+  output_width = output_hires ? DISPLAY_SCREEN_WIDTH : DISPLAY_ASPECT_WIDTH;
+  output_height = output_hires ? 2 * DISPLAY_SCREEN_HEIGHT :
+                                 DISPLAY_SCREEN_HEIGHT;
+
+  output_buffer_size = 3 * output_width * output_height;
+  output_buffer = libspectrum_new( libspectrum_byte, output_buffer_size );
+
+  init_colours();
+  frames_until_output = 0;
+
+  if( output_format == NULLDISPLAY_FORMAT_Y4M ) {
+
+    interval = settings_current.headless_interval > 1 ?
+               settings_current.headless_interval : 1;
+    frame_length = machine_current->timings.tstates_per_frame * interval *
+                   ( settings_current.frame_rate > 1 ?
+                     settings_current.frame_rate : 1 );
+
+    fprintf( output, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n",
+             output_width, output_height,
+             (int)machine_current->timings.processor_speed,
+             (int)frame_length );
+  }
+
+  return 0;
+}
+
+static void
+output_close( void )
+{
+  if( !output ) return;
+
+  if( fclose( output ) ) {
+    ui_error( UI_ERROR_ERROR, "Couldn't close `%s': %s",
+              settings_current.headless_output, strerror( errno ) );
+  }
+  output = NULL;
+
+  libspectrum_free( output_buffer );
+  output_buffer = NULL;
+  output_buffer_valid = 0;
+}
+
+/* Fetch line 'y' of the output frame as palette indices, scaling from the
+   current machine's image size to the stream's frame size as necessary */
+static void
+get_line( int y, libspectrum_byte *dest )
+{
+  const libspectrum_byte *src;
+  int x;
+
+  if( output_hires == machine_current->timex ) {
+    memcpy( dest, nulldisplay_image[y], output_width );
+  } else if( output_hires ) {
+    src = nulldisplay_image[ y >> 1 ];
+    for( x = 0; x < output_width; x++ ) dest[x] = src[ x >> 1 ];
+  } else {
+    src = nulldisplay_image[ y << 1 ];
+    for( x = 0; x < output_width; x++ ) dest[x] = src[ x << 1 ];
+  }
+}
+
+static void
+convert_frame( void )
+{
+  libspectrum_byte line[ DISPLAY_SCREEN_WIDTH ];
+  libspectrum_byte *luma, *cb, *cr, *rgb;
+  size_t plane_size = output_width * output_height;
+  int x, y;
+
+  switch( output_format ) {
+
+  case NULLDISPLAY_FORMAT_RAW:
+    rgb = output_buffer;
+    for( y = 0; y < output_height; y++ ) {
+      get_line( y, line );
+      for( x = 0; x < output_width; x++ ) {
+        *rgb++ = output_rgb[ line[x] ][0];
+        *rgb++ = output_rgb[ line[x] ][1];
+        *rgb++ = output_rgb[ line[x] ][2];
+      }
+    }
+    break;
+
+  case NULLDISPLAY_FORMAT_Y4M:
+    luma = output_buffer; cb = luma + plane_size; cr = cb + plane_size;
+    for( y = 0; y < output_height; y++ ) {
+      get_line( y, line );
+      for( x = 0; x < output_width; x++ ) {
+        *luma++ = output_ycbcr[ line[x] ][0];
+        *cb++   = output_ycbcr[ line[x] ][1];
+        *cr++   = output_ycbcr[ line[x] ][2];
+      }
+    }
+    break;
+
+  }
+}
+
+static int
+output_frame( void )
+{
+  libspectrum_qword hash = display_get_frame_hash();
+
+  if( !output_buffer_valid || hash != output_buffer_hash ) {
+    convert_frame();
+    output_buffer_hash = hash;
+    output_buffer_valid = 1;
+  }
+
+  if( output_format == NULLDISPLAY_FORMAT_Y4M ) fputs( "FRAME\n", output );
+
+  if( fwrite( output_buffer, 1, output_buffer_size, output ) !=
+      output_buffer_size ) {
+    ui_error( UI_ERROR_ERROR, "Couldn't write to `%s': %s",
+              settings_current.headless_output, strerror( errno ) );
+    return 1;
+  }
+
+  return 0;
+}
+
+int
+uidisplay_init( int width, int height )
+{
+  /* The stream stays open across machine changes */
+  if( !output && settings_current.headless_output ) {
+    if( output_open() ) return 1;
+  }
+
+  display_ui_initialised = 1;
+
+  /* The image layout may have changed */
+  output_buffer_valid = 0;
+
+  display_refresh_all();
+
+  return 0;
+}
+
+int
+nulldisplay_end( void )
+{
+  output_close();
+
+  return 0;
+}
+
+void
+uidisplay_area( int x, int y, int w, int h )
+{
+  /* Do nothing; the whole frame is written at the end of each frame */
+}
+
+void
+uidisplay_frame_end( void )
+{
+  if( !output ) return;
+
+  if( frames_until_output-- > 0 ) return;
+
+  frames_until_output = settings_current.headless_interval - 1;
+
+  if( output_frame() ) output_close();
+}
+
+int
+uidisplay_hotswap_gfx_mode( void )
+{
+  /* No error */
+  return 0;
+}
+
+int
+uidisplay_end( void )
+{
+  display_ui_initialised = 0;
+
+  return 0;
+}
+
+/* Set one pixel in the display */
+void
+uidisplay_putpixel( int x, int y, int colour )
+{
+  if( machine_current->timex ) {
+    x <<= 1; y <<= 1;
+    nulldisplay_image[y  ][x  ] = colour;
+    nulldisplay_image[y  ][x+1] = colour;
+    nulldisplay_image[y+1][x  ] = colour;
+    nulldisplay_image[y+1][x+1] = colour;
+  } else {
+    nulldisplay_image[y][x] = colour;
+  }
+}
+
+/* Print the 8 pixels in `data' using ink colour `ink' and paper
+   colour `paper' to the screen at ( (8*x) , y ) */
+void
+uidisplay_plot8( int x, int y, libspectrum_byte data,
+                 libspectrum_byte ink, libspectrum_byte paper )
+{
+  libspectrum_byte *dest;
+  int i;
+
+  x <<= 3;
+
+  if( machine_current->timex ) {
+    x <<= 1; y <<= 1;
+    for( i = 0; i < 2; i++, y++ ) {
+      libspectrum_byte mask;
+
+      dest = &nulldisplay_image[y][x];
+      for( mask = 0x80; mask; mask >>= 1 ) {
+        *dest++ = ( data & mask ) ? ink : paper;
+        *dest++ = ( data & mask ) ? ink : paper;
+      }
+    }
+  } else {
+    libspectrum_byte mask;
+
+    dest = &nulldisplay_image[y][x];
+    for( mask = 0x80; mask; mask >>= 1 )
+      *dest++ = ( data & mask ) ? ink : paper;
+  }
+}
+
+/* Fill the `w' chunks of 8 pixels starting at ( (8*x) , y ) with colour
+   `colour' */
+void
+uidisplay_fill8( int x, int y, int w, libspectrum_byte colour )
+{
+  if( machine_current->timex ) {
+    x <<= 4; y <<= 1; w <<= 4;
+    memset( &nulldisplay_image[y  ][x], colour, w );
+    memset( &nulldisplay_image[y+1][x], colour, w );
+  } else {
+    memset( &nulldisplay_image[y][x << 3], colour, w << 3 );
+  }
+}
+
+/* Print the 16 pixels in `data' using ink colour `ink' and paper
+   colour `paper' to the screen at ( (16*x) , y ) */
+void
+uidisplay_plot16( int x, int y, libspectrum_word data,
+                  libspectrum_byte ink, libspectrum_byte paper )
+{
+  libspectrum_byte *dest;
+  libspectrum_word mask;
+  int i;
+
+  x <<= 4; y <<= 1;
+
+  for( i = 0; i < 2; i++, y++ ) {
+    dest = &nulldisplay_image[y][x];
+    for( mask = 0x8000; mask; mask >>= 1 )
+      *dest++ = ( data & mask ) ? ink : paper;
+  }
+}
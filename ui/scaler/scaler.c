@@ -154,12 +154,23 @@ scaler_select_scaler( scaler_type scaler )
 
 int
 scaler_select_id( const char *id )
+{
+  scaler_type scaler;
+
+  if( scaler_get_type_from_id( id, &scaler ) ) return 1;
+
+  scaler_select_scaler( scaler );
+  return 0;
+}
+
+int
+scaler_get_type_from_id( const char *id, scaler_type *scaler )
 {
   scaler_type i;
 
   for( i=0; i < SCALER_NUM; i++ ) {
     if( ! strcmp( available_scalers[i].id, id ) ) {
-      scaler_select_scaler( i );
+      *scaler = i;
       return 0;
     }
   }
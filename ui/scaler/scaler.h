@@ -80,6 +80,7 @@ extern int scalers_registered;
 typedef int (*scaler_available_fn)( scaler_type scaler );
 
 int scaler_select_id( const char *scaler_mode );
+int scaler_get_type_from_id( const char *scaler_mode, scaler_type *scaler );
 void scaler_register_clear( void );
 int scaler_select_scaler( scaler_type scaler );
 void scaler_register( scaler_type scaler );
@@ -0,0 +1,967 @@
+/* sdl2display.c: Routines for dealing with the SDL 2 display
+   Copyright (c) 2000-2006 Philip Kendall, Matan Ziv-Av, Fredrick Meunier
+   Copyright (c) 2015 Adrien Destugues
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+#include "config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "libspectrum.h"
+
+#include "display.h"
+#include "fuse.h"
+#include "machine.h"
+#include "peripherals/scld.h"
+#include "screenshot.h"
+#include "settings.h"
+#include "ui/ui.h"
+#include "ui/scaler/scaler.h"
+#include "ui/uidisplay.h"
+#include "utils.h"
+#include "sdldisplay.h"
+
+/* The window, renderer and texture survive machine changes; only the
+   texture is recreated when the size of the picture changes */
+SDL_Window *sdldisplay_window = NULL;
+static SDL_Renderer *sdldisplay_renderer = NULL;
+static SDL_Texture *sdldisplay_texture = NULL;
+
+static SDL_Surface *tmp_screen=NULL; /* Temporary screen for scalers */
+
+/* The output of the scalers; dirty regions of this are uploaded to the
+   streaming texture at the end of each frame */
+static libspectrum_byte *scaled_screen = NULL;
+static int scaled_pitch;
+static int scaled_width;
+static int scaled_height;
+
+static SDL_Surface *red_cassette[2], *green_cassette[2];
+static SDL_Surface *red_mdr[2], *green_mdr[2];
+static SDL_Surface *red_disk[2], *green_disk[2];
+
+static ui_statusbar_state sdl_disk_state, sdl_mdr_state, sdl_tape_state;
+static int sdl_status_updated;
+
+static int tmp_screen_width;
+
+static Uint32 colour_values[16];
+
+static SDL_Color colour_palette[] = {
+  {   0,   0,   0, 255 },
+  {   0,   0, 192, 255 },
+  { 192,   0,   0, 255 },
+  { 192,   0, 192, 255 },
+  {   0, 192,   0, 255 },
+  {   0, 192, 192, 255 },
+  { 192, 192,   0, 255 },
+  { 192, 192, 192, 255 },
+  {   0,   0,   0, 255 },
+  {   0,   0, 255, 255 },
+  { 255,   0,   0, 255 },
+  { 255,   0, 255, 255 },
+  {   0, 255,   0, 255 },
+  {   0, 255, 255, 255 },
+  { 255, 255,   0, 255 },
+  { 255, 255, 255, 255 }
+};
+
+static Uint32 bw_values[16];
+
+/* This is a rule of thumb for the maximum number of rects that can be updated
+   each frame. If more are generated we just update the whole screen */
+#define MAX_UPDATE_RECT 300
+static SDL_Rect updated_rects[MAX_UPDATE_RECT];
+static int num_rects = 0;
+static libspectrum_byte sdldisplay_force_full_refresh = 1;
+
+static int fullscreen_width = 0;
+static int fullscreen_height = 0;
+
+/* The current size of the display (in units of DISPLAY_SCREEN_*) */
+static float sdldisplay_current_size = 1;
+
+static libspectrum_byte sdldisplay_is_full_screen = 0;
+
+static int image_width;
+static int image_height;
+
+static int timex;
+
+static void init_scalers( void );
+static int sdldisplay_allocate_colours( int numColours, Uint32 *colour_values,
+                                        Uint32 *bw_values );
+
+static int sdldisplay_load_gfx_mode( void );
+
+static void
+init_scalers( void )
+{
+  scaler_register_clear();
+
+  scaler_register( SCALER_NORMAL );
+  scaler_register( SCALER_2XSAI );
+  scaler_register( SCALER_SUPER2XSAI );
+  scaler_register( SCALER_SUPEREAGLE );
+  scaler_register( SCALER_ADVMAME2X );
+  scaler_register( SCALER_ADVMAME3X );
+  scaler_register( SCALER_DOTMATRIX );
+  scaler_register( SCALER_PALTV );
+  scaler_register( SCALER_HQ2X );
+  if( machine_current->timex ) {
+    scaler_register( SCALER_HALF );
+    scaler_register( SCALER_HALFSKIP );
+    scaler_register( SCALER_TIMEXTV );
+    scaler_register( SCALER_TIMEX1_5X );
+    scaler_register( SCALER_TIMEX2X );
+  } else {
+    scaler_register( SCALER_DOUBLESIZE );
+    scaler_register( SCALER_TRIPLESIZE );
+    scaler_register( SCALER_QUADSIZE );
+    scaler_register( SCALER_TV2X );
+    scaler_register( SCALER_TV3X );
+    scaler_register( SCALER_TV4X );
+    scaler_register( SCALER_PALTV2X );
+    scaler_register( SCALER_PALTV3X );
+    scaler_register( SCALER_PALTV4X );
+    scaler_register( SCALER_HQ3X );
+    scaler_register( SCALER_HQ4X );
+  }
+
+  if( scaler_is_supported( current_scaler ) ) {
+    scaler_select_scaler( current_scaler );
+  } else {
+    scaler_select_scaler( SCALER_NORMAL );
+  }
+}
+
+static int
+sdl_convert_icon( SDL_Surface *source, SDL_Surface **icon, int red )
+{
+  SDL_Surface *copy;   /* Copy with altered palette */
+  int i;
+
+  SDL_Color colors[ source->format->palette->ncolors ];
+
+  copy = SDL_ConvertSurface( source, source->format, 0 );
+
+  for( i = 0; i < copy->format->palette->ncolors; i++ ) {
+    colors[i].r = red ? copy->format->palette->colors[i].r : 0;
+    colors[i].g = red ? 0 : copy->format->palette->colors[i].g;
+    colors[i].b = 0;
+    colors[i].a = 255;
+  }
+
+  SDL_SetPaletteColors( copy->format->palette, colors, 0, i );
+
+  icon[0] = SDL_ConvertSurface( copy, tmp_screen->format, 0 );
+
+  SDL_FreeSurface( copy );
+
+  icon[1] = SDL_CreateRGBSurface( 0, (icon[0]->w)<<1, (icon[0]->h)<<1,
+                                  icon[0]->format->BitsPerPixel,
+                                  icon[0]->format->Rmask,
+                                  icon[0]->format->Gmask,
+                                  icon[0]->format->Bmask,
+                                  icon[0]->format->Amask
+                                );
+
+  ( scaler_get_proc16( SCALER_DOUBLESIZE ) )(
+        (libspectrum_byte*)icon[0]->pixels,
+        icon[0]->pitch,
+        (libspectrum_byte*)icon[1]->pixels,
+        icon[1]->pitch, icon[0]->w, icon[0]->h
+      );
+
+  return 0;
+}
+
+static int
+sdl_load_status_icon( const char*filename, SDL_Surface **red, SDL_Surface **green )
+{
+  char path[ PATH_MAX ];
+  SDL_Surface *temp;    /* Copy of image as loaded */
+
+  if( utils_find_file_path( filename, path, UTILS_AUXILIARY_LIB ) ) {
+    fprintf( stderr, "%s: Error getting path for icons\n", fuse_progname );
+    return -1;
+  }
+
+  if((temp = SDL_LoadBMP(path)) == NULL) {
+    fprintf( stderr, "%s: Error loading icon \"%s\" text:%s\n", fuse_progname,
+             path, SDL_GetError() );
+    return -1;
+  }
+
+  if(temp->format->palette == NULL) {
+    fprintf( stderr, "%s: Icon \"%s\" is not paletted\n", fuse_progname, path );
+    return -1;
+  }
+
+  sdl_convert_icon( temp, red, 1 );
+  sdl_convert_icon( temp, green, 0 );
+
+  SDL_FreeSurface( temp );
+
+  return 0;
+}
+
+int
+uidisplay_init( int width, int height )
+{
+  int i, no_modes, mw = 0, mh = 0, mn = 0;
+  SDL_DisplayMode mode;
+
+  no_modes = SDL_GetNumDisplayModes( 0 );
+  if( no_modes < 0 ) no_modes = 0;
+
+  if( settings_current.sdl_fullscreen_mode &&
+      strcmp( settings_current.sdl_fullscreen_mode, "list" ) == 0 ) {
+
+    fprintf( stderr,
+    "=====================================================================\n"
+    " List of available SDL fullscreen modes:\n"
+    "---------------------------------------------------------------------\n"
+    "  No. width height\n"
+    "---------------------------------------------------------------------\n"
+    );
+    if( !no_modes ) {
+      fprintf( stderr, "  ** The modes list is empty, the desktop "
+                       "resolution will be used...\n" );
+    } else {
+      for( i = 0; i < no_modes; i++ ) {
+        if( SDL_GetDisplayMode( 0, i, &mode ) ) continue;
+        fprintf( stderr, "% 3d  % 5d % 5d\n", i + 1, mode.w, mode.h );
+      }
+    }
+    fprintf( stderr,
+    "=====================================================================\n");
+    fuse_exiting = 1;
+    return 0;
+  }
+
+  if( settings_current.sdl_fullscreen_mode ) {
+    if( sscanf( settings_current.sdl_fullscreen_mode, " %dx%d", &mw, &mh ) != 2 ) {
+      mw = mh = 0;
+      if( sscanf( settings_current.sdl_fullscreen_mode, " %d", &mn ) == 1 &&
+          mn >= 1 && mn <= no_modes &&
+          !SDL_GetDisplayMode( 0, mn - 1, &mode ) ) {
+        mw = mode.w; mh = mode.h;
+      }
+    }
+  }
+
+  /* With no explicit mode, full screen uses the desktop resolution and
+     lets the renderer scale the picture to fit */
+  fullscreen_width = mw;
+  fullscreen_height = mh;
+
+  image_width = width;
+  image_height = height;
+
+  timex = machine_current->timex;
+
+  init_scalers();
+
+  if ( scaler_select_scaler( current_scaler ) )
+    scaler_select_scaler( SCALER_NORMAL );
+
+  if( sdldisplay_load_gfx_mode() ) return 1;
+
+  SDL_SetWindowTitle( sdldisplay_window, "Fuse" );
+
+  /* We can now output error messages to our output device */
+  display_ui_initialised = 1;
+
+  sdl_load_status_icon( "cassette.bmp", red_cassette, green_cassette );
+  sdl_load_status_icon( "microdrive.bmp", red_mdr, green_mdr );
+  sdl_load_status_icon( "plus3disk.bmp", red_disk, green_disk );
+
+  return 0;
+}
+
+static int
+sdldisplay_allocate_colours( int numColours, Uint32 *colour_values,
+                             Uint32 *bw_values )
+{
+  int i;
+  Uint8 red, green, blue, grey;
+
+  for( i = 0; i < numColours; i++ ) {
+
+      red = colour_palette[i].r;
+    green = colour_palette[i].g;
+     blue = colour_palette[i].b;
+
+    /* Addition of 0.5 is to avoid rounding errors */
+    grey = ( 0.299 * red + 0.587 * green + 0.114 * blue ) + 0.5;
+
+    colour_values[i] = SDL_MapRGB( tmp_screen->format,  red, green, blue );
+    bw_values[i]     = SDL_MapRGB( tmp_screen->format, grey,  grey, grey );
+  }
+
+  return 0;
+}
+
+static SDL_Renderer*
+sdldisplay_create_renderer( void )
+{
+  SDL_Renderer *renderer = NULL;
+  const char *type = settings_current.sdl_renderer;
+
+  /* No vsync: the picture is presented once per emulated frame, and the
+     emulation itself is paced by the sound device or the timer */
+  if( !type || strcmp( type, "software" ) ) {
+    renderer = SDL_CreateRenderer( sdldisplay_window, -1,
+                                   SDL_RENDERER_ACCELERATED );
+    if( renderer || ( type && !strcmp( type, "accelerated" ) ) )
+      return renderer;
+  }
+
+  return SDL_CreateRenderer( sdldisplay_window, -1, SDL_RENDERER_SOFTWARE );
+}
+
+static int
+sdldisplay_set_window( void )
+{
+  Uint32 fullscreen_flags = 0;
+
+  if( settings_current.full_screen ) {
+    fullscreen_flags = fullscreen_width ? SDL_WINDOW_FULLSCREEN :
+                                          SDL_WINDOW_FULLSCREEN_DESKTOP;
+  }
+
+  if( !sdldisplay_window ) {
+    sdldisplay_window = SDL_CreateWindow( "Fuse", SDL_WINDOWPOS_UNDEFINED,
+                                          SDL_WINDOWPOS_UNDEFINED,
+                                          scaled_width, scaled_height,
+                                          SDL_WINDOW_RESIZABLE );
+    if( !sdldisplay_window ) return 1;
+
+    sdldisplay_renderer = sdldisplay_create_renderer();
+    if( !sdldisplay_renderer ) return 1;
+  }
+
+  if( fullscreen_flags == SDL_WINDOW_FULLSCREEN ) {
+    SDL_DisplayMode mode;
+
+    if( !SDL_GetDesktopDisplayMode( 0, &mode ) ) {
+      mode.w = fullscreen_width;
+      mode.h = fullscreen_height;
+      SDL_SetWindowDisplayMode( sdldisplay_window, &mode );
+    }
+  }
+
+  if( SDL_SetWindowFullscreen( sdldisplay_window, fullscreen_flags ) ) {
+    SDL_SetWindowFullscreen( sdldisplay_window, 0 );
+    settings_current.full_screen = 0;
+  }
+
+  if( !settings_current.full_screen )
+    SDL_SetWindowSize( sdldisplay_window, scaled_width, scaled_height );
+
+  /* Scale the picture to the window, keeping the aspect ratio and, unless
+     told otherwise, only by whole multiples */
+  SDL_RenderSetLogicalSize( sdldisplay_renderer, scaled_width, scaled_height );
+#if SDL_VERSION_ATLEAST( 2, 0, 5 )
+  SDL_RenderSetIntegerScale( sdldisplay_renderer,
+                             settings_current.sdl_integer_scale ? SDL_TRUE :
+                                                                  SDL_FALSE );
+#endif
+
+  return 0;
+}
+
+static void
+sdldisplay_free_screens( void )
+{
+  if( tmp_screen ) {
+    free( tmp_screen->pixels );
+    SDL_FreeSurface( tmp_screen );
+    tmp_screen = NULL;
+  }
+
+  if( sdldisplay_texture ) {
+    SDL_DestroyTexture( sdldisplay_texture );
+    sdldisplay_texture = NULL;
+  }
+
+  libspectrum_free( scaled_screen ); scaled_screen = NULL;
+}
+
+static int
+sdldisplay_load_gfx_mode( void )
+{
+  Uint16 *tmp_screen_pixels;
+
+  sdldisplay_force_full_refresh = 1;
+
+  /* Free the old surfaces */
+  sdldisplay_free_screens();
+
+  tmp_screen_width = (image_width + 3);
+
+  sdldisplay_current_size = scaler_get_scaling_factor( current_scaler );
+
+  scaled_width = image_width * sdldisplay_current_size;
+  scaled_height = image_height * sdldisplay_current_size;
+
+  SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "nearest" );
+
+  if( sdldisplay_set_window() ) {
+    fprintf( stderr, "%s: couldn't create SDL window: %s\n", fuse_progname,
+             SDL_GetError() );
+    fuse_abort();
+  }
+
+  sdldisplay_is_full_screen = settings_current.full_screen;
+
+  /* The scalers write 16 bit pixels, so use a 565 texture and let the
+     renderer convert it if needs be */
+  scaler_select_bitformat( 565 );
+
+  sdldisplay_texture = SDL_CreateTexture( sdldisplay_renderer,
+                                          SDL_PIXELFORMAT_RGB565,
+                                          SDL_TEXTUREACCESS_STREAMING,
+                                          scaled_width, scaled_height );
+  if( !sdldisplay_texture ) {
+    fprintf( stderr, "%s: couldn't create SDL texture: %s\n", fuse_progname,
+             SDL_GetError() );
+    fuse_abort();
+  }
+
+  scaled_pitch = scaled_width * sizeof( Uint16 );
+  scaled_screen = libspectrum_new0( libspectrum_byte,
+                                    scaled_pitch * scaled_height );
+
+  /* Create the surface used for the graphics in 16 bit before scaling */
+
+  /* Need some extra bytes around when using 2xSaI */
+  tmp_screen_pixels = (Uint16*)calloc(tmp_screen_width*(image_height+3), sizeof(Uint16));
+  tmp_screen = SDL_CreateRGBSurfaceFrom(tmp_screen_pixels,
+                                        tmp_screen_width,
+                                        image_height + 3,
+                                        16, tmp_screen_width*2,
+                                        0xf800, 0x07e0, 0x001f, 0 );
+
+  if( !tmp_screen ) {
+    fprintf( stderr, "%s: couldn't create tmp_screen\n", fuse_progname );
+    fuse_abort();
+  }
+
+  sdldisplay_allocate_colours( 16, colour_values, bw_values );
+
+  /* Redraw the entire screen... */
+  display_refresh_all();
+
+  return 0;
+}
+
+int
+uidisplay_hotswap_gfx_mode( void )
+{
+  fuse_emulation_pause();
+
+  /* Setup the new GFX mode */
+  if( sdldisplay_load_gfx_mode() ) return 1;
+
+  if ( settings_current.full_screen || ui_mouse_grabbed ) {
+    SDL_ShowCursor( SDL_DISABLE );
+  } else {
+    SDL_ShowCursor( SDL_ENABLE );
+  }
+
+  fuse_emulation_unpause();
+
+  return 0;
+}
+
+static SDL_Surface *saved = NULL;
+
+void
+uidisplay_frame_save( void )
+{
+  if( saved ) {
+    SDL_FreeSurface( saved );
+    saved = NULL;
+  }
+
+  saved = SDL_ConvertSurface( tmp_screen, tmp_screen->format, 0 );
+}
+
+void
+uidisplay_frame_restore( void )
+{
+  if( saved ) {
+    SDL_BlitSurface( saved, NULL, tmp_screen, NULL );
+    sdldisplay_force_full_refresh = 1;
+  }
+}
+
+/* Scale an area of tmp_screen and upload it to the texture */
+static void
+sdldisplay_update_texture( int x, int y, int w, int h )
+{
+  SDL_Rect dst;
+
+  dst.x = x * sdldisplay_current_size;
+  dst.y = y * sdldisplay_current_size;
+  dst.w = w * sdldisplay_current_size;
+  dst.h = h * sdldisplay_current_size;
+
+  scaler_proc16(
+    (libspectrum_byte*)tmp_screen->pixels +
+                      (x+1) * tmp_screen->format->BytesPerPixel +
+                      (y+1) * tmp_screen->pitch,
+    tmp_screen->pitch,
+    scaled_screen + dst.x * sizeof( Uint16 ) + dst.y * scaled_pitch,
+    scaled_pitch, w, h
+  );
+
+  SDL_UpdateTexture( sdldisplay_texture, &dst,
+                     scaled_screen + dst.x * sizeof( Uint16 ) +
+                     dst.y * scaled_pitch,
+                     scaled_pitch );
+}
+
+static void
+sdl_blit_icon( SDL_Surface **icon, SDL_Rect *r )
+{
+  int x, y, w, h;
+
+  if( timex ) {
+    r->x<<=1;
+    r->y<<=1;
+    r->w<<=1;
+    r->h<<=1;
+  }
+
+  x = r->x;
+  y = r->y;
+  w = r->w;
+  h = r->h;
+  r->x++;
+  r->y++;
+
+  if( SDL_BlitSurface( icon[timex], NULL, tmp_screen, r ) ) return;
+
+  /* Extend the dirty region by 1 pixel for scalers
+     that "smear" the screen, e.g. 2xSAI */
+  if( scaler_flags & SCALER_FLAGS_EXPAND )
+    scaler_expander( &x, &y, &w, &h, image_width, image_height );
+
+  sdldisplay_update_texture( x, y, w, h );
+}
+
+static void
+sdl_icon_overlay( void )
+{
+  SDL_Rect r = { 243, 218, red_disk[0]->w, red_disk[0]->h };
+
+  switch( sdl_disk_state ) {
+  case UI_STATUSBAR_STATE_ACTIVE:
+    sdl_blit_icon( green_disk, &r );
+    break;
+  case UI_STATUSBAR_STATE_INACTIVE:
+    sdl_blit_icon( red_disk, &r );
+    break;
+  case UI_STATUSBAR_STATE_NOT_AVAILABLE:
+    break;
+  }
+
+  r.x = 264;
+  r.y = 218;
+  r.w = red_mdr[0]->w;
+  r.h = red_mdr[0]->h;
+
+  switch( sdl_mdr_state ) {
+  case UI_STATUSBAR_STATE_ACTIVE:
+    sdl_blit_icon( green_mdr, &r );
+    break;
+  case UI_STATUSBAR_STATE_INACTIVE:
+    sdl_blit_icon( red_mdr, &r );
+    break;
+  case UI_STATUSBAR_STATE_NOT_AVAILABLE:
+    break;
+  }
+
+  r.x = 285;
+  r.y = 220;
+  r.w = red_cassette[0]->w;
+  r.h = red_cassette[0]->h;
+
+  switch( sdl_tape_state ) {
+  case UI_STATUSBAR_STATE_ACTIVE:
+    sdl_blit_icon( green_cassette, &r );
+    break;
+  case UI_STATUSBAR_STATE_INACTIVE:
+  case UI_STATUSBAR_STATE_NOT_AVAILABLE:
+    sdl_blit_icon( red_cassette, &r );
+    break;
+  }
+
+  sdl_status_updated = 0;
+}
+
+/* Set one pixel in the display */
+void
+uidisplay_putpixel( int x, int y, int colour )
+{
+  libspectrum_word *dest_base, *dest;
+  Uint32 *palette_values = settings_current.bw_tv ? bw_values :
+                           colour_values;
+
+  Uint32 palette_colour = palette_values[ colour ];
+
+  if( machine_current->timex ) {
+    x <<= 1; y <<= 1;
+    dest_base = dest =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+
+    *(dest++) = palette_colour;
+    *(dest++) = palette_colour;
+    dest = (libspectrum_word*)
+      ( (libspectrum_byte*)dest_base + tmp_screen->pitch);
+    *(dest++) = palette_colour;
+    *(dest++) = palette_colour;
+  } else {
+    dest =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+
+    *dest = palette_colour;
+  }
+}
+
+/* Print the 8 pixels in `data' using ink colour `ink' and paper
+   colour `paper' to the screen at ( (8*x) , y ) */
+void
+uidisplay_plot8( int x, int y, libspectrum_byte data,
+	         libspectrum_byte ink, libspectrum_byte paper )
+{
+  libspectrum_word *dest;
+  Uint32 *palette_values = settings_current.bw_tv ? bw_values :
+                           colour_values;
+
+  Uint32 palette_ink = palette_values[ ink ];
+  Uint32 palette_paper = palette_values[ paper ];
+
+  if( machine_current->timex ) {
+    int i;
+    libspectrum_word *dest_base;
+
+    x <<= 4; y <<= 1;
+
+    dest_base =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+
+    for( i=0; i<2; i++ ) {
+      dest = dest_base;
+
+      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
+      *(dest++) = ( data & 0x01 ) ? palette_ink : palette_paper;
+      *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
+
+      dest_base = (libspectrum_word*)
+        ( (libspectrum_byte*)dest_base + tmp_screen->pitch);
+    }
+  } else {
+    x <<= 3;
+
+    dest =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+
+    *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
+    *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
+  }
+}
+
+/* Fill the `w' chunks of 8 pixels starting at ( (8*x) , y ) with colour
+   `colour' */
+void
+uidisplay_fill8( int x, int y, int w, libspectrum_byte colour )
+{
+  libspectrum_word *dest;
+  Uint32 *palette_values = settings_current.bw_tv ? bw_values :
+                           colour_values;
+  libspectrum_word palette_colour = palette_values[ colour ];
+  int i, n;
+
+  if( machine_current->timex ) {
+    x <<= 4; y <<= 1; w <<= 4;
+  } else {
+    x <<= 3; w <<= 3;
+  }
+
+  for( i = 0; i < ( machine_current->timex ? 2 : 1 ); i++, y++ ) {
+    dest =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+    for( n = w; n; n-- ) *dest++ = palette_colour;
+  }
+}
+
+/* Print the 16 pixels in `data' using ink colour `ink' and paper
+   colour `paper' to the screen at ( (16*x) , y ) */
+void
+uidisplay_plot16( int x, int y, libspectrum_word data,
+		  libspectrum_byte ink, libspectrum_byte paper )
+{
+  libspectrum_word *dest_base, *dest;
+  int i;
+  Uint32 *palette_values = settings_current.bw_tv ? bw_values :
+                           colour_values;
+  Uint32 palette_ink = palette_values[ ink ];
+  Uint32 palette_paper = palette_values[ paper ];
+  x <<= 4; y <<= 1;
+
+  dest_base =
+    (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                         (x+1) * tmp_screen->format->BytesPerPixel +
+                         (y+1) * tmp_screen->pitch);
+
+  for( i=0; i<2; i++ ) {
+    dest = dest_base;
+
+    *(dest++) = ( data & 0x8000 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x4000 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x2000 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x1000 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0800 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0400 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0200 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0100 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0080 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0040 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0020 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0010 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0008 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0004 ) ? palette_ink : palette_paper;
+    *(dest++) = ( data & 0x0002 ) ? palette_ink : palette_paper;
+    *dest     = ( data & 0x0001 ) ? palette_ink : palette_paper;
+
+    dest_base = (libspectrum_word*)
+      ( (libspectrum_byte*)dest_base + tmp_screen->pitch);
+  }
+}
+
+static void
+sdldisplay_present( void )
+{
+  /* The back buffer's contents are undefined after a present, so always
+     draw the whole texture; only the texture uploads are partial */
+  SDL_RenderClear( sdldisplay_renderer );
+  SDL_RenderCopy( sdldisplay_renderer, sdldisplay_texture, NULL, NULL );
+  SDL_RenderPresent( sdldisplay_renderer );
+}
+
+void
+uidisplay_frame_end( void )
+{
+  SDL_Rect *r;
+  SDL_Rect *last_rect;
+
+  /* We check for a switch to fullscreen here to give systems with a
+     windowed-only UI a chance to free menu etc. resources before
+     the switch to fullscreen (e.g. Mac OS X) */
+  if( sdldisplay_is_full_screen != settings_current.full_screen &&
+      uidisplay_hotswap_gfx_mode() ) {
+    fprintf( stderr, "%s: Error switching to fullscreen\n", fuse_progname );
+    fuse_abort();
+  }
+
+  /* Force a full redraw if requested */
+  if ( sdldisplay_force_full_refresh ) {
+    num_rects = 1;
+
+    updated_rects[0].x = 0;
+    updated_rects[0].y = 0;
+    updated_rects[0].w = image_width;
+    updated_rects[0].h = image_height;
+  }
+
+  /* Nothing has changed, so keep presenting the previous picture */
+  if ( num_rects == 0 && !sdl_status_updated )
+    return;
+
+  last_rect = updated_rects + num_rects;
+
+  for( r = updated_rects; r != last_rect; r++ )
+    sdldisplay_update_texture( r->x, r->y, r->w, r->h );
+
+  if ( settings_current.statusbar )
+    sdl_icon_overlay();
+
+  sdldisplay_present();
+
+  num_rects = 0;
+  sdldisplay_force_full_refresh = 0;
+}
+
+void
+uidisplay_area( int x, int y, int width, int height )
+{
+  if ( sdldisplay_force_full_refresh )
+    return;
+
+  if( num_rects == MAX_UPDATE_RECT ) {
+    sdldisplay_force_full_refresh = 1;
+    return;
+  }
+
+  /* Extend the dirty region by 1 pixel for scalers
+     that "smear" the screen, e.g. 2xSAI */
+  if( scaler_flags & SCALER_FLAGS_EXPAND )
+    scaler_expander( &x, &y, &width, &height, image_width, image_height );
+
+  updated_rects[num_rects].x = x;
+  updated_rects[num_rects].y = y;
+  updated_rects[num_rects].w = width;
+  updated_rects[num_rects].h = height;
+
+  num_rects++;
+}
+
+/* Redraw the window from the texture, which still holds the last frame */
+void
+sdldisplay_expose( void )
+{
+  if( sdldisplay_texture ) sdldisplay_present();
+}
+
+int
+uidisplay_end( void )
+{
+  int i;
+
+  display_ui_initialised = 0;
+
+  sdldisplay_free_screens();
+
+  if( saved ) {
+    SDL_FreeSurface( saved ); saved = NULL;
+  }
+
+  for( i=0; i<2; i++ ) {
+    if ( red_cassette[i] ) {
+      SDL_FreeSurface( red_cassette[i] ); red_cassette[i] = NULL;
+    }
+    if ( green_cassette[i] ) {
+      SDL_FreeSurface( green_cassette[i] ); green_cassette[i] = NULL;
+    }
+    if ( red_mdr[i] ) {
+      SDL_FreeSurface( red_mdr[i] ); red_mdr[i] = NULL;
+    }
+    if ( green_mdr[i] ) {
+      SDL_FreeSurface( green_mdr[i] ); green_mdr[i] = NULL;
+    }
+    if ( red_disk[i] ) {
+      SDL_FreeSurface( red_disk[i] ); red_disk[i] = NULL;
+    }
+    if ( green_disk[i] ) {
+      SDL_FreeSurface( green_disk[i] ); green_disk[i] = NULL;
+    }
+  }
+
+  return 0;
+}
+
+/* Destroy the window; unlike uidisplay_end(), this is called only when
+   the UI is shut down */
+void
+sdldisplay_end( void )
+{
+  if( sdldisplay_renderer ) {
+    SDL_DestroyRenderer( sdldisplay_renderer ); sdldisplay_renderer = NULL;
+  }
+
+  if( sdldisplay_window ) {
+    SDL_DestroyWindow( sdldisplay_window ); sdldisplay_window = NULL;
+  }
+}
+
+/* The statusbar handling function */
+int
+ui_statusbar_update( ui_statusbar_item item, ui_statusbar_state state )
+{
+  switch( item ) {
+
+  case UI_STATUSBAR_ITEM_DISK:
+    sdl_disk_state = state;
+    sdl_status_updated = 1;
+    return 0;
+
+  case UI_STATUSBAR_ITEM_PAUSED:
+    /* We don't support pausing this version of Fuse */
+    return 0;
+
+  case UI_STATUSBAR_ITEM_TAPE:
+    sdl_tape_state = state;
+    sdl_status_updated = 1;
+    return 0;
+
+  case UI_STATUSBAR_ITEM_MICRODRIVE:
+    sdl_mdr_state = state;
+    sdl_status_updated = 1;
+    return 0;
+
+  case UI_STATUSBAR_ITEM_MOUSE:
+    /* We don't support showing a grab icon */
+    return 0;
+
+  }
+
+  ui_error( UI_ERROR_ERROR, "Attempt to update unknown statusbar item %d",
+            item );
+  return 1;
+}
@@ -710,6 +710,32 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   }
 }
 
+/* Fill the `w' chunks of 8 pixels starting at ( (8*x) , y ) with colour
+   `colour' */
+void
+uidisplay_fill8( int x, int y, int w, libspectrum_byte colour )
+{
+  libspectrum_word *dest;
+  Uint32 *palette_values = settings_current.bw_tv ? bw_values :
+                           colour_values;
+  libspectrum_word palette_colour = palette_values[ colour ];
+  int i, n;
+
+  if( machine_current->timex ) {
+    x <<= 4; y <<= 1; w <<= 4;
+  } else {
+    x <<= 3; w <<= 3;
+  }
+
+  for( i = 0; i < ( machine_current->timex ? 2 : 1 ); i++, y++ ) {
+    dest =
+      (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
+                           (x+1) * tmp_screen->format->BytesPerPixel +
+                           (y+1) * tmp_screen->pitch);
+    for( n = w; n; n-- ) *dest++ = palette_colour;
+  }
+}
+
 /* Print the 16 pixels in `data' using ink colour `ink' and paper
    colour `paper' to the screen at ( (16*x) , y ) */
 void
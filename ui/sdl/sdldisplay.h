@@ -24,6 +24,17 @@
 #ifndef FUSE_SDLDISPLAY_H
 #define FUSE_SDLDISPLAY_H
 
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+
+extern SDL_Window *sdldisplay_window;
+
+void sdldisplay_expose( void );
+void sdldisplay_end( void );
+
+#else				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
+
 extern SDL_Surface *sdldisplay_gc;    /* Hardware screen */
 
+#endif				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
+
 #endif			/* #ifndef FUSE_SDLDISPLAY_H */
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <SDL.h>
 
 #include "display.h"
@@ -39,6 +40,45 @@
 #include "utils.h"
 #include "sdlkeyboard.h"
 
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+
+/* SDL 2 has no Unicode value in its key events, so work out the character
+   from the key and the modifiers. The shifted symbols are those of a US
+   keyboard; the input layer's keysyms for printable characters are their
+   ASCII codes */
+static const char unshifted_symbols[] = "`1234567890-=[]\\;',./";
+static const char shifted_symbols[]   = "~!@#$%^&*()_+{}|:\"<>?";
+
+static input_key
+unicode_keysym_from_event( SDL_KeyboardEvent *keyevent )
+{
+  SDL_Keycode sym = keyevent->keysym.sym;
+  int shift = !!( keyevent->keysym.mod & KMOD_SHIFT );
+  const char *ptr;
+
+  if( sym >= SDLK_a && sym <= SDLK_z )
+    return ( shift ^ !!( keyevent->keysym.mod & KMOD_CAPS ) ?
+             INPUT_KEY_A : INPUT_KEY_a ) + ( sym - SDLK_a );
+
+  if( shift && sym > 0 && sym < 0x80 &&
+      ( ptr = strchr( unshifted_symbols, sym ) ) != NULL )
+    return shifted_symbols[ ptr - unshifted_symbols ];
+
+  return INPUT_KEY_NONE;
+}
+
+void
+sdlkeyboard_init(void)
+{
+}
+
+void
+sdlkeyboard_end(void)
+{
+}
+
+#else				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
+
 /* Map low byte of UCS-2(?) Unicode to Fuse input layer keysym for
    upper case letters */
 extern const keysyms_map_t unicode_keysyms_map[];
@@ -75,6 +115,18 @@ sdlkeyboard_end(void)
   g_hash_table_destroy( unicode_keysyms_hash );
 }
 
+static input_key
+unicode_keysym_from_event( SDL_KeyboardEvent *keyevent )
+{
+  /* Currently unicode_keysyms_map contains ASCII character keys */
+  if( ( keyevent->keysym.unicode & 0xFF80 ) == 0 ) 
+    return unicode_keysyms_remap( keyevent->keysym.unicode );
+
+  return INPUT_KEY_NONE;
+}
+
+#endif				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
+
 void
 sdlkeyboard_keypress( SDL_KeyboardEvent *keyevent )
 {
@@ -83,11 +135,7 @@ sdlkeyboard_keypress( SDL_KeyboardEvent *keyevent )
 
   fuse_keysym = keysyms_remap( keyevent->keysym.sym );
 
-  /* Currently unicode_keysyms_map contains ASCII character keys */
-  if( ( keyevent->keysym.unicode & 0xFF80 ) == 0 ) 
-    unicode_keysym = unicode_keysyms_remap( keyevent->keysym.unicode );
-  else
-    unicode_keysym = INPUT_KEY_NONE;
+  unicode_keysym = unicode_keysym_from_event( keyevent );
 
   if( fuse_keysym == INPUT_KEY_NONE && unicode_keysym == INPUT_KEY_NONE )
     return;
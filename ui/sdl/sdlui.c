@@ -60,9 +60,9 @@ ui_init( int *argc, char ***argv )
   if ( error )
     return error;
 
-#ifndef __MORPHOS__
+#if !SDL_VERSION_ATLEAST( 2, 0, 0 ) && !defined __MORPHOS__
   SDL_EnableUNICODE( 1 );
-#endif				/* #ifndef __MORPHOS__ */
+#endif
 
   sdlkeyboard_init();
 
@@ -92,11 +92,17 @@ ui_event( void )
       ui_mouse_button( event.button.button, 0 );
       break;
     case SDL_MOUSEMOTION:
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+      /* The mouse is in relative mode while grabbed */
+      if( ui_mouse_grabbed )
+        ui_mouse_motion( event.motion.xrel, event.motion.yrel );
+#else
       if( ui_mouse_grabbed ) {
         ui_mouse_motion( event.motion.x - 128, event.motion.y - 128 );
         if( event.motion.x != 128 || event.motion.y != 128 )
           SDL_WarpMouse( 128, 128 );
       }	
+#endif
       break;
 
 #if defined USE_JOYSTICK && !defined HAVE_JSW_H
@@ -121,6 +127,22 @@ ui_event( void )
       menu_file_exit(0);
       fuse_emulation_unpause();
       break;
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+    case SDL_WINDOWEVENT:
+      switch( event.window.event ) {
+      case SDL_WINDOWEVENT_EXPOSED:
+      case SDL_WINDOWEVENT_SIZE_CHANGED:
+        sdldisplay_expose();
+        break;
+      case SDL_WINDOWEVENT_FOCUS_GAINED:
+        ui_mouse_resume();
+        break;
+      case SDL_WINDOWEVENT_FOCUS_LOST:
+        ui_mouse_suspend();
+        break;
+      }
+      break;
+#else
     case SDL_VIDEOEXPOSE:
       display_refresh_all();
       break;
@@ -129,6 +151,7 @@ ui_event( void )
 	if( event.active.gain ) ui_mouse_resume(); else ui_mouse_suspend();
       }
       break;
+#endif
     default:
       break;
     }
@@ -148,6 +171,10 @@ ui_end( void )
 
   sdlkeyboard_end();
 
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+  sdldisplay_end();
+#endif
+
   SDL_Quit();
 
   ui_widget_end();
@@ -163,12 +190,42 @@ ui_statusbar_update_speed( float speed )
 
   snprintf( buffer, 15, "%s - %3.0f%%", fuse, speed );
 
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+  if( sdldisplay_window ) SDL_SetWindowTitle( sdldisplay_window, buffer );
+#else
   /* FIXME: Icon caption should be snapshot name? */
   SDL_WM_SetCaption( buffer, fuse );
+#endif
+
+  return 0;
+}
+
+#if SDL_VERSION_ATLEAST( 2, 0, 0 )
+
+int
+ui_mouse_grab( int startup )
+{
+  if( startup && !settings_current.full_screen ) return 0;
+
+  if( SDL_SetRelativeMouseMode( SDL_TRUE ) ) {
+    ui_error( UI_ERROR_WARNING, "Mouse grab failed" );
+    return 0;
+  }
+
+  return 1;
+}
+
+int
+ui_mouse_release( int suspend )
+{
+  if( settings_current.full_screen ) return !suspend;
 
+  SDL_SetRelativeMouseMode( SDL_FALSE );
   return 0;
 }
 
+#else				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
+
 int
 ui_mouse_grab( int startup )
 {
@@ -199,3 +256,5 @@ ui_mouse_release( int suspend )
   SDL_ShowCursor( SDL_ENABLE );
   return 0;
 }
+
+#endif				/* #if SDL_VERSION_ATLEAST( 2, 0, 0 ) */
@@ -52,5 +52,6 @@ void uidisplay_plot8( int x, int y, libspectrum_byte data, libspectrum_byte ink,
                       libspectrum_byte paper );
 void uidisplay_plot16( int x, int y, libspectrum_word data, libspectrum_byte ink,
                        libspectrum_byte paper);
+void uidisplay_fill8( int x, int y, int w, libspectrum_byte colour );
 
 #endif			/* #ifndef FUSE_UIDISPLAY_H */
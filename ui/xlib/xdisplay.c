@@ -1124,6 +1124,32 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   }
 }
 
+/* Fill the `w' chunks of 8 pixels starting at ( (8*x) , y ) with colour
+   `colour' */
+void
+uidisplay_fill8( int x, int y, int w, libspectrum_byte colour )
+{
+  libspectrum_word *dest;
+  libspectrum_word pc = settings_current.bw_tv ? pal_grey[ colour ] :
+                        	pal_colour[ colour ];
+  int n;
+
+  if( machine_current->timex ) {
+
+    x <<= 4; y <<= 1;
+
+    dest = &(rgb_image[y + 2][x + 1]);
+
+    for( n = w << 4; n; n-- ) { *(dest + rgb_pitch) = *dest = pc; dest++; }
+  } else {
+    x <<= 3;
+
+    dest = &(rgb_image[y + 2][x + 1]);
+
+    for( n = w << 3; n; n-- ) *dest++ = pc;
+  }
+}
+
 /* Print the 16 pixels in `data' using ink colour `ink' and paper
    colour `paper' to the screen at ( (16*x) , y ) */
 void
@@ -28,6 +28,7 @@
 
 #include "debugger/debugger.h"
 #include "fuse.h"
+#include "loader.h"
 #include "machine.h"
 #include "mempool.h"
 #include "periph.h"
@@ -47,7 +48,11 @@
 #include "peripherals/ttx2000s.h"
 #include "peripherals/ula.h"
 #include "peripherals/usource.h"
+#include "rewind.h"
+#include "rzx.h"
 #include "settings.h"
+#include "sound.h"
+#include "state.h"
 #include "unittests.h"
 
 static int
@@ -788,6 +793,11 @@ unittests_run( void )
   r += mempool_test();
   r += paging_test();
   r += debugger_disassemble_unittest();
+  r += loader_unittest();
+  r += sound_unittest();
+  r += state_unittest();
+  r += rewind_unittest();
+  r += rzx_unittest();
 
   printf("Final return value: %d (should be 0)\n", r);
 
@@ -631,6 +631,20 @@ module_register( module_info_t *module GCC_UNUSED )
   return 0;
 }
 
+void
+state_buffer_write( state_buffer_t *buffer GCC_UNUSED,
+                    const void *data GCC_UNUSED, size_t length GCC_UNUSED )
+{
+  /* Do nothing */
+}
+
+void
+state_buffer_read( state_buffer_t *buffer GCC_UNUSED, void *data GCC_UNUSED,
+                   size_t length GCC_UNUSED )
+{
+  /* Do nothing */
+}
+
 void
 z80_debugger_variables_init( void )
 {
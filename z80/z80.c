@@ -37,6 +37,7 @@
 #include "rzx.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "z80.h"
 #include "z80_internals.h"
@@ -74,6 +75,8 @@ int z80_nmos_iff2_event;
 static void z80_init_tables(void);
 static void z80_from_snapshot( libspectrum_snap *snap );
 static void z80_to_snapshot( libspectrum_snap *snap );
+static void z80_state_save( state_buffer_t *buffer );
+static int z80_state_load( state_buffer_t *buffer );
 static void z80_nmi( libspectrum_dword ts, int type, void *user_data );
 
 static module_info_t z80_module_info = {
@@ -83,6 +86,10 @@ static module_info_t z80_module_info = {
   NULL,
   z80_from_snapshot,
   z80_to_snapshot,
+  STATE_ID( 'Z', '8', '0', 'R' ),
+  1,
+  z80_state_save,
+  z80_state_load,
 
 };
 
@@ -352,3 +359,19 @@ z80_to_snapshot( libspectrum_snap *snap )
      independent of this flag */
   libspectrum_snap_set_last_instruction_set_f( snap, !!Q );
 }
+
+/* The state never leaves this process, so the processor can be copied as
+   it is */
+static void
+z80_state_save( state_buffer_t *buffer )
+{
+  state_buffer_write( buffer, &z80, sizeof( z80 ) );
+}
+
+static int
+z80_state_load( state_buffer_t *buffer )
+{
+  state_buffer_read( buffer, &z80, sizeof( z80 ) );
+
+  return 0;
+}